@@ -0,0 +1,47 @@
+#ifndef ASSET_CACHE_CLASS_H
+#define ASSET_CACHE_CLASS_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <functional>
+#include <glad/glad.h>
+
+/*
+Reference counted cache of GL assets loaded from disk.
+Assets are keyed by their path and the parameters they were created with,
+so identical textures, cubemaps, and fonts are decoded and uploaded once.
+Must only be used from the thread owning the GL context.
+*/
+class AssetCache
+{
+    public:
+        // Creates the asset texture on a cache miss, returns its GL name or 0 on failure
+        // data may be set to CPU side information shared by every user of the asset
+        typedef std::function<GLuint(std::shared_ptr<void>& data)> Loader;
+
+        // Get asset stored under key, loading it on first use, and add a reference
+        static GLuint Acquire(const std::string& key, Loader load, std::shared_ptr<void> * data = NULL);
+
+        // Whether an asset is stored under key
+        static bool Contains(const std::string& key);
+
+        // Drop a reference to the asset, the GL object is deleted with the last reference
+        static void Release(GLuint ID);
+
+        // Build a cache key from asset kind, path, and creation parameters
+        static std::string Key(const char * kind, const std::string& path, GLenum param1 = 0, GLenum param2 = 0);
+
+    private:
+        struct Entry
+        {
+            GLuint ID;
+            unsigned int references;
+            std::shared_ptr<void> data;
+        };
+
+        static std::map<std::string, Entry> entries;
+        static std::map<GLuint, std::string> keys;
+};
+
+#endif // !ASSET_CACHE_CLASS_H
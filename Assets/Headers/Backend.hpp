@@ -25,6 +25,7 @@
 // C++ headers
 #include <iostream>
 #include <map>
+#include <atomic>
 
 #include "Constants.hpp"
 
@@ -39,8 +40,15 @@ struct WindowData
     const char * title;
     GLFWmonitor * monitor;
     bool fullscreen;
+    bool onDemand = true; // Only redraw when something changed instead of every vsync
 };
 
+// Frames drawn after the scene is marked dirty, lets ImGui settle hover and layout state
+#define REDRAW_FRAMES 3
+
+// Longest time in seconds the main loop sleeps without events when rendering on demand
+#define IDLE_TIMEOUT 0.5
+
 GLFWwindow * initWindow(int width, int height, const char * title, GLFWmonitor *fullscreen, GLFWwindow *share = NULL);
 
 void initIMGUI(GLFWwindow * window);
@@ -59,6 +67,15 @@ void ActivateTextSettings();
 
 void DeactivateTextSettings();
 
+// Request that the next frames are drawn, safe to call from any thread
+void MarkDirty(int frames = REDRAW_FRAMES);
+
+// Returns true if a frame should be drawn and counts it against the pending redraws
+bool ConsumeRedraw();
+
+// Install callbacks that mark the scene dirty on input, call before initIMGUI so ImGui chains them
+void InstallRedrawCallbacks(GLFWwindow * window);
+
 struct ScopedID {
     ScopedID(unsigned int id) {
         ImGui::PushID(id);  // Push the ID when the object is created
@@ -73,4 +90,12 @@ struct ScopedID {
 void window_size_callback(GLFWwindow* window, int width, int height);
 void window_iconify_callback(GLFWwindow* window, int iconified);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos);
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void char_callback(GLFWwindow* window, unsigned int codepoint);
+void cursor_enter_callback(GLFWwindow* window, int entered);
+void window_focus_callback(GLFWwindow* window, int focused);
+void window_refresh_callback(GLFWwindow* window);
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 #endif // !BACKEND_H
\ No newline at end of file
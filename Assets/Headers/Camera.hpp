@@ -10,6 +10,7 @@
 #include <glm/gtx/vector_angle.hpp>
 
 #include "Shader.hpp"
+#include "UBO.hpp"
 #include "Constants.hpp"
 
 #define DEFAULT_SPEED 0.1f;
@@ -30,6 +31,9 @@ class Camera
 
         glm::mat4 view = MAT_IDENTITY;
 
+        // Camera uniform block shared by every shader program
+        UBO<CameraBlock> ubo;
+
         // Camera Attributes
         float FOVdeg = 45.0f;
         float nearPlane = 0.1f;
@@ -52,13 +56,13 @@ class Camera
         // Main camera constructor
         Camera(int width, int height, glm::vec3 position);
 
-        // Update the view and projection matrices of the camera
+        // Update the view and projection matrices of the camera and upload them to the camera block
         void UpdateMatrix(int width, int height);
 
         // Export the camera matrix to the vertex Shader
         void Matrix(Shader& shader, const char* uniform);
 
-        // Camera input handler
-        void Input(GLFWwindow * window, double deltaTime = 1.0);
+        // Camera input handler, returns true if the camera moved
+        bool Input(GLFWwindow * window, double deltaTime = 1.0);
 };
 #endif // !CAMERA_CLASS_H
@@ -13,6 +13,8 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Constants.hpp"
+#include "AssetCache.hpp"
+#include "ImageDecoder.hpp"
 
 // Matrix Operation Headers
 #include <glm/glm.hpp>
@@ -36,7 +38,11 @@ class Cubemap
         FileType format;
         Cubemap(const char* cubeDir, FileType format = PNG);
 
+        // Load face textures, or share them with a cubemap loaded from the same directory
         void BindTextures();
+
+        // Release face textures and delete buffers
+        void Delete();
         
         void Draw(Shader & shader, Camera & camera, 
             glm::mat4 matrix = MAT_IDENTITY,
@@ -47,6 +53,10 @@ class Cubemap
         void DrawSkybox(Shader & shader, Camera & camera, int width, int height);
     private:
         std::string faces[6];
+        std::string directory;
+
+        // Decode the six faces into a new cube map texture
+        GLuint LoadTextures();
 };
 
 #endif // !CUBEMAP_CLASS_H
\ No newline at end of file
@@ -17,6 +17,10 @@ class EBO
         // EBO constructor for storing index array and EBO information
         EBO(std::vector<GLuint> indices, GLenum usage = GL_STATIC_DRAW);
 
+        EBO();
+
+        void BufferData(unsigned int size, GLenum usage = GL_STATIC_DRAW);
+
         // Bind EBO to binding point
         void Bind();
 
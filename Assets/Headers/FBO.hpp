@@ -3,6 +3,7 @@
 
 #include <glad/glad.h>
 #include <stdio.h>
+#include <functional>
 
 #include "Shader.hpp"
 #include "Camera.hpp"
@@ -10,6 +11,18 @@
 #include "VAO.hpp"
 #include "VBO.hpp"
 
+// Largest asynchronous pick radius, regions are up to (2 * PICK_MAX_RADIUS + 1)^2 pixels
+#define PICK_MAX_RADIUS 4
+
+// Number of asynchronous picks that can be in flight at once
+#define PICK_BUFFERS 3
+
+// Stencil value written by the selected spectrum, other meshes write 1
+#define OUTLINE_STENCIL 2
+
+// Largest outline width in pixels
+#define OUTLINE_MAX_WIDTH 10
+
 /*
 ### Frame Buffer Object (FBO)
 Class for defining and handling custom OpenGL frame buffers
@@ -46,6 +59,11 @@ class FBO
         };
 
         Pixel ReadPixel(GLuint x, GLuint y);
+
+    protected:
+        // Size of the attachments
+        int width = 0;
+        int height = 0;
         
     private:
         // Reference ID for Frame Buffer texture
@@ -60,13 +78,80 @@ class SelectionFBO : public FBO
 {
     public:
         static GLuint currSel;
-        void InitVAO(void * meshPtr, VAO<PosVertex> &vao);
-        void InitVAO(Mesh *ptr, VAO<PosVertex> &vao);
-        void SelectMesh(Shader & selection_shader, Camera & camera, std::map<std::string, void *> nmrMeshes);
-        void SelectMesh(Shader & selection_shader, Camera & camera, std::vector<Mesh *> vector);
-        void DrawSelection(Shader & selection_shader, Camera & camera, VAO<PosVertex> & vao, NMRMesh * mesh);
-        void DrawSelection(Shader &shader, Camera &camera, VAO<PosVertex> &vao, Mesh * ptr);
+
+        typedef std::function<void(Pixel)> PickCallback;
+
+        // Queue a pick at window pixel (x, y), the ID pass is only drawn while a pick is pending
+        // A radius above 0 reads a (2 * radius + 1)^2 region and picks the object nearest to (x, y)
+        void RequestPick(GLuint x, GLuint y, int radius = 0, PickCallback callback = nullptr);
+
+        // Retrieve the oldest finished pick without stalling, returns false while none is ready
+        // The request's callback, if any, is invoked before returning
+        bool PollPick(Pixel & pixel);
+
+        // Whether a pick is pending or still being read back
+        bool Busy();
+
+        // Delete frame buffer and picking buffers
+        void Delete();
+
+        // Draw the ID pass of all meshes (skipped when no pick is pending)
+        void SelectMesh(Shader & selection_shader, Camera & camera, std::map<std::string, NMRMesh *> & nmrMeshes, Shader * heightfield_shader = NULL);
+        void SelectMesh(Shader & selection_shader, Camera & camera, std::vector<Mesh *> & vector);
+        void DrawSelection(Shader & selection_shader, Camera & camera, NMRMesh * mesh);
+        void DrawSelection(Shader &shader, Camera &camera, Mesh * ptr);
+    private:
+        // Pixel buffer read of a pick region, completed when fence is signaled
+        struct PickRead
+        {
+            GLuint pbo = 0;
+            GLsync fence = 0;
+            int width = 0, height = 0;  // Size of the region read
+            int cx = 0, cy = 0;         // Requested pixel inside the region
+            PickCallback callback;
+        };
+
+        // Copy the requested region of the ID pass into the next free pixel buffer
+        void IssueRead();
+
+        bool pickPending = false;
+        GLuint pickX = 0, pickY = 0;
+        int pickRadius = 0;
+        PickCallback pickCallback;
+
+        PickRead reads[PICK_BUFFERS]; // Ring of in flight reads
+        int readHead = 0;
+        int readCount = 0;
+};
+
+/*
+Screen-space selection outline. The stencil buffer of the default frame buffer
+is copied into a texture and a screen-space pass colors pixels near those with
+OUTLINE_STENCIL, so the cost depends on the screen area of the mesh and not on
+its vertex count. The pass is scissored to the projected bounds of the mesh.
+*/
+class OutlinePass
+{
+    public:
+        // Draw outline around pixels of the default frame buffer holding OUTLINE_STENCIL
+        // bounds maps the [-1, 1] box of the object to clip space, the whole screen is used if NULL
+        // padding is the number of pixels the object draws past its box, such as the radius of points
+        void Draw(Shader & shader, int width, int height, float lineWidth, const float color[4], const glm::mat4 * bounds = NULL, float padding = 0.0f);
+
+        void Delete();
+
     private:
+        // Create frame buffer with a depth-stencil texture of the given size
+        void Init(int width, int height);
+
+        // Pixel rectangle covered by the projection of the [-1, 1] box of bounds
+        static bool ScreenBounds(const glm::mat4 & bounds, int width, int height, int & x0, int & y0, int & x1, int & y1);
+
+        GLuint ID = 0;
+        GLuint stencilID = 0;
+        GLuint vaoID = 0;   // Attribute-less vertex array for the full-screen triangle
+        int width = 0;
+        int height = 0;
 };
 
 #endif // !FRAME_BUFFER_HEADER_H
\ No newline at end of file
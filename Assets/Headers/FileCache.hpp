@@ -0,0 +1,28 @@
+#ifndef FILE_CACHE_CLASS_H
+#define FILE_CACHE_CLASS_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <fstream>
+#include <functional>
+
+// Starting value of FileCache::Hash64
+#define FILE_CACHE_HASH_SEED 14695981039346656037ULL
+
+/*
+Helpers shared by the on-disk caches (shader binaries, spectrum caches):
+a hash to key cache files by, and writes that never leave a truncated file.
+*/
+class FileCache
+{
+    public:
+        // 64 bit FNV-1a hash of data, continuing from hash so several buffers can be chained
+        static uint64_t Hash64(const void * data, size_t size, uint64_t hash = FILE_CACHE_HASH_SEED);
+
+        // Write path through a temporary file that is renamed once write succeeds,
+        // write returns false to abandon the file. Returns false if nothing was written
+        static bool WriteAtomic(const std::string& path, const std::function<bool(std::ofstream&)>& write);
+};
+
+#endif // !FILE_CACHE_CLASS_H
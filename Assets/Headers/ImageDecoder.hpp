@@ -0,0 +1,74 @@
+#ifndef IMAGE_DECODER_CLASS_H
+#define IMAGE_DECODER_CLASS_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Decoded image, pixels are released with stbi_image_free
+struct Image
+{
+    unsigned char * pixels = NULL;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+};
+
+/*
+Background image decoder.
+Images are decoded with stb_image on worker threads, the OpenGL thread
+requests every image it is about to need and then collects the decoded
+pixels for upload, so several images decode at the same time.
+*/
+class ImageDecoder
+{
+    public:
+        // Start decoder with given number of worker threads (0 picks from hardware)
+        ImageDecoder(unsigned int workerCount = 0);
+
+        // Stop workers and release any images that were never collected
+        ~ImageDecoder();
+
+        // Queue image for decoding, ignored if image is already queued
+        void Request(const std::string& path, bool flip);
+
+        // Get decoded image, waiting for a queued decode or decoding on the calling thread
+        // Returned pixels are NULL if the image could not be loaded
+        Image Get(const std::string& path, bool flip);
+
+        // Decoder shared by textures, cubemaps, and models
+        static ImageDecoder& Shared();
+
+    private:
+        struct Job
+        {
+            std::string path;
+            bool flip;
+            bool started = false;
+            bool done = false;
+            Image image;
+        };
+
+        // Worker thread loop
+        void Work();
+
+        // Decode image with stb_image on the calling thread
+        static Image Decode(const std::string& path, bool flip);
+
+        static std::string Key(const std::string& path, bool flip);
+
+        std::vector<std::thread> workers;
+        std::mutex queueMutex;
+        std::condition_variable queueCond;      // Signals workers that jobs are pending
+        std::condition_variable doneCond;       // Signals Get that a job finished
+        bool stopping = false;
+
+        std::deque<Job *> pending;              // Waiting for a worker
+        std::map<std::string, Job *> jobs;      // Requested and not yet collected
+};
+
+#endif // !IMAGE_DECODER_CLASS_H
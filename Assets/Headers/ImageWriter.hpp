@@ -0,0 +1,61 @@
+#ifndef IMAGE_WRITER_CLASS_H
+#define IMAGE_WRITER_CLASS_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+/*
+Background image writer.
+Images are encoded to PNG with stb_image_write on worker threads,
+so encoding overlaps with rendering on the OpenGL thread.
+*/
+class ImageWriter
+{
+    public:
+        // Start writer with given number of worker threads (0 picks from hardware)
+        ImageWriter(unsigned int workerCount = 0);
+
+        // Write remaining images and stop workers
+        ~ImageWriter();
+
+        // Queue image for writing, pixels are moved into the writer
+        // Rows are ordered bottom to top as read from OpenGL
+        void Write(const std::string& path, std::vector<unsigned char>& pixels, int width, int height, int channels);
+
+        // Wait until every queued image is written
+        // Returns the number of images that failed to write since the last call
+        int Finish();
+
+        // Number of images queued or being written
+        size_t Pending();
+
+    private:
+        struct Job
+        {
+            std::string path;
+            std::vector<unsigned char> pixels;
+            int width, height, channels;
+        };
+
+        // Worker thread loop
+        void Work();
+
+        // Flip rows and encode image on the calling thread, returns false on failure
+        static bool Encode(Job& job);
+
+        std::vector<std::thread> workers;
+        std::mutex queueMutex;
+        std::condition_variable queueCond;      // Signals workers that jobs are pending
+        std::condition_variable doneCond;       // Signals Finish that a job finished
+        bool stopping = false;
+
+        std::deque<Job *> pending;              // Waiting for a worker
+        size_t active = 0;                      // Being written by a worker
+        int failures = 0;
+};
+
+#endif // !IMAGE_WRITER_CLASS_H
@@ -0,0 +1,50 @@
+#ifndef MEMORY_BUDGET_CLASS_H
+#define MEMORY_BUDGET_CLASS_H
+
+#include <map>
+#include <cstddef>
+
+class NMRMesh;
+
+// Default and largest budget for CPU-side spectral data in megabytes
+#define MEMORY_BUDGET_MB 2048
+#define MEMORY_BUDGET_MAX_MB 65536
+
+/*
+Global budget for the CPU-side data of NMR meshes: spectrum matrices,
+NMR library mesh buffers, vertex and index copies, and planes read ahead.
+When usage exceeds the budget, the copies of the least recently viewed
+meshes are released once they are on the GPU, spectra are read from disk
+again when a render mode needs them.
+Must only be used from the thread owning the GL context.
+*/
+class MemoryBudget
+{
+    public:
+        static size_t budget;   // Budget in bytes
+        static bool showUI;
+
+        // Track mesh, called on NMRMesh construction and destruction
+        static void Register(NMRMesh * mesh);
+        static void Unregister(NMRMesh * mesh);
+
+        // Mark mesh as viewed in the current frame
+        static void Touch(NMRMesh * mesh);
+
+        // Release the data of least recently viewed meshes until usage fits the budget
+        // Call once per frame after the meshes are displayed
+        static void Enforce();
+
+        // Bytes held by all tracked meshes
+        static size_t Usage();
+
+        // Draw budget window
+        static void DisplayUI();
+
+    private:
+        static std::map<NMRMesh *, unsigned long> meshes;  // Frame each mesh was last viewed in
+        static unsigned long frame;
+        static size_t released;                             // Bytes released since start
+};
+
+#endif // !MEMORY_BUDGET_CLASS_H
@@ -23,7 +23,6 @@ class Mesh
         Vertices vertices;
         Indices indices;
         Textures textures;
-        PosVertices posVertices;
 
         GLenum primative = GL_TRIANGLES;
         VAO<Vertex> vao;
@@ -52,11 +51,96 @@ class Mesh
             glm::vec3 globalScale = ONES
         );
         
+        // Upload at most maxBytes of pending buffer data (0 uploads everything)
+        // Returns true once the mesh is fully resident on the GPU
+        bool UploadStep(size_t maxBytes = 0);
+
+        // Fraction of buffer data uploaded so far
+        float UploadProgress();
+
+        // Delete vertex arrays and buffers, only for meshes that are not copied
+        // Buffers shared with other meshes are left to their owner
+        void Delete();
+
+        // Activate shader and bind textures and material uniforms
+        void BindMaterial(Shader& shader);
+
+        // Free the CPU copies of vertices and indices once they are uploaded
+        // Returns the number of bytes released
+        size_t ReleaseVertexData();
+
         GLuint ID;
         glm::vec3 pos = ZEROS;
+
+        // Vertex and index buffers, shared with the picking pass
+        GLuint vboID = 0;
+        GLuint eboID = 0;
+
+        // Position-only vertex array over vboID and eboID used by the picking pass
+        VAO<PosVertex> pickVAO;
+        bool uploaded = true; // False while a staged upload is in progress
+
+        // Location of the mesh in its buffers, non-zero for meshes in shared buffers
+        GLint baseVertex = 0;
+        GLuint firstIndex = 0;
+
+        // Vertices and indices in the buffers, kept when the CPU copies are released
+        size_t bufferVertices = 0;
+        size_t bufferIndices = 0;
     protected:
         // Internal mesh initialization function used by Mesh and its children
         void initMesh(Vertices& vertices, Indices& indices, Textures& textures);
+
+        // Allocate GPU buffers and take ownership of mesh data without filling the buffers
+        // Data is streamed to the GPU by subsequent UploadStep calls
+        void beginUpload(Vertices& vertices, Indices& indices, Textures& textures);
+
+        // Like beginUpload, but stores the mesh at the given location of buffers owned elsewhere
+        void beginSharedUpload(Vertices& vertices, Indices& indices, Textures& textures,
+                               GLuint vbo, GLuint ebo, GLint baseVertex, GLuint firstIndex);
+
+        // Activate shader and send textures, camera, and transformation uniforms
+        void BindUniforms
+        (
+            Shader& shader,
+            Camera& camera,
+            glm::mat4 matrix = MAT_IDENTITY,
+            glm::vec3 translation = ZEROS,
+            glm::quat rotation = QUAT_IDENTITY,
+            glm::vec3 scale = ONES,
+            glm::vec3 globalTranslation = ZEROS,
+            glm::quat globalRotation = QUAT_IDENTITY,
+            glm::vec3 globalScale = ONES
+        );
+
+        // Link pickVAO to the current vertex and index buffers
+        void initPickVAO();
+
+        // Build sampler uniform names of textures, done once instead of per draw
+        void initSamplerNames();
+
+        // Sampler uniform name of each texture
+        std::vector<std::string> samplerNames;
+
+        // Sampler handles of each texture in a program the mesh was drawn with
+        struct SamplerHandles
+        {
+            GLuint program;
+            std::vector<UniformHandle> handles;
+        };
+
+        // Sampler handles per program, a mesh is drawn by only a few programs
+        std::vector<SamplerHandles> samplerHandles;
+
+        // Sampler handles of the textures in shader, looked up on the first draw with it
+        const std::vector<UniformHandle>& Samplers(const Shader& shader);
+
+        // Staged upload state
+        size_t vertexOffset = 0;
+        size_t indexOffset = 0;
+
+        // False if vboID and eboID belong to shared buffers
+        bool ownsBuffers = true;
 };
 
 #endif // !MESH_CLASS_H
\ No newline at end of file
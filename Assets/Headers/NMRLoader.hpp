@@ -0,0 +1,90 @@
+#ifndef NMRLOADER_CLASS_H
+#define NMRLOADER_CLASS_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "NMRMesh.hpp"
+
+/*
+Background loader for NMR spectra.
+Files are read and meshed on worker threads, finished data is
+handed back through a queue and uploaded on the OpenGL thread.
+*/
+class NMRLoader
+{
+    public:
+        // Loading stage of a requested file
+        enum Stage { QUEUED, READING, UPLOADING };
+
+        // Start loader with given number of worker threads (0 picks from hardware)
+        // Must be created with the OpenGL context current, its texture limit is read
+        NMRLoader(unsigned int workerCount = 0);
+
+        // Stop workers and release any pending data
+        ~NMRLoader();
+
+        // Stop workers and delete pending jobs, must run while the OpenGL context is alive
+        // as meshes still uploading are deleted (called again by the destructor, then a no-op)
+        void Shutdown();
+
+        // Queue file for loading, ignored if file is already loading
+        void Request(std::string file);
+
+        // Queue every file in nmrMeshes that does not have a mesh yet
+        void RequestMissing(std::map<std::string, NMRMesh *>& nmrMeshes);
+
+        // Create meshes for finished files and stream their buffers (OpenGL thread only)
+        // Fully uploaded meshes are placed into nmrMeshes
+        void Poll(std::map<std::string, NMRMesh *>& nmrMeshes);
+
+        // Whether file is currently queued, reading, or uploading
+        bool IsLoading(std::string file);
+
+        // Whether any file is loading
+        bool Busy();
+
+        // Current stage and progress [0, 1] of file, returns false if file is not loading
+        bool Progress(std::string file, Stage& stage, float& progress);
+
+        // Maximum bytes of vertex data uploaded per frame
+        size_t uploadBudget = 32 * 1024 * 1024;
+
+        // Load spectra as GPU heightfields, skipping CPU mesh building
+        std::atomic<bool> heightfield{false};
+
+        // Open 2D spectra from sidecar cache files, written on first load
+        std::atomic<bool> useCache{false};
+
+    private:
+        struct Job
+        {
+            std::string file;
+            Stage stage = QUEUED;
+            std::atomic<float> progress{0.0f};
+            NMRData data;
+            NMRMesh * mesh = NULL;
+            std::string error;
+        };
+
+        // Worker thread loop
+        void Work();
+
+        std::vector<std::thread> workers;
+        std::mutex queueMutex;
+        std::condition_variable queueCond;
+        bool stopping = false;
+        GLint maxTextureSize = 0;               // GL_MAX_TEXTURE_SIZE, read by workers
+
+        std::deque<Job *> pending;              // Waiting for a worker
+        std::deque<Job *> finished;             // Meshed, waiting for the OpenGL thread
+        std::deque<Job *> uploading;            // Streaming to the GPU (OpenGL thread only)
+        std::map<std::string, Job *> jobs;      // All active jobs by file
+};
+
+#endif // !NMRLOADER_CLASS_H
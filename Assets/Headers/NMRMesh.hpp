@@ -3,6 +3,9 @@
 
 #include <string>
 #include <vector>
+#include <mutex>
+#include <atomic>
+#include <future>
 #include "VAO.hpp"
 #include "EBO.hpp"
 #include "Camera.hpp"
@@ -12,6 +15,8 @@
 #include "UI.hpp"
 #include "Cubemap.hpp"
 #include "Shapes.hpp"
+#include "Terrain.hpp"
+#include "RenderQueue.hpp"
 
 extern "C" {
 #include "fdatap.h"
@@ -27,6 +32,39 @@ extern "C" {
 #include "nmrgraphics.h"
 }
 
+class NMRLoader;
+class OutlinePass;
+class PlaneReader;
+class SpectrumCache;
+
+// Texture unit of the heightfield intensity texture (0 and 1 hold the mesh textures)
+#define HEIGHTFIELD_UNIT 2
+
+/*
+CPU-side NMR spectrum and mesh data, built without an OpenGL context
+*/
+struct NMRData
+{
+    std::string file;
+    int sizeList[MAXDIM], qSizeList[MAXDIM], dimCount;
+    float fdata[FDATASIZE];
+    NMR_INT totalSize;
+    int qSize, vertexCount, indexCount, normCount;
+    float minVal, maxVal;
+    float * mat = (float *)NULL;
+    void * matMap = NULL;
+    NMR_INT matMapSize = 0;
+    float * vertexList = (float *)NULL;
+    int * indexList = (int *)NULL;
+    float * normXYZ = (float *)NULL;
+    Vertices vertices;
+    Indices indices;
+    bool meshBuilt = false; // False if mesh building was skipped for heightfield display
+    PlaneReader * planes = NULL; // Reader of 3D/4D data, mat holds its first plane (NULL for 2D data)
+    SpectrumCache * cache = NULL; // Mapped cache file of 2D data, mat is NULL when read from the cache
+    Terrain * terrain = NULL; // Terrain of cached 2D data, or of 2D data too large for a heightfield texture
+};
+
 /*
 Mesh Object for NMR Data
 */
@@ -37,10 +75,25 @@ class NMRMesh : public Mesh
         NMRMesh();
 
         // Destructor
-        // ~NMRMesh();
+        ~NMRMesh();
 
         // Initialize and create a NMRMesh based on given NMR file and primative
-        NMRMesh(std::string file, GLenum primative = GL_TRIANGLES); //Vertices& vertices, Indices& indices, Textures& textures
+        // mapFile memory maps the spectral data instead of copying it into a heap buffer
+        NMRMesh(std::string file, GLenum primative = GL_TRIANGLES, bool mapFile = true); //Vertices& vertices, Indices& indices, Textures& textures
+
+        // Create a NMRMesh from data prepared by LoadData, buffers are streamed with UploadStep
+        NMRMesh(NMRData& data, GLenum primative = GL_TRIANGLES);
+
+        // Read NMR file and build mesh data on the calling thread (no OpenGL calls)
+        // buildMesh can be disabled when the spectrum is only displayed as a heightfield,
+        // spectra that cannot be heightfields are meshed regardless
+        // useCache opens 2D spectra from their cache file, writing it first if needed
+        // maxTextureSize is the GL_MAX_TEXTURE_SIZE of the context, 2D spectra beyond it
+        // are given a terrain instead of a mesh (0 leaves the choice to the OpenGL thread)
+        static void LoadData(std::string file, NMRData& data, bool mapFile = true, std::atomic<float> * progress = NULL, bool buildMesh = true, bool useCache = false, int maxTextureSize = 0);
+
+        // Release NMR buffers held by data that was not handed to a NMRMesh
+        static void FreeData(NMRData& data);
         
         // Draw NMRMesh object
         void Draw(
@@ -52,12 +105,67 @@ class NMRMesh : public Mesh
             glm::vec3 scale = ONES
         );
 
+        // Draw NMRMesh as a heightfield, vertices are generated by the "_hf" shader variants
+        void DrawHeightfield(
+            Shader& shader,
+            Camera& camera,
+            glm::mat4 matrix = MAT_IDENTITY,
+            glm::vec3 translation = ZEROS,
+            glm::quat rotation = QUAT_IDENTITY,
+            glm::vec3 scale = ONES
+        );
+
+        // Draw tiles chosen by the level of detail terrain
+        void DrawTerrain(
+            Shader& shader,
+            Camera& camera,
+            glm::mat4 matrix = MAT_IDENTITY,
+            glm::vec3 translation = ZEROS,
+            glm::quat rotation = QUAT_IDENTITY,
+            glm::vec3 scale = ONES
+        );
+
+        // Draw a line along the normal of every grid point with the "normals" shaders
+        // Lines are instanced from the vertices of the current draw mode, one instance per point
+        void DrawNormals(
+            Shaders& shaders,
+            Camera& camera,
+            glm::mat4 matrix = MAT_IDENTITY,
+            glm::vec3 translation = ZEROS,
+            glm::quat rotation = QUAT_IDENTITY,
+            glm::vec3 scale = ONES
+        );
+
+        // Upload spectrum as a single channel heightfield texture, returns false if unsupported
+        bool InitHeightfield();
+
+        // Build level of detail terrain for the spectrum in the background, returns false if unsupported
+        bool InitTerrain();
+
+        // Build and upload the vertex mesh of a spectrum loaded without one
+        void BuildMesh();
+
+        // Display another plane of 3D/4D data, rebuilding the current render mode only
+        // Returns false for 2D data or if the plane could not be read
+        bool SetPlane(int z, int a = 0);
+
+        // CPU bytes of spectrum and mesh data held by the mesh
+        size_t MemoryUsage();
+
+        // Free CPU copies that drawing does not need, returns the number of bytes released
+        // The spectrum is kept while it is drawn as terrain, which meshes tiles from it
+        // Library owned data is kept until a call that finds rdMutex free
+        size_t ReleaseMemory();
+
+        // Read the spectrum (or current plane) again after ReleaseMemory, returns false on failure
+        bool Reload();
+
         void updateUniforms(Shaders & shaders);
 
         void resetAttributes();
         
-        // Display object instance
-        void Display(WindowData &win, Camera & camera, Shaders &shaders);
+        // Display object instance, mesh draws are added to queue when given
+        void Display(WindowData &win, Camera & camera, Shaders &shaders, RenderQueue * queue = NULL);
 
         // Display all UI elements
         void DisplayUI(WindowData &win, Camera & camera, Shaders &shaders);
@@ -65,8 +173,8 @@ class NMRMesh : public Mesh
         // Bounding Box Display
         void DisplayBoundingBox(Camera & camera, Shaders &shaders);
 
-        // Stencil Display
-        void DisplayStencil(Camera & camera, Shaders &shaders);
+        // Selection outline, drawn by the outline pass after all meshes
+        void DisplayStencil(OutlinePass &pass, WindowData &win, Camera &camera, Shaders &shaders);
         
         // Spectral settings UI
         void SpectraUI();
@@ -84,6 +192,7 @@ class NMRMesh : public Mesh
         
         unsigned int ID; // Unique NMRMesh object ID
         static GLuint selID; // ID of selected object
+        static std::mutex rdMutex; // Guards the NMR library, which keeps global state
 
         // Display Attributes
 
@@ -94,6 +203,10 @@ class NMRMesh : public Mesh
         bool showNormals = false;
         bool showGizmo = true;
 
+        bool heightfield = false; // Draw from heightfield texture instead of vertex mesh
+        bool hfQuantize = false; // Store heightfield as 16-bit normalized instead of 32-bit float
+        bool terrainLOD = false; // Draw level of detail terrain tiles instead of full mesh
+
         float pointSize = 1.0f;
         float nmrSize = 1.0f;
         float normalLength = 0.05f;
@@ -110,11 +223,29 @@ class NMRMesh : public Mesh
 
         void Constructor(unsigned int ID);
 
+        // Take ownership of loaded NMR data
+        void FromData(NMRData& data);
+
+        // Place mesh data in the shared mesh arena, or in buffers of its own if the arena is full
+        void beginMeshUpload(Vertices& vertices, Indices& indices);
+
+        // Build vertex, index and normal data from the spectrum in data
+        static void BuildMeshData(NMRData& data);
+
         // Convert NMR data to vertex coordinates
-        void NMRToVertex();
+        static void NMRToVertex(NMRData& data);
 
         // Convert 2D NMR data to vertex coordinates
-        void NMR2DToVertex();
+        static void NMR2DToVertex(NMRData& data);
+
+        // Take the terrain once its background build finishes, returns whether a terrain exists
+        bool TerrainReady();
+
+        // Wait for and discard a terrain still building, which reads mat
+        void CancelTerrain();
+
+        // Bind heightfield texture and set the heightfield uniforms of shader
+        void BindHeightfield(Shader& shader, bool points);
 
         // Creates ImGuiUI text with ID tag
         const char * UITxt(char * text);
@@ -126,15 +257,16 @@ class NMRMesh : public Mesh
         static ImGuizmo::OPERATION mCurrentGizmoOperation;
         static ImGuizmo::MODE mCurrentGizmoMode;
         
-        // Bounding Box
-        Cubemap * boundingBox = NULL; 
+        // Bounding Box, shared by every mesh and created when first drawn
+        static Cubemap * boundingBox;
+        static unsigned int meshCount; // Meshes alive, the box is deleted with the last
 
         // BoundingBox attributes
         glm::vec3 bbPos = ZEROS;
         glm::vec3 bbScale = glm::vec3(2.0);
 
         // Stencil attributes
-        float outline = 0.50f; // Stencil buffer outline
+        float outline = 3.0f; // Outline width in pixels
         float stencil_color[4] = { 1.0f, 1.0f, 1.0f, 1.0f }; // Stencil buffer color
 
         // NMR variables
@@ -143,14 +275,41 @@ class NMRMesh : public Mesh
         NMR_INT totalSize;
         int qSize, vertexCount, indexCount, normCount;
         float minVal, maxVal;
-        float * mat;
+        float * mat = (float *)NULL;
+        void * matMap = NULL; // File mapping backing mat (NULL if mat is heap allocated)
+        NMR_INT matMapSize = 0;
         float * vertexList = (float *)NULL;
         int * indexList = (int *)NULL;
         float * normXYZ = (float *)NULL;
         std::vector<glm::vec3> normals;
+        bool meshBuilt = false;
+
+        // Heightfield variables
+        GLuint hfTexture = 0; // Intensity texture, 0 until InitHeightfield succeeds
+        VAO<Vertex> hfVAO; // Attribute-less VAO for heightfield draws
+        float hfDecode[2] = { 0.0f, 1.0f }; // Intensity = hfDecode[0] + hfDecode[1] * texel
+        float hfRange[2] = { 0.0f, 1.0f }; // Displayed intensity range, adjustable without re-uploading
+        bool hfQuantized = false; // Format of current texture
+
+        // Level of detail terrain, created on first use
+        Terrain * terrain = NULL;
+        std::future<Terrain *> terrainTask; // Pyramid building off the OpenGL thread
+
+        // Cache file the terrain is drawn from, NULL if the spectrum was not opened through one
+        SpectrumCache * cache = NULL;
+
+        // Spectrum file, read again when needed after ReleaseMemory
+        std::string file;
+
+        // Plane variables
+        PlaneReader * planes = NULL; // Reader of 3D/4D data, NULL for 2D spectra
+        int plane[2] = { 0, 0 }; // Displayed Z and A plane
+
+        // Location of the mesh in MeshArena::Shared(), page -1 if it has buffers of its own
+        ArenaRange arenaRange;
         
 };
 
-void MeshList(std::map<std::string, void *> nmrMeshes);
+void MeshList(std::map<std::string, NMRMesh *> nmrMeshes, NMRLoader * loader = NULL);
 
 #endif // !NMRMESH_CLASS_H
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef OFFSCREEN_CLASS_H
+#define OFFSCREEN_CLASS_H
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <string>
+#include <vector>
+
+// Number of image reads that can be in flight at once
+#define OFFSCREEN_READS 3
+
+/*
+OpenGL context without a window or display server, created through EGL.
+Uses the Mesa surfaceless platform when available so it also runs on
+machines without a GPU through a software driver.
+*/
+class OffscreenContext
+{
+    public:
+        EGLDisplay display = EGL_NO_DISPLAY;
+        EGLContext context = EGL_NO_CONTEXT;
+        EGLSurface surface = EGL_NO_SURFACE; // Only used if surfaceless contexts are unsupported
+
+        // Create a core profile context of the given version and make it current
+        // Returns false if no context could be created
+        bool Init(int major = 4, int minor = 6);
+
+        // Release context and display
+        void Delete();
+};
+
+/*
+Multisampled render target read back to the CPU through a ring of pixel buffers,
+so the next image renders while earlier images are still being copied.
+*/
+class OffscreenTarget
+{
+    public:
+        // Image read back from the target, rows are ordered bottom to top
+        struct Image
+        {
+            std::string name;
+            std::vector<unsigned char> pixels; // RGBA8
+            int width = 0;
+            int height = 0;
+        };
+
+        // Create color and depth-stencil attachments of the given size
+        void Init(int width, int height, int samples = 4);
+
+        // Bind target for drawing and set the viewport to its size
+        void Bind();
+
+        // Resolve the current image and queue it for read back under name
+        // Must not be called while Full()
+        void Read(const std::string& name);
+
+        // Whether every read buffer holds an image that was not collected yet
+        bool Full();
+
+        // Whether any read is in flight
+        bool Busy();
+
+        // Collect the oldest finished read, wait blocks until it is finished
+        // Returns false if no read is ready
+        bool Poll(Image& image, bool wait = false);
+
+        void Delete();
+
+        int width = 0;
+        int height = 0;
+
+    private:
+        struct PendingRead
+        {
+            GLuint pbo = 0;
+            GLsync fence = 0;
+            std::string name;
+        };
+
+        GLuint ID = 0;          // Multisampled frame buffer drawn to
+        GLuint colorID = 0;
+        GLuint depthID = 0;
+        GLuint resolveID = 0;   // Single sampled frame buffer read from
+        GLuint resolveColorID = 0;
+
+        PendingRead reads[OFFSCREEN_READS];
+        int readHead = 0;
+        int readCount = 0;
+};
+
+#endif // !OFFSCREEN_CLASS_H
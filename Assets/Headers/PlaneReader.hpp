@@ -0,0 +1,94 @@
+#ifndef PLANE_READER_CLASS_H
+#define PLANE_READER_CLASS_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+extern "C" {
+#include "fdatap.h"
+#include "prec.h"
+}
+
+// Planes read ahead on each side of the current plane along Z, and along A
+#define PLANE_PREFETCH 2
+
+/*
+Plane-indexed reader for 3D/4D NMRPipe data.
+Opens single-file 3D/4D data, or multi-file series named by a template
+such as "ft/test%03d.ft3" (one Z plane per file) or "ft/test%02d%03d.ft4"
+(A and Z file numbers). Only the requested XY plane is read, neighbouring
+planes are read ahead on a background thread.
+*/
+class PlaneReader
+{
+    public:
+        PlaneReader();
+
+        // Stop prefetch thread and release cached planes
+        ~PlaneReader();
+
+        PlaneReader(const PlaneReader&) = delete;
+        PlaneReader& operator=(const PlaneReader&) = delete;
+
+        // Read geometry of file or template, returns false if it is not 3D/4D data
+        // Must be called before any other member
+        bool Open(const std::string& file);
+
+        // Read plane (Z index + A index * zSize), returning a buffer of planePts points
+        // Prefetched planes are handed over without reading, buffers are freed with freeNMRMapped
+        float * Take(int plane);
+
+        // Queue neighbours of plane for reading ahead, dropping cached planes far from it
+        void Prefetch(int plane);
+
+        // Bytes of planes read ahead
+        size_t CacheBytes();
+
+        // Header of the first file, sizes and dimension count describe the complete data
+        float fdata[FDATASIZE];
+        int sizeList[MAXDIM], qSizeList[MAXDIM];
+        int dimCount = 0;
+        int qSize = 0;
+
+        int zSize = 1, aSize = 1;   // Number of planes along Z and A
+        NMR_INT planePts = 0;       // Points of one XY plane
+
+    private:
+        // File holding plane, and the index of plane within that file
+        std::string FileName(int plane, NMR_INT& index);
+
+        // Read plane into a new buffer on the calling thread, NULL on failure
+        float * Read(int plane);
+
+        // Whether plane is kept in the cache while other is the current plane
+        static bool Near(int plane, int other, int zSize);
+
+        // Release a plane buffer
+        void Free(float * data);
+
+        // Prefetch thread loop
+        void Work();
+
+        std::string file;       // File name, or printf template of a series
+        int specifiers = 0;     // Integer conversions in the template, 0 for single files
+        int filePlanes = 1;     // Planes stored in each file
+
+        std::thread worker;
+        std::mutex cacheMutex;
+        std::condition_variable queueCond;      // Signals the worker that planes are requested
+        std::condition_variable readCond;       // Signals Take that a plane was read
+        bool stopping = false;
+
+        std::deque<int> requests;               // Planes waiting for the worker
+        std::set<int> reading;                  // Planes being read by the worker
+        std::map<int, float *> cache;           // Read ahead planes
+        int current = 0;                        // Plane passed to the last Prefetch
+};
+
+#endif // !PLANE_READER_CLASS_H
@@ -0,0 +1,103 @@
+#ifndef PROFILER_CLASS_H
+#define PROFILER_CLASS_H
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <glad/glad.h>
+
+// Frames kept for the timeline and trace export
+#define PROFILE_FRAMES 240
+
+// Frames of GPU queries in flight before their results are dropped
+#define GPU_QUERY_FRAMES 4
+
+// Time a CPU zone until the end of the enclosing scope
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_CONCAT_INNER(a, b) a##b
+
+/*
+Frame profiler recording nested CPU zones and GL_TIME_ELAPSED timings of GPU passes.
+GPU results are collected a few frames later without waiting on the GPU.
+Zone names must be string literals or otherwise outlive the profiler.
+Must only be used from the thread owning the GL context.
+*/
+class Profiler
+{
+    public:
+        struct Zone
+        {
+            const char * name;
+            int depth;              // Nesting level, 0 for top level zones
+            double start, end;      // CPU time in milliseconds since the profiler started
+            double gpu = -1.0;      // GPU time in milliseconds, negative if not measured or not available yet
+        };
+
+        struct Frame
+        {
+            unsigned long index;
+            double start, end;
+            std::vector<Zone> zones;
+        };
+
+        // Record zones and show the profiler window
+        static bool enabled;
+        static bool showUI;
+
+        // Start recording a frame
+        static void BeginFrame();
+
+        // Finish the frame and collect finished GPU queries of earlier frames
+        static void EndFrame();
+
+        // Open a zone, GPU zones must not overlap other GPU zones
+        static void Begin(const char * name, bool gpu = false);
+
+        // Close the most recently opened zone
+        static void End();
+
+        // Draw timeline and statistics window
+        static void DisplayUI();
+
+        // Write recorded frames as Chrome trace JSON (chrome://tracing, Perfetto)
+        static bool ExportTrace(const std::string& path);
+
+    private:
+        // Queries issued during one frame
+        struct QuerySet
+        {
+            std::vector<GLuint> queries;    // Query objects, reused between frames
+            std::vector<size_t> zones;      // Zone index each used query belongs to
+            size_t used = 0;
+            unsigned long frame = 0;
+            bool pending = false;
+        };
+
+        static double Now();
+
+        // Read available results of earlier frames into history
+        static void CollectQueries();
+
+        static Frame * FindFrame(unsigned long index);
+
+        static std::chrono::steady_clock::time_point origin;
+        static std::deque<Frame> history;
+        static Frame current;
+        static std::vector<size_t> stack;   // Open zones of current frame
+        static bool recording;
+        static bool gpuOpen;                // A GPU zone is currently open
+        static size_t gpuZone;
+        static unsigned long frameIndex;
+        static QuerySet querySets[GPU_QUERY_FRAMES];
+};
+
+// Zone lasting until the end of the enclosing scope
+struct ProfileZone
+{
+    ProfileZone(const char * name, bool gpu = false) { Profiler::Begin(name, gpu); }
+    ~ProfileZone() { Profiler::End(); }
+};
+
+#endif // !PROFILER_CLASS_H
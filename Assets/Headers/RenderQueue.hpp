@@ -0,0 +1,141 @@
+#ifndef RENDER_QUEUE_CLASS_H
+#define RENDER_QUEUE_CLASS_H
+
+#include <map>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Shader.hpp"
+#include "Mesh.hpp"
+
+// Binding point of the per draw transform buffer read by batched shaders
+#define DRAW_BINDING 2
+
+// Vertex capacity of the first page of the mesh arena, each later page doubles it up to
+// ARENA_PAGE_MAX_VERTICES. Pages are at least the next power of two of the mesh they are made for,
+// meshes larger than ARENA_PAGE_MAX_VERTICES are not stored in the arena
+#define ARENA_PAGE_MIN_VERTICES (1 << 16)
+#define ARENA_PAGE_MAX_VERTICES (1 << 21)
+
+// Index capacity of a page per vertex of its minimum vertex capacity
+#define ARENA_PAGE_INDEX_RATIO 6
+
+// Location of a mesh inside the shared buffers of the mesh arena
+struct ArenaRange
+{
+    int page = -1;              // -1 if the mesh is not stored in the arena
+    GLint baseVertex = 0;
+    GLuint firstIndex = 0;
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+};
+
+/*
+Shared vertex and index buffers for meshes that are drawn together.
+Buffers are split into pages so that growing the arena never moves
+existing meshes, every page has a vertex array used by multi draws.
+*/
+class MeshArena
+{
+    public:
+        // Reserve space for a mesh, returns false if the buffers could not be created or the mesh is too large to share
+        bool Allocate(size_t vertexCount, size_t indexCount, ArenaRange& range);
+
+        // Return space of a mesh, empty pages are deleted
+        void Free(ArenaRange& range);
+
+        GLuint VertexBuffer(int page);
+        GLuint IndexBuffer(int page);
+
+        // Vertex array over the buffers of a page, base vertex 0
+        GLuint VertexArray(int page);
+
+        // Arena shared by all NMR meshes
+        static MeshArena& Shared();
+
+    private:
+        struct Page
+        {
+            GLuint vboID = 0;
+            GLuint eboID = 0;
+            GLuint vaoID = 0;
+            std::map<size_t, size_t> freeVertices;  // Offset to length of free vertex ranges
+            std::map<size_t, size_t> freeIndices;   // Offset to length of free index ranges
+            size_t vertexCapacity = 0;
+            size_t indexCapacity = 0;
+            int users = 0;
+        };
+
+        // Create page with at least the given capacity
+        int NewPage(size_t vertexCount, size_t indexCount);
+
+        // Number of pages in use
+        int PageCount();
+
+        // First fit allocation from a free list
+        static bool Take(std::map<size_t, size_t>& freeList, size_t count, size_t& offset);
+
+        // Return a range to a free list, merging it with its neighbours
+        static void Give(std::map<size_t, size_t>& freeList, size_t offset, size_t count);
+
+        std::vector<Page *> pages;
+};
+
+/*
+Queue of mesh draws for one frame. Draws are sorted by program, primitive,
+textures, and arena page, and each run of matching draws is issued with a
+single glMultiDrawElementsIndirect call. Model matrices are stored in a
+shader storage buffer indexed with gl_DrawID by the batched shader variants.
+*/
+class RenderQueue
+{
+    public:
+        // Queue a draw of an arena mesh with a batched shader variant
+        void Submit(Shader& shader, Mesh& mesh, const ArenaRange& range, const glm::mat4& model);
+
+        // Issue all queued draws and clear the queue
+        void Flush();
+
+        // Number of queued draws
+        size_t Size();
+
+        // Delete draw buffers
+        void Delete();
+
+    private:
+        struct Draw
+        {
+            Shader * shader;
+            Mesh * mesh;
+            GLuint program;
+            GLenum primative;
+            int page;
+            std::vector<GLuint> textures;
+            ArenaRange range;
+            glm::mat4 model;
+        };
+
+        // Layout of glMultiDrawElementsIndirect commands
+        struct Command
+        {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+
+        // Grow buffer to hold at least size bytes, orphaning its previous storage
+        static void Reserve(GLenum target, GLuint& ID, size_t& capacity, size_t size);
+
+        std::vector<Draw> draws;
+        std::vector<Command> commands;
+        std::vector<glm::mat4> models;
+
+        GLuint commandID = 0;
+        GLuint modelID = 0;
+        size_t commandCapacity = 0;
+        size_t modelCapacity = 0;
+};
+
+#endif // !RENDER_QUEUE_CLASS_H
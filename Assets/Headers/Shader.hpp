@@ -11,8 +11,12 @@
 
 // Other headers
 #include <map>
+#include <unordered_map>
+#include <memory>
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <filesystem>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -29,6 +33,55 @@ enum ShaderType
 
 std::string shaderFile(std::string shader_path, std::string name, ShaderType shader_type);
 
+// Directory holding linked program binaries from previous runs, safe to delete
+#define SHADER_CACHE_DIR "Assets/Cache/Shaders/"
+
+// Name suffix of shader variants that read vertices from a heightfield texture
+#define HEIGHTFIELD_SUFFIX "_hf"
+
+// Name suffix of shader variants that read model matrices per draw of a multi draw (see RenderQueue)
+#define BATCHED_SUFFIX "_mdi"
+
+// Handle of an active uniform in a shader program, see Shader::Uniform
+typedef int UniformHandle;
+
+// Handle of uniforms that are not active in the program, setters ignore it
+#define INVALID_UNIFORM -1
+
+/*
+Handles of the uniforms set on every draw, looked up once when a program
+is linked so draws do not search uniforms by name
+*/
+struct CommonUniforms
+{
+    UniformHandle materialAmbient = INVALID_UNIFORM;
+    UniformHandle materialShininess = INVALID_UNIFORM;
+    UniformHandle drawOffset = INVALID_UNIFORM;       // Batched variants (see RenderQueue)
+    UniformHandle heightMap = INVALID_UNIFORM;        // Heightfield variants (see NMRMesh::BindHeightfield)
+    UniformHandle hfSize = INVALID_UNIFORM;
+    UniformHandle hfDecode = INVALID_UNIFORM;
+    UniformHandle hfRange = INVALID_UNIFORM;
+    UniformHandle hfPoints = INVALID_UNIFORM;
+};
+
+/*
+Uniform locations of a linked program and the last value sent to each,
+so unchanged values are not sent again
+*/
+struct UniformCache
+{
+    struct Slot
+    {
+        GLint location;
+        bool valid = false;         // Whether value holds the value in the program
+        unsigned char value[64];    // Last value sent, large enough for a mat4
+    };
+
+    std::vector<Slot> slots;
+    std::unordered_map<std::string, UniformHandle> handles;
+    CommonUniforms common;
+};
+
 /*
 Object for loading vertex and fragment shaders 
 by source code to a new program
@@ -43,7 +96,8 @@ class Shader
         Shader();
         
         // Constructor that builds shader program from vertex and fragment shaders
-        Shader(const char* vertexFile, const char* fragmentFile, const char* geometryFile);
+        // vertexPrelude is inserted after the #version line of the vertex shader
+        Shader(const char* vertexFile, const char* fragmentFile, const char* geometryFile, const char* vertexPrelude = NULL);
 
         // Activate shader program
         void Activate();
@@ -51,6 +105,15 @@ class Shader
         // Delete shader program
         void Delete();
 
+        // Handle of uniform name, INVALID_UNIFORM if the program does not use it
+        UniformHandle Uniform(const std::string &name) const;
+
+        // Handles of the uniforms set on every draw
+        const CommonUniforms& Common() const;
+
+        // Forget the cached uniform values, for code that sets uniforms without the setters
+        void InvalidateUniforms();
+
         void setBool(const std::string &name, bool value) const;
 
         void setInt(const std::string &name, int value) const;
@@ -63,6 +126,8 @@ class Shader
 
         void setVec2(const std::string &name, float x, float y) const;
 
+        void setIVec2(const std::string &name, int x, int y) const;
+
         void setVec3(const std::string &name, const glm::vec3 &value) const;
 
         void setVec3(const std::string &name, float x, float y, float z) const;
@@ -77,7 +142,49 @@ class Shader
 
         void setMat4(const std::string &name, const glm::mat4 &mat) const;
 
+        // Handle based setters, values equal to the last value sent are skipped
+
+        void setBool(UniformHandle handle, bool value) const;
+
+        void setInt(UniformHandle handle, int value) const;
+
+        void setUInt(UniformHandle handle, int value) const;
+
+        void setFloat(UniformHandle handle, float value) const;
+
+        void setVec2(UniformHandle handle, const glm::vec2 &value) const;
+
+        void setIVec2(UniformHandle handle, const glm::ivec2 &value) const;
+
+        void setVec3(UniformHandle handle, const glm::vec3 &value) const;
+
+        void setVec4(UniformHandle handle, const glm::vec4 &value) const;
+
+        void setMat2(UniformHandle handle, const glm::mat2 &mat) const;
+
+        void setMat3(UniformHandle handle, const glm::mat3 &mat) const;
+
+        void setMat4(UniformHandle handle, const glm::mat4 &mat) const;
+
     private:
+        // Uniform locations and values, shared by copies of this shader
+        std::shared_ptr<UniformCache> uniforms = std::make_shared<UniformCache>();
+
+        // Query the active uniforms of the linked program
+        void cacheUniforms();
+
+        // Returns true if value differs from the last value sent to handle, and records it
+        bool changed(UniformHandle handle, const void * value, size_t size) const;
+
+        // Cache file of program built from the given sources with the current driver
+        static std::string binaryCacheFile(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode);
+
+        // Create program from cache file, returns false if it is missing or rejected by the driver
+        bool loadBinary(const std::string& cacheFile);
+
+        // Store linked program in cache file
+        void saveBinary(const std::string& cacheFile);
+
         // Check if shader compilation results in any errors
         void compileErrors(unsigned int shader, const char * type);
 };
@@ -86,4 +193,8 @@ typedef std::map<std::string, Shader> Shaders;
 
 void initializeShaders(Shaders & shaders, std::string shader_path, std::vector<std::string> shader_list);
 
+void initializeHeightfieldShaders(Shaders & shaders, std::string shader_path, std::vector<std::string> shader_list);
+
+void initializeBatchedShaders(Shaders & shaders, std::string shader_path, std::vector<std::string> shader_list);
+
 #endif // !SHADER_CLASS_H
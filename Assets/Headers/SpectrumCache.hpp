@@ -0,0 +1,73 @@
+#ifndef SPECTRUM_CACHE_CLASS_H
+#define SPECTRUM_CACHE_CLASS_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+struct NMRData;
+struct CacheHeader;
+class Terrain;
+
+// Extension of the cache file written next to a spectrum
+#define SPECTRUM_CACHE_EXT ".rcache"
+
+// Cache directory used when the directory of a spectrum is not writable
+#define SPECTRUM_CACHE_DIR "Assets/Cache/Spectra/"
+
+/*
+Sidecar cache of a 2D spectrum for instant reopening.
+Holds the spectrum header and intensity range, and the terrain level
+pyramid (largest magnitude of each block, so peaks survive) with the
+normal of every point. Each level is stored in TERRAIN_TILE square tiles
+so a terrain tile reads one contiguous block. The file is keyed by the
+path, size and modification time of the spectrum and is memory mapped on
+reopen, the coarsest level is drawn at once and finer tiles are paged in
+by the system as the terrain refines.
+*/
+class SpectrumCache
+{
+    public:
+        // Unmap the cache file
+        ~SpectrumCache();
+
+        SpectrumCache(const SpectrumCache&) = delete;
+        SpectrumCache& operator=(const SpectrumCache&) = delete;
+
+        // Map the cache of file, NULL if there is none or it was written for another version of file
+        static SpectrumCache * Open(const std::string& file);
+
+        // Write the cache of a 2D spectrum read by NMRMesh::LoadData, performs no OpenGL calls
+        static bool Create(const std::string& file, const NMRData& data);
+
+        // Copy header, sizes and intensity range of the cached spectrum into data
+        void Fill(NMRData& data) const;
+
+        // Pyramid levels, level 0 is the full resolution spectrum
+        int LevelCount() const;
+        void LevelSize(int level, int& xSize, int& ySize, int& xShift, int& yShift) const;
+
+        // Tiled intensities, and normals stored as X and Z scaled to the int16_t range
+        const float * Values(int level) const;
+        const int16_t * Normals(int level) const;
+
+        float minVal, maxVal;
+
+    private:
+        SpectrumCache() = default;
+
+        // Write cache to path through a temporary file, returns false if path is not writable
+        static bool Write(const std::string& path, const CacheHeader& header, Terrain& terrain);
+
+        // Cache file next to the spectrum, and the fallback in SPECTRUM_CACHE_DIR
+        static std::string SidecarPath(const std::string& file);
+        static std::string FallbackPath(const std::string& file);
+
+        // Map path if it holds a valid cache for the source key in header
+        static SpectrumCache * Map(const std::string& path, const CacheHeader& key);
+
+        const CacheHeader * header = NULL;  // Start of the mapping
+        size_t mapSize = 0;
+};
+
+#endif // !SPECTRUM_CACHE_CLASS_H
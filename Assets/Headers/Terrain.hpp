@@ -0,0 +1,152 @@
+#ifndef TERRAIN_CLASS_H
+#define TERRAIN_CLASS_H
+
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "VAO.hpp"
+#include "EBO.hpp"
+#include "Camera.hpp"
+#include "Constants.hpp"
+
+class SpectrumCache;
+
+// Grid cells along each side of a terrain tile, identical at every level
+#define TERRAIN_TILE 128
+
+/*
+Chunked level of detail terrain for large 2D spectra.
+The spectrum is downsampled into a pyramid of levels keeping the largest
+magnitude of each 2x2 block, so peaks survive at every level. Levels are
+split into a quadtree of fixed size tiles, tiles are meshed on demand and
+chosen each frame by camera distance and view frustum. Tile edges hang
+skirts so neighbours of different levels do not show cracks.
+OpenGL objects are created by the first Select, so the pyramid can be
+built on worker threads (SpectrumCache does so to write cache files).
+*/
+class Terrain
+{
+    public:
+        // Build level pyramid for xSize by ySize matrix mat, mat must outlive the terrain
+        Terrain(float * mat, int xSize, int ySize, float minVal, float maxVal);
+
+        // Use the pyramid and normals of a mapped cache file, cache must outlive the terrain
+        Terrain(const SpectrumCache& cache);
+
+        // Release tile buffers
+        ~Terrain();
+
+        Terrain(const Terrain&) = delete;
+        Terrain& operator=(const Terrain&) = delete;
+
+        // Choose the tiles to draw for the camera, call once per frame before Draw
+        // model is the full model matrix the terrain is drawn with
+        void Select(Camera& camera, glm::mat4 model);
+
+        // Draw tiles chosen by the last Select with the currently active shader
+        void Draw(GLenum primative);
+
+        // Draw a normal line for every grid point of the tiles chosen by the last Select
+        // The active shader reads tile vertices from the NORMALS_BINDING storage buffer
+        void DrawNormals();
+
+        // Number of pyramid levels
+        int LevelCount();
+
+        // Tiles are refined while the camera is closer than lodFactor times their size
+        float lodFactor = 2.0f;
+
+        // Maximum number of tiles meshed per frame, coarser tiles are drawn until refined ones are ready
+        int buildsPerFrame = 8;
+
+        // GPU bytes kept for tiles that are not drawn in the current frame
+        size_t residentBudget = 256 * 1024 * 1024;
+
+        // Statistics of the last Select
+        size_t drawnTiles = 0;
+        size_t residentTiles = 0;
+        bool refining = false;  // Tiles were left unbuilt, later frames will refine further
+
+    private:
+        friend class SpectrumCache;
+
+        struct Level
+        {
+            int xSize, ySize;       // Points along each axis
+            int xShift, yShift;     // Level point i is full resolution point (i << shift)
+            std::vector<float> data; // Downsampled points, empty for the full resolution level
+            const float * values = NULL;    // Tiled points of a cache file, used instead of data
+            const int16_t * normals = NULL; // Tiled normals of a cache file
+        };
+
+        struct Bounds
+        {
+            float yMin, yMax;       // Graphics Y range of the tile points
+        };
+
+        struct Tile
+        {
+            VAO<Vertex> vao;
+            GLuint vboID;
+            unsigned long lastUsed;
+        };
+
+        // Create the shared index buffer and the coarsest tile
+        void Init();
+
+        // Refine tile into children, returns false if neither tile nor children can be drawn this frame
+        bool Refine(int level, int tx, int ty);
+
+        // Add tile to the draw list, meshing it if needed
+        bool Use(int level, int tx, int ty);
+
+        // Mesh tile and upload it into a new vertex buffer
+        Tile& Build(int level, int tx, int ty);
+
+        // Delete least recently used tiles above residentBudget
+        void Evict();
+
+        // Whether tile contains at least one grid cell
+        bool Exists(int level, int tx, int ty);
+
+        // Model space bounding box of tile
+        void Box(int level, int tx, int ty, glm::vec3& lo, glm::vec3& hi);
+
+        // True if box lies outside the view frustum
+        bool Culled(glm::vec3 lo, glm::vec3 hi);
+
+        // Point value, position, and normal at level coordinates
+        float Sample(int level, int x, int y);
+        glm::vec3 Position(int level, int x, int y);
+        glm::vec3 Normal(int level, int x, int y);
+
+        // Offset of a point in the tiled layout of cache files
+        static size_t TileOffset(const Level& L, int x, int y);
+
+        // Map intensity to graphics Y as mat2mesh does
+        float Height(float value);
+
+        static unsigned long long Key(int level, int tx, int ty);
+
+        float * mat;
+        float minVal, maxVal;
+        std::vector<Level> levels;
+
+        std::map<unsigned long long, Bounds> bounds;
+        std::map<unsigned long long, Tile> tiles;
+        std::vector<Tile *> selected;
+
+        GLuint eboID = 0; // Index buffer shared by every tile, all tiles have the same topology
+        GLsizei indexCount;
+        size_t tileBytes;
+
+        // Per frame selection state
+        unsigned long frame = 0;
+        int builds = 0;
+        glm::mat4 clip;
+        glm::mat4 world;
+        glm::vec3 eye;
+};
+
+#endif // !TERRAIN_CLASS_H
@@ -5,6 +5,8 @@
 #include <stb/stb_image.h>
 
 #include "Shader.hpp"
+#include "AssetCache.hpp"
+#include "ImageDecoder.hpp"
 
 class Texture
 {
@@ -20,6 +22,9 @@ class Texture
         // Constructor for texture given parameters for initialization
         Texture(const char * image, const char * texType, GLuint slot, GLenum minLOD, GLenum magLOD);
 
+        // Start decoding image in the background, skipped if the texture is already loaded
+        static void Prefetch(const char * image, GLenum minLOD, GLenum magLOD);
+
         // Assign texture to texture unit in shader
         void texUnit(Shader& shader, const char* uniform, GLuint unit);
         
@@ -29,7 +34,11 @@ class Texture
         // Unbind texture from binding point
         void Unbind();
 
-        // Delete texture object
+        // Release texture object, deleted once no other texture shares it
         void Delete();
+
+    private:
+        // Decode image file and upload it into a new texture object
+        static GLuint Load(const char * image, GLenum minLOD, GLenum magLOD);
 };
 #endif // !TEXTURE_CLASS_H
\ No newline at end of file
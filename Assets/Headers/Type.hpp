@@ -1,12 +1,27 @@
 #ifndef TYPE_HEADER_H
 #define TYPE_HEADER_H
 
+#include <vector>
+#include <unordered_map>
 #include "Backend.hpp"
 #include "Shader.hpp"
+#include "VBO.hpp"
+#include "AssetCache.hpp"
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
+// Width in pixels of the glyph atlas, rows are added until every glyph fits
+#define ATLAS_WIDTH 1024
+
+// Number of cached string layouts kept before the cache is cleared
+#define LAYOUT_CACHE_SIZE 1024
+
+/*
+Text renderer drawing ASCII strings from a single glyph atlas.
+RenderText only queues quads, all strings queued during a frame
+are streamed to the GPU and drawn with one call by Flush.
+*/
 class Type
 {
     public:
@@ -17,13 +32,22 @@ class Type
         static void SetProjection(glm::mat4 projection);
 
         static glm::mat4 GetProjection();
-        
-        glm::vec4 RenderText(Shader &shader, std::string text, float x, float y, float scale, glm::vec3 color, bool centerCoords = false);
+
+        // Queue text for drawing, returns (x, width, y, height) of the placed text
+        glm::vec4 RenderText(std::string text, float x, float y, float scale, glm::vec3 color, bool centerCoords = false);
+
+        // Draw every queued string in one call and clear the queue
+        void Flush(Shader &shader);
 
         void RenderCenter(Shader &shader, glm::vec2 center_point, glm::vec3 color);
-        struct Character 
+
+        // Release the glyph atlas and delete buffers
+        void Delete();
+
+        struct Character
         {
-            unsigned int textureID;  // ID handle of the glyph texture
+            glm::vec2    uvMin;      // Top left atlas coordinate of glyph
+            glm::vec2    uvMax;      // Bottom right atlas coordinate of glyph
             glm::ivec2   Size;       // Size of glyph
             glm::ivec2   Bearing;    // Offset from baseline to left/top of glyph
             unsigned int Advance;    // Offset to advance to next glyph
@@ -32,6 +56,18 @@ class Type
         static glm::mat4 projection;
 
     private:
+        /*
+        Quads of a string laid out at the origin with unit scale.
+        Static strings are laid out once and reused every frame.
+        */
+        struct Layout
+        {
+            std::vector<TextVertex> vertices; // Four vertices per glyph
+            float advance;          // Total advance of the string
+            float bottom, top;      // Extents used to center the string
+            float minY, maxY;       // Vertical bounds of the glyph quads
+        };
+
         // Private functions
         int LoadFont(const char * fontFile);
 
@@ -39,13 +75,23 @@ class Type
 
         int GenerateBuffers();
 
+        // Get cached layout of text, laying it out on first use
+        const Layout& GetLayout(const std::string& text);
+
+        // Grow vertex and index buffers to hold quads glyphs
+        void Reserve(size_t quads);
+
         // Private variables
         FT_Library ft;
         FT_Face face;
         static GLenum unit;
         static std::vector<GLuint> indices;
         unsigned int VAO, VBO, EBO;
+        unsigned int atlas = 0; // Glyph atlas texture, shared through the asset cache
+        size_t capacity = 0;    // Quads the buffers can hold
         std::map<char, Character> Characters;
+        std::unordered_map<std::string, Layout> layouts;
+        std::vector<TextVertex> queue; // Vertices waiting for Flush
 };
 
 #endif // !TYPE_HEADER_H
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef UBO_CLASS_H
+#define UBO_CLASS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glad/glad.h>
+#include "Constants.hpp"
+
+// Uniform block binding points, must match layout(binding = n) in the shaders
+#define CAMERA_BINDING 0
+#define OBJECT_BINDING 1
+
+/*
+Camera uniform block, updated once per frame and read by every program.
+Members follow std140 layout, a vec3 is padded to 16 bytes.
+*/
+struct CameraBlock
+{
+    glm::mat4 camMatrix;    // Camera projection * view matrix
+    glm::vec3 camPos;       // Camera position in world space
+    float pad;
+};
+
+/*
+Object uniform block, updated before each draw.
+model is the complete global and local transform of the object.
+*/
+struct ObjectBlock
+{
+    glm::mat4 model;
+};
+
+/*
+### Uniform Buffer Object (UBO)
+Class for containing and handling an OpenGL uniform buffer bound to a fixed binding point
+*/
+template <typename Block> class UBO
+{
+    public:
+        // Reference ID for UBO
+        GLuint ID;
+
+        // Binding point the buffer is attached to
+        GLuint binding;
+
+        // UBO constructor, allocates the block and attaches it to binding
+        UBO(GLuint binding);
+
+        // Upload block to the buffer, skipped if identical to the last upload
+        void Update(const Block& block);
+
+        // Attach buffer to its binding point again
+        void Bind();
+
+        // Delete UBO
+        void Delete();
+
+    private:
+        Block last;
+        bool valid = false;
+};
+
+// Object buffer shared by every draw call, created on first use
+UBO<ObjectBlock>& ObjectBuffer();
+
+// Combine global and local transforms into a single model matrix
+glm::mat4 ObjectMatrix
+(
+    glm::mat4 matrix,
+    glm::vec3 translation,
+    glm::quat rotation,
+    glm::vec3 scale,
+    glm::vec3 globalTranslation = ZEROS,
+    glm::quat globalRotation = QUAT_IDENTITY,
+    glm::vec3 globalScale = ONES
+);
+
+#endif // !UBO_CLASS_H
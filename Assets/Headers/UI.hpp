@@ -6,17 +6,21 @@
 #include "Camera.hpp"
 #include "Constants.hpp"
 #include "Light.hpp"
+#include "Profiler.hpp"
+#include "MemoryBudget.hpp"
 
 #include <filesystem>
 namespace fs = std::filesystem;
 
+class NMRMesh;
+
 static const float identityMatrix[16] =
 { 1.f, 0.f, 0.f, 0.f,
     0.f, 1.f, 0.f, 0.f,
     0.f, 0.f, 1.f, 0.f,
     0.f, 0.f, 0.f, 1.f };
 
-void DrawMainMenu(std::map<std::string, void *>& nmrFiles, std::vector<Light*> &lights, std::string & currFile, GLFWwindow * window);
+void DrawMainMenu(std::map<std::string, NMRMesh *>& nmrFiles, std::vector<Light*> &lights, std::string & currFile, GLFWwindow * window);
 
 void EditTransform(
     const Camera& camera, glm::vec3& pos, 
@@ -5,6 +5,9 @@
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 
+// Binding point of a Vertex buffer read as a storage buffer by the normals shader
+#define NORMALS_BINDING 3
+
 struct Vertex
 {
     glm::vec3 position;
@@ -28,6 +31,7 @@ struct TextVertex
 {
     glm::vec2 position;
     glm::vec2 texUV;
+    glm::vec3 color;
 };
 
 /*
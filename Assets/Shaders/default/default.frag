@@ -11,7 +11,12 @@ uniform sampler2D diffuse0; // Obtain albedo texture unit from main function
 uniform sampler2D specular0; // Obtain specular texture unit from main function
 uniform vec4 lightColor; // Color obtained from the light source
 uniform vec3 lightPos; // Position of the light source
-uniform vec3 camPos; // Obtain camera position for specular lighting
+// Camera block shared by every program, updated once per frame
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 camMatrix; // Camera view matrix
+    vec3 camPos; // Obtain camera position for specular lighting
+};
 
 // Material properties of object
 struct Material {
@@ -0,0 +1,66 @@
+// Heightfield vertex pulling
+// Prepended (with #define HEIGHTFIELD) to vertex shaders built as "<name>_hf" variants.
+// Grid X/Z are rebuilt from gl_VertexID and Y/normal from the intensity texture,
+// so no vertex buffer is needed.
+
+uniform sampler2D heightMap; // Intensity matrix, one texel per grid point (R32F or R16)
+uniform ivec2 hfSize; // Grid size in points (x, y)
+uniform vec2 hfDecode; // Intensity = hfDecode.x + hfDecode.y * texel
+uniform vec2 hfRange; // Intensity clipping range, mapped to -1.0 ... 1.0
+uniform bool hfPoints; // One vertex per grid point instead of two triangles per grid cell
+
+// Replacements for the vertex attributes, filled in by heightfieldVertex()
+vec3 aPos;
+vec3 aNormal;
+vec3 aColor;
+vec2 aTex;
+
+// Corners of the two triangles of a grid cell, same winding as mat2mesh
+const ivec2 hfCorners[6] = ivec2[6](
+    ivec2(0, 0), ivec2(0, 1), ivec2(1, 1),
+    ivec2(0, 0), ivec2(1, 1), ivec2(1, 0)
+);
+
+// Graphics Y of grid point p, clamped to the grid edge
+float hfHeight(ivec2 p)
+{
+    p = clamp(p, ivec2(0), hfSize - 1);
+
+    float value = hfDecode.x + hfDecode.y * texelFetch(heightMap, p, 0).r;
+    float range = hfRange.y - hfRange.x;
+
+    if (range == 0.0) return clamp(value, hfRange.x, hfRange.y) - hfRange.x;
+
+    return 2.0 * (clamp(value, hfRange.x, hfRange.y) - hfRange.x) / range - 1.0;
+}
+
+// Fill in the attributes of grid point p
+void heightfieldPoint(ivec2 p)
+{
+    // Grid spans -1.0 ... 1.0 in X, and 1.0 ... -1.0 in Z
+    vec2 spacing = 2.0 / vec2(max(hfSize - 1, ivec2(1)));
+
+    aPos = vec3(-1.0 + spacing.x * p.x, hfHeight(p), 1.0 - spacing.y * p.y);
+
+    // Central differences of the scaled surface
+    float dYdX = (hfHeight(p + ivec2(1, 0)) - hfHeight(p - ivec2(1, 0))) / (2.0 * spacing.x);
+    float dYdZ = (hfHeight(p - ivec2(0, 1)) - hfHeight(p + ivec2(0, 1))) / (2.0 * spacing.y);
+
+    aNormal = normalize(vec3(-dYdX, 1.0, -dYdZ));
+    aColor = vec3(1.0);
+    aTex = vec2(0.0);
+}
+
+void heightfieldVertex()
+{
+    ivec2 p;
+
+    if (hfPoints) {
+        p = ivec2(gl_VertexID % hfSize.x, gl_VertexID / hfSize.x);
+    } else {
+        int cell = gl_VertexID / 6;
+        p = ivec2(cell % (hfSize.x - 1), cell / (hfSize.x - 1)) + hfCorners[gl_VertexID % 6];
+    }
+
+    heightfieldPoint(p);
+}
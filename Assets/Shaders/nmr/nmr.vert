@@ -2,19 +2,24 @@
 
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 camMatrix; // Camera view matrix
-uniform mat4 model; // Model data for object
-uniform mat4 translation; // Translation matrix
-uniform mat4 rotation; // Rotation matrix
-uniform mat4 scale; // Scale matrix
+// Camera block shared by every program, updated once per frame
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 camMatrix; // Camera view matrix
+    vec3 camPos; // Camera position
+};
+
+// Object block, updated before each draw
+layout(std140, binding = 1) uniform Object
+{
+    mat4 model; // Global and local transform of object
+};
 
 out DATA
 {
-    mat4 projection;
 } data_out;
 
 void main()
 {
-    gl_Position = model * translation * rotation * scale * vec4(aPos, 1.0f);
-    data_out.projection = camMatrix;
+    gl_Position = model * vec4(aPos, 1.0f);
 }
\ No newline at end of file
@@ -1,34 +1,44 @@
 #version 460 core
-layout(location = 0) in vec3 aPos; // Position array
-layout(location = 1) in vec3 aNormal; // Normal array
-layout(location = 2) in vec3 aColor; // Color arrays
-layout(location = 3) in vec2 aTex; // Texture array
-
-out DATA
+// Drawn as two vertex lines with one instance per mesh vertex,
+// vertex 0 is the mesh vertex and vertex 1 the tip of its normal
+#ifndef HEIGHTFIELD
+// Mesh vertex buffer read as floats, same layout as struct Vertex
+layout(std430, binding = 3) readonly buffer Vertices
 {
-    vec3 Normal; // Outputs the normal vectors of the object
-    mat4 projection; // Include projection matrix since it is applied after geometry shader
-} data_out;
+    float vertexData[];
+};
+
+const int VERTEX_FLOATS = 11; // position (3), normal (3), color (3), texture (2)
+#endif // Attributes come from heightfieldPoint(), one instance per grid point
 
 // NEVER DECLARE UNIFORMS IF THEY GO UNUSED
-uniform mat4 camMatrix; // Camera view matrix
-uniform mat4 model; // Model data for object
-uniform mat4 translation; // Translation matrix
-uniform mat4 rotation; // Rotation matrix
-uniform mat4 scale; // Scale matrix
+// Camera block shared by every program, updated once per frame
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 camMatrix; // Camera view matrix
+    vec3 camPos; // Camera position
+};
 
-uniform mat4 gTranslation; // Global Translation matrix
-uniform mat4 gRotation; // Global Rotation matrix
-uniform mat4 gScale; // Global Scale matrix
+// Object block, updated before each draw
+layout(std140, binding = 1) uniform Object
+{
+    mat4 model; // Global and local transform of object
+};
+
+uniform float hairLength; // Length that the normals extend
 
 void main()
 {
-    // Calculate current position   
-                    // Global transform                 //                      Local Transform
-    gl_Position = gTranslation * gRotation * gScale * (model * translation * rotation * scale * vec4(aPos, 1.0));
-
-    // Assigns the normal vectors from the vertex data to "Normal"
-    data_out.Normal = aNormal;
+#ifdef HEIGHTFIELD
+    heightfieldPoint(ivec2(gl_InstanceID % hfSize.x, gl_InstanceID / hfSize.x));
+#else
+    int v = (gl_BaseInstance + gl_InstanceID) * VERTEX_FLOATS;
+    vec3 aPos = vec3(vertexData[v], vertexData[v + 1], vertexData[v + 2]);
+    vec3 aNormal = vec3(vertexData[v + 3], vertexData[v + 4], vertexData[v + 5]);
+#endif
+    // Normals extend in world space, independent of the object scale
+    vec4 position = model * vec4(aPos, 1.0);
+    position += float(gl_VertexID) * hairLength * vec4(aNormal, 0.0);
 
-    data_out.projection = camMatrix;
+    gl_Position = camMatrix * position;
 }
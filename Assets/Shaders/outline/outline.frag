@@ -0,0 +1,38 @@
+#version 460 core
+
+out vec4 FragColor;
+
+uniform usampler2D stencilMap; // Stencil values of the frame
+uniform int selected; // Stencil value of the selected object
+uniform float lineWidth; // Outline width in pixels
+uniform vec4 color; // Outline color
+
+void main()
+{
+    ivec2 size = textureSize(stencilMap, 0);
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+    // Pixels of the object itself are not outlined
+    if (texelFetch(stencilMap, pixel, 0).r == uint(selected)) discard;
+
+    int radius = int(ceil(lineWidth));
+    float nearest = lineWidth + 1.0;
+
+    // Distance to the closest pixel of the object within the outline width
+    for (int y = -radius; y <= radius; y++) {
+        for (int x = -radius; x <= radius; x++) {
+            ivec2 neighbour = pixel + ivec2(x, y);
+            if (any(lessThan(neighbour, ivec2(0))) || any(greaterThanEqual(neighbour, size))) continue;
+
+            if (texelFetch(stencilMap, neighbour, 0).r == uint(selected)) {
+                nearest = min(nearest, length(vec2(x, y)));
+            }
+        }
+    }
+
+    if (nearest > lineWidth) discard;
+
+    // Soften the outer edge by a pixel
+    float coverage = clamp(lineWidth + 0.5 - nearest, 0.0, 1.0);
+    FragColor = vec4(color.rgb, color.a * coverage);
+}
@@ -26,7 +26,12 @@ uniform vec4 lightColor;
 uniform vec3 lightPos;
 
 // Obtain camera position for specular lighting
-uniform vec3 camPos;
+// Camera block shared by every program, updated once per frame
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 camMatrix; // Camera view matrix
+    vec3 camPos; // Obtain camera position for specular lighting
+};
 
 // Point light implements a light that emanates in all directions
 // with a relaitionship between distance and intensity.
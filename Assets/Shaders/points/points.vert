@@ -1,8 +1,10 @@
 #version 460 core
+#ifndef HEIGHTFIELD
 layout(location = 0) in vec3 aPos; // Position array
 layout(location = 1) in vec3 aNormal; // Normal array
 layout(location = 2) in vec3 aColor; // Color arrays
 layout(location = 3) in vec2 aTex; // Texture array
+#endif // Attributes come from heightfieldVertex()
 
 out DATA
 {
@@ -10,25 +12,29 @@ out DATA
     vec3 color; // Output color for fragment shader
     vec2 texCoord; // Outputs the texture coordinates to the fragment shader
     vec3 currPos; // Output the current 3 float position to the fragment shader
-    mat4 projection; // Include projection matrix since it is applied after geometry shader
 } data_out;
 
 // NEVER DECLARE UNIFORMS IF THEY GO UNUSED
-uniform mat4 camMatrix; // Camera view matrix
-uniform mat4 model; // Model data for object
-uniform mat4 translation; // Translation matrix
-uniform mat4 rotation; // Rotation matrix
-uniform mat4 scale; // Scale matrix
+// Camera block shared by every program, updated once per frame
+layout(std140, binding = 0) uniform Camera
+{
+    mat4 camMatrix; // Camera view matrix
+    vec3 camPos; // Camera position
+};
 
-uniform mat4 gTranslation; // Global Translation matrix
-uniform mat4 gRotation; // Global Rotation matrix
-uniform mat4 gScale; // Global Scale matrix
+// Object block, updated before each draw
+layout(std140, binding = 1) uniform Object
+{
+    mat4 model; // Global and local transform of object
+};
 
 void main()
 {
+#ifdef HEIGHTFIELD
+    heightfieldVertex();
+#endif
     // Calculate current position   
-                    // Global transform                 //                      Local Transform
-    gl_Position = gTranslation * gRotation * gScale * (model * translation * rotation * scale * vec4(aPos, 1.0));
+    gl_Position = model * vec4(aPos, 1.0);
 
     // Assigns the normal vectors from the vertex data to "Normal"
     data_out.Normal = aNormal;
@@ -39,6 +45,4 @@ void main()
     data_out.texCoord = mat2(0.0, -1.0, 1.0, 0.0) * aTex;
     // Output projection matrix to perform after geometry shader
     data_out.currPos = vec3(gl_Position);
-
-    data_out.projection = camMatrix;
 }
@@ -1,12 +1,15 @@
 #version 330 core
-layout (location = 0) in vec3 vertex; // <vec3 pos>
+layout (location = 0) in vec2 vertex; // <vec2 pos>
 layout (location = 1) in vec2 tex; // <vec2 tex>
+layout (location = 2) in vec3 color; // <vec3 color>
 out vec2 TexCoords;
+out vec3 TextColor;
 
 uniform mat4 projection;
 
 void main()
 {
-    gl_Position = projection * vec4(vertex, 1.0);
+    gl_Position = projection * vec4(vertex, 0.0, 1.0);
     TexCoords = tex;
-}  
\ No newline at end of file
+    TextColor = color;
+}
\ No newline at end of file
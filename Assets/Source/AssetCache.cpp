@@ -0,0 +1,120 @@
+#include "AssetCache.hpp"
+
+std::map<std::string, AssetCache::Entry> AssetCache::entries;
+std::map<GLuint, std::string> AssetCache::keys;
+
+/*
+Get asset stored under key, loading it on first use
+
+Parameters
+----------
+key : const std::string&
+    Cache key of asset, see AssetCache::Key
+
+load : Loader
+    Function creating the asset texture on a cache miss
+
+data : std::shared_ptr<void> *
+    If not NULL, set to the CPU side data stored with the asset
+
+Returns
+-------
+ID : GLuint
+    GL texture name of asset, 0 if loading failed
+*/
+GLuint AssetCache::Acquire(const std::string& key, Loader load, std::shared_ptr<void> * data)
+{
+    auto found = entries.find(key);
+    if (found == entries.end()) {
+        Entry entry;
+        entry.references = 0;
+        entry.ID = load(entry.data);
+
+        // Failed loads are not cached so the next request retries
+        if (entry.ID == 0) {
+            if (data != NULL) data->reset();
+            return 0;
+        }
+        found = entries.insert(std::pair<std::string, Entry>(key, entry)).first;
+        keys[entry.ID] = key;
+    }
+
+    found->second.references++;
+    if (data != NULL) *data = found->second.data;
+
+    return found->second.ID;
+}
+
+/*
+Whether an asset is stored under key, used to skip work for assets that are already loaded
+
+Parameters
+----------
+key : const std::string&
+    Cache key of asset
+
+Returns
+-------
+found : bool
+    True if the asset is cached
+*/
+bool AssetCache::Contains(const std::string& key)
+{
+    return entries.find(key) != entries.end();
+}
+
+/*
+Drop a reference to an asset. Textures that did not come
+from the cache are deleted immediately.
+
+Parameters
+----------
+ID : GLuint
+    GL texture name returned by Acquire
+
+Returns
+-------
+None
+*/
+void AssetCache::Release(GLuint ID)
+{
+    if (ID == 0) return;
+
+    auto key = keys.find(ID);
+    if (key == keys.end()) {
+        glDeleteTextures(1, &ID);
+        return;
+    }
+
+    auto entry = entries.find(key->second);
+    if (--entry->second.references > 0) return;
+
+    glDeleteTextures(1, &ID);
+    entries.erase(entry);
+    keys.erase(key);
+}
+
+/*
+Build a cache key, assets created from the same file
+with different parameters are cached separately
+
+Parameters
+----------
+kind : const char *
+    Asset kind, e.g. "texture", "cubemap", or "font"
+
+path : const std::string&
+    File or directory the asset is loaded from
+
+param1, param2 : GLenum
+    Creation parameters such as sampler filters or file format
+
+Returns
+-------
+key : std::string
+    Cache key
+*/
+std::string AssetCache::Key(const char * kind, const std::string& path, GLenum param1, GLenum param2)
+{
+    return std::string(kind) + "|" + path + "|" + std::to_string(param1) + "|" + std::to_string(param2);
+}
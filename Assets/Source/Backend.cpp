@@ -1,5 +1,8 @@
 #include "Backend.hpp"
 
+// Frames left to draw before the main loop may sleep
+static std::atomic<int> redrawFrames{REDRAW_FRAMES};
+
 /*
 Initializes GLFW window with given information
 Does NOT Check for valid window or successful initialization
@@ -216,6 +219,78 @@ void DeactivateTextSettings()
     glEnable(GL_STENCIL_TEST);
 }
 
+// ********************
+// * Render on Demand *
+// ********************
+
+/*
+Request that the next frames are drawn. Called by input callbacks, camera
+movement, and anything else that changes what is on screen.
+
+Parameters
+----------
+frames : int
+    Number of frames to draw, by default REDRAW_FRAMES
+
+Returns
+-------
+None
+*/
+void MarkDirty(int frames)
+{
+    int current = redrawFrames.load();
+    while (current < frames && !redrawFrames.compare_exchange_weak(current, frames)) {}
+
+    // Wake the main loop if it is waiting for events
+    glfwPostEmptyEvent();
+}
+
+/*
+Check whether a frame should be drawn
+
+Parameters
+----------
+None
+
+Returns
+-------
+redraw : bool
+    True if a redraw is pending, the pending count is decreased by one
+*/
+bool ConsumeRedraw()
+{
+    int current = redrawFrames.load();
+    while (current > 0) {
+        if (redrawFrames.compare_exchange_weak(current, current - 1)) return true;
+    }
+    return false;
+}
+
+/*
+Install callbacks marking the scene dirty on mouse, text, and window events.
+ImGui chains callbacks that were installed before it, so this must run before initIMGUI.
+
+Parameters
+----------
+window : GLFWwindow*
+    Target window
+
+Returns
+-------
+None
+*/
+void InstallRedrawCallbacks(GLFWwindow * window)
+{
+    glfwSetCursorPosCallback(window, cursor_pos_callback);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetCharCallback(window, char_callback);
+    glfwSetCursorEnterCallback(window, cursor_enter_callback);
+    glfwSetWindowFocusCallback(window, window_focus_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+}
+
 // *************
 // * Callbacks *
 // *************
@@ -223,6 +298,7 @@ void DeactivateTextSettings()
 void window_size_callback(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    MarkDirty();
 }
 
 void window_iconify_callback(GLFWwindow* window, int iconified)
@@ -241,6 +317,8 @@ void window_iconify_callback(GLFWwindow* window, int iconified)
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
+    MarkDirty();
+
     // *************
     // * SHORTCUTS *
     // *************
@@ -264,3 +342,43 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         }
     }
 }
+
+void cursor_pos_callback(GLFWwindow* window, double xpos, double ypos)
+{
+    MarkDirty();
+}
+
+void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+    MarkDirty();
+}
+
+void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
+{
+    MarkDirty();
+}
+
+void char_callback(GLFWwindow* window, unsigned int codepoint)
+{
+    MarkDirty();
+}
+
+void cursor_enter_callback(GLFWwindow* window, int entered)
+{
+    MarkDirty();
+}
+
+void window_focus_callback(GLFWwindow* window, int focused)
+{
+    MarkDirty();
+}
+
+void window_refresh_callback(GLFWwindow* window)
+{
+    MarkDirty();
+}
+
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    MarkDirty();
+}
@@ -24,7 +24,7 @@ Returns
 -------
 Camera object
 */
-Camera::Camera(int width, int height, glm::vec3 position){
+Camera::Camera(int width, int height, glm::vec3 position) : ubo(CAMERA_BINDING){
     Camera::width = width;
     Camera::height = height;
 
@@ -67,6 +67,13 @@ void Camera::UpdateMatrix(int width, int height){
     projection = glm::perspective(glm::radians(FOVdeg), (float)(float(width)/(float)(height)), nearPlane, farPlane);
 
     cameraMatrix = projection * Camera::view;
+
+    // Upload once per frame, every program reads the matrix from the camera block
+    CameraBlock block;
+    block.camMatrix = cameraMatrix;
+    block.camPos = position;
+    block.pad = 0.0f;
+    ubo.Update(block);
 }
 
 /* Export camera matrix to shader 
@@ -96,9 +103,10 @@ window : GLFWwindow*
 
 Returns
 -------
-None
+moved : bool
+    True if the view changed
 */
-void Camera::Input(GLFWwindow * window, double deltaTime){
+bool Camera::Input(GLFWwindow * window, double deltaTime){
     deltaSpeed = speed * deltaTime;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS){
         
@@ -183,5 +191,9 @@ void Camera::Input(GLFWwindow * window, double deltaTime){
 		firstClick = true;
     }
 
+    glm::mat4 previousView = Camera::view;
     Camera::view = glm::lookAt(position, position + orientation, up);
+
+    // Report movement so the scene is redrawn while keys or the mouse move the camera
+    return Camera::view != previousView;
 }
\ No newline at end of file
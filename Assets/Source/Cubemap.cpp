@@ -75,10 +75,20 @@ Cubemap::Cubemap(const char* cubeDir, FileType format){
 	faces[5] = std::string(cubeDir) + "back"   + formatStr;    // (+z)
 
     Cubemap::format = format;
+    Cubemap::directory = cubeDir;
 }
 
 void Cubemap::BindTextures(){
+    // Cubemaps loaded from the same directory share one texture
+    cubeMapTexture = AssetCache::Acquire(
+        AssetCache::Key("cubemap", directory, format),
+        [&](std::shared_ptr<void>&) { return LoadTextures(); }
+    );
+}
+
+GLuint Cubemap::LoadTextures(){
     // Create and bind texture for cube map
+    GLuint cubeMapTexture;
     glGenTextures(1, &cubeMapTexture);
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapTexture);
 
@@ -93,8 +103,10 @@ void Cubemap::BindTextures(){
 	// Potential help with seams on some systems
 	//glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-    // Disable vertical flip since cubemaps start at top left corner
-    stbi_set_flip_vertically_on_load(false);
+    // Decode all faces in parallel, vertical flip is disabled since cubemaps start at top left corner
+    for (unsigned int i = 0; i < 6; i++) {
+        ImageDecoder::Shared().Request(faces[i], false);
+    }
 
     int fileType = GL_RGB;
     if (format == PNG) {
@@ -103,9 +115,10 @@ void Cubemap::BindTextures(){
 
     // Read and load each texture
     for (unsigned int i = 0; i < 6; i++) {
-        int width, height, numChannels;
-        
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &numChannels, 0);
+        Image face = ImageDecoder::Shared().Get(faces[i], false);
+        int width = face.width;
+        int height = face.height;
+        unsigned char* data = face.pixels;
         // Check if data exists
         if (data) {
             // Greate GL texture
@@ -130,6 +143,18 @@ void Cubemap::BindTextures(){
 			stbi_image_free(data);
         }
     }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    return cubeMapTexture;
+}
+
+void Cubemap::Delete(){
+    AssetCache::Release(cubeMapTexture);
+    cubeMapTexture = 0;
+
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
 }
 
 void Cubemap::Draw(
@@ -140,26 +165,10 @@ void Cubemap::Draw(
     // Activate Shader
     shader.Activate();
 
-    // Send camera position to shader and perform camera matrix calculations
-    
-    shader.setVec3("camPos", camera.position.x, camera.position.y, camera.position.z);
-    camera.Matrix(shader, "camMatrix");
-
-    // Create transformation matrices for mesh
-    glm::mat4 trans = glm::mat4(1.0f);
-    glm::mat4 rot = glm::mat4(1.0f);
-    glm::mat4 sca = glm::mat4(1.0f);
-
-    // Apply translation, rotation, and scale to transformation matrices
-    trans = glm::translate(trans, translation);
-    rot = glm::mat4_cast(rotation);
-    sca = glm::scale(sca, scale);
-
-    // Send transformation matrices and model matrix to shader
-    shader.setMat4("translation", trans);
-    shader.setMat4("rotation", rot);
-    shader.setMat4("scale", sca);
-    shader.setMat4("model", matrix);
+    // Send model matrix to the object block
+    ObjectBlock object;
+    object.model = ObjectMatrix(matrix, translation, rotation, scale);
+    ObjectBuffer().Update(object);
 
     // Draw object 
     glBindVertexArray(VAO);
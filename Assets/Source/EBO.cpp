@@ -29,6 +29,17 @@ EBO::EBO(std::vector<GLuint> indices, GLenum usage){
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), usage);
 }
 
+EBO::EBO()
+{
+    glGenBuffers(1, &ID);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID);
+}
+
+void EBO::BufferData(unsigned int size, GLenum usage)
+{
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size * sizeof(GLuint), NULL, usage);
+}
+
 /*
 Bind buffer to binding point
 
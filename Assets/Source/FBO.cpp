@@ -1,4 +1,7 @@
 #include "FBO.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
+#include <cmath>
 
 GLuint SelectionFBO::currSel = 0;
 
@@ -33,6 +36,9 @@ void FBO::Init(int width, int height)
         printf("Frame Buffer error, status: 0x%x\n", status);
     }
 
+    FBO::width = width;
+    FBO::height = height;
+
     // Restore the default framebuffer
     glBindTexture(GL_TEXTURE_2D, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
@@ -78,54 +84,174 @@ FBO::Pixel FBO::ReadPixel(GLuint x, GLuint y)
     return Pixel;
 }
 
-void SelectionFBO::InitVAO(void *meshPtr, VAO<PosVertex> &vao)
+/*
+Queue an object pick at a window pixel. The ID pass is only drawn on frames
+with a pending pick, its pixels are copied into a pixel buffer and the
+result is returned by PollPick once the GPU has finished, usually one or two frames later.
+
+Parameters
+----------
+x : GLuint
+    Window x coordinate in pixels
+y : GLuint
+    Window y coordinate in pixels, from the bottom of the window
+radius : int
+    Pick radius in pixels, by default 0 (single pixel)
+callback : PickCallback
+    Optional function called with the result from PollPick
+
+Returns
+-------
+None
+*/
+void SelectionFBO::RequestPick(GLuint x, GLuint y, int radius, PickCallback callback)
+{
+    pickPending = true;
+    pickX = x;
+    pickY = y;
+    pickRadius = std::min(std::max(radius, 0), PICK_MAX_RADIUS);
+    pickCallback = callback;
+}
+
+void SelectionFBO::IssueRead()
 {
-    
-    // Bind Vertex Array Object (VAO)
-    vao.Bind();
+    if (readCount == PICK_BUFFERS) return; // All buffers in flight, drop the request
+
+    PickRead & read = reads[(readHead + readCount) % PICK_BUFFERS];
+    int side = 2 * PICK_MAX_RADIUS + 1;
+
+    if (read.pbo == 0) {
+        glGenBuffers(1, &read.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, side * side * sizeof(GLuint), NULL, GL_STREAM_READ);
+    }
 
-    NMRMesh * mesh = static_cast<NMRMesh *>(meshPtr);
+    // Clamp region to the frame buffer
+    int x0 = std::max((int)pickX - pickRadius, 0);
+    int y0 = std::max((int)pickY - pickRadius, 0);
+    int x1 = std::min((int)pickX + pickRadius, width - 1);
+    int y1 = std::min((int)pickY + pickRadius, height - 1);
 
-    std::vector<GLuint> indices = mesh->indices;
-    std::vector<PosVertex> vertices = mesh->posVertices;
-    VBO<PosVertex> vbo(vertices);
+    if (x1 < x0 || y1 < y0) return;
 
-    // Index Buffer Object (EBO)
-    EBO ebo(indices);
+    read.width = x1 - x0 + 1;
+    read.height = y1 - y0 + 1;
+    read.cx = (int)pickX - x0;
+    read.cy = (int)pickY - y0;
+    read.callback = pickCallback;
 
-    // Link vbo layouts to corresponding vao
-    // Position Coordinate layout (layout 0)
-    vao.LinkAttrib(vbo, 0, 3, GL_FLOAT, sizeof(PosVertex), (void *)0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, ID);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+
+    // Copy happens on the GPU, glReadPixels returns immediately with a pack buffer bound
+    glReadPixels(x0, y0, read.width, read.height, GL_RED_INTEGER, GL_UNSIGNED_INT, (void *)0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 
-    vao.Unbind();
-    vbo.Unbind();
-    ebo.Unbind();
+    read.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readCount++;
 }
 
-void SelectionFBO::InitVAO(Mesh *ptr, VAO<PosVertex> &vao)
+/*
+Whether a pick is waiting for the ID pass or its read back has not finished,
+the scene keeps being drawn until the result is delivered
+
+Parameters
+----------
+None
+
+Returns
+-------
+busy : bool
+    True while picks are outstanding
+*/
+bool SelectionFBO::Busy()
+{
+    return pickPending || readCount > 0;
+}
+
+/*
+Retrieve the oldest finished pick. Never waits on the GPU.
+
+Parameters
+----------
+pixel : Pixel&
+    Output object under the requested pixel, or the nearest object inside the pick radius
+
+Returns
+-------
+True if a pick finished, false if none is ready
+*/
+bool SelectionFBO::PollPick(Pixel &pixel)
 {
-    
-    // Bind Vertex Array Object (VAO)
-    vao.Bind();
+    if (readCount == 0) return false;
+
+    PickRead & read = reads[readHead];
+
+    GLenum status = glClientWaitSync(read.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (status == GL_TIMEOUT_EXPIRED) return false;
+
+    glDeleteSync(read.fence);
+    read.fence = 0;
+    readHead = (readHead + 1) % PICK_BUFFERS;
+    readCount--;
+
+    if (status == GL_WAIT_FAILED) return false;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+    GLuint * ids = (GLuint *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, read.width * read.height * sizeof(GLuint), GL_MAP_READ_BIT);
 
-    std::vector<GLuint> indices = ptr->indices;
-    std::vector<PosVertex> vertices = ptr->posVertices;
-    VBO<PosVertex> vbo(vertices);
+    pixel = Pixel();
 
-    // Index Buffer Object (EBO)
-    EBO ebo(indices);
+    if (ids != NULL) {
+        int best = -1;
 
-    // Link vbo layouts to corresponding vao
-    // Position Coordinate layout (layout 0)
-    vao.LinkAttrib(vbo, 0, 3, GL_FLOAT, sizeof(PosVertex), (void *)0);
+        // Requested pixel first, otherwise the closest pixel covered by an object
+        for (int y = 0; y < read.height; y++) {
+            for (int x = 0; x < read.width; x++) {
+                int dist = (x - read.cx) * (x - read.cx) + (y - read.cy) * (y - read.cy);
+                GLuint id = ids[y * read.width + x];
 
-    vao.Unbind();
-    vbo.Unbind();
-    ebo.Unbind();
+                if (id != 0 && (best < 0 || dist < best)) {
+                    best = dist;
+                    pixel.objID = id;
+                }
+            }
+        }
+
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (read.callback) read.callback(pixel);
+
+    return true;
+}
+
+void SelectionFBO::Delete()
+{
+    for (auto & read : reads) {
+        if (read.fence != 0) glDeleteSync(read.fence);
+        if (read.pbo != 0) glDeleteBuffers(1, &read.pbo);
+        read = PickRead();
+    }
+
+    readHead = 0;
+    readCount = 0;
+    pickPending = false;
+
+    FBO::Delete();
 }
 
-void SelectionFBO::SelectMesh(Shader &selection_shader, Camera &camera, std::map<std::string, void *> nmrMeshes)
+void SelectionFBO::SelectMesh(Shader &selection_shader, Camera &camera, std::map<std::string, NMRMesh *> &nmrMeshes, Shader * heightfield_shader)
 {
+    // Nothing to pick this frame
+    if (!pickPending) return;
+
     Bind(); // Bind FBO
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear FBO
@@ -137,26 +263,47 @@ void SelectionFBO::SelectMesh(Shader &selection_shader, Camera &camera, std::map
         // Avoid null pointer
         if (ptr == NULL) continue;
 
-        VAO<PosVertex> vao;
+        NMRMesh * mesh = ptr;
 
-        NMRMesh * mesh = static_cast<NMRMesh *>(ptr);
+        // Terrain tiles share the vertex layout of meshes, draw the tiles chosen for the last frame
+        if (mesh->terrainLOD) {
+            selection_shader.setUInt("objID", static_cast<GLuint>(mesh->ID));
+            mesh->DrawTerrain(selection_shader, camera, mesh->drawMat, mesh->pos, mesh->rot, mesh->scale);
+            continue;
+        }
 
-        SelectionFBO::InitVAO(mesh, vao);
+        // Heightfield meshes have no vertex buffer, draw them with the heightfield selection shader
+        if (mesh->heightfield) {
+            if (heightfield_shader == NULL) continue;
+
+            heightfield_shader->Activate();
+            heightfield_shader->setUInt("objID", static_cast<GLuint>(mesh->ID));
+            mesh->DrawHeightfield(*heightfield_shader, camera, mesh->drawMat, mesh->pos, mesh->rot, mesh->scale);
+
+            selection_shader.Activate();
+            continue;
+        }
 
         GLuint objectID = static_cast<GLuint>(mesh->ID); // Assign unique object ID starting from 1
         selection_shader.setUInt("objID", objectID);
 
         // Draw the mesh
-        DrawSelection(selection_shader, camera, vao, mesh);
+        DrawSelection(selection_shader, camera, mesh);
 
         // mesh->Draw(selection_shader, camera, mat, pos, rot, scale);
     }
 
     Unbind(); // Unbind FBO
+
+    IssueRead();
+    pickPending = false;
 }
 
-void SelectionFBO::SelectMesh(Shader &selection_shader, Camera &camera, std::vector<Mesh *> vector)
+void SelectionFBO::SelectMesh(Shader &selection_shader, Camera &camera, std::vector<Mesh *> &vector)
 {
+    // Nothing to pick this frame
+    if (!pickPending) return;
+
     Bind(); // Bind FBO
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear FBO
@@ -168,23 +315,22 @@ void SelectionFBO::SelectMesh(Shader &selection_shader, Camera &camera, std::vec
         // Avoid null pointer
         if (ptr == NULL) continue;
 
-        VAO<PosVertex> vao;
-
-        SelectionFBO::InitVAO(ptr, vao);
-
         GLuint objectID = static_cast<GLuint>(ptr->ID); // Assign unique object ID starting from 1
         selection_shader.setUInt("objID", objectID);
 
         // Draw the mesh
-        DrawSelection(selection_shader, camera, vao, ptr);
+        DrawSelection(selection_shader, camera, ptr);
 
         // mesh->Draw(selection_shader, camera, mat, pos, rot, scale);
     }
 
     Unbind(); // Unbind FBO
+
+    IssueRead();
+    pickPending = false;
 }
 
-void SelectionFBO::DrawSelection(Shader &shader, Camera &camera, VAO<PosVertex> &vao, NMRMesh * mesh)
+void SelectionFBO::DrawSelection(Shader &shader, Camera &camera, NMRMesh * mesh)
 {
     glm::mat4 mat   = mesh->drawMat;
     glm::vec3 pos   = mesh->pos;
@@ -192,70 +338,210 @@ void SelectionFBO::DrawSelection(Shader &shader, Camera &camera, VAO<PosVertex>
     glm::vec3 scale = mesh->scale;
 
     shader.Activate();
-    vao.Bind();
+    mesh->pickVAO.Bind();
 
-    camera.Matrix(shader, "camMatrix");
+    // Send model matrix to the object block
+    ObjectBlock object;
+    object.model = ObjectMatrix(mat, pos, rot, scale);
+    ObjectBuffer().Update(object);
 
-    // Create transformation matrices for mesh
+    glDrawElementsBaseVertex(GL_TRIANGLES, mesh->bufferIndices, GL_UNSIGNED_INT, (void *)(mesh->firstIndex * sizeof(GLuint)), mesh->baseVertex);
+}
 
-    glm::mat4 trans = MAT_IDENTITY;
-    glm::mat4 rotat = MAT_IDENTITY;
-    glm::mat4 sca = MAT_IDENTITY;
+void SelectionFBO::DrawSelection(Shader &shader, Camera &camera, Mesh * ptr)
+{
+    glm::mat4 mat   = MAT_IDENTITY;
+    glm::vec3 pos   = ptr->pos;
+    glm::quat rot   = QUAT_IDENTITY;
+    glm::vec3 scale = ONES;
+
+    shader.Activate();
+    ptr->pickVAO.Bind();
+
+    // Send model matrix to the object block
+    ObjectBlock object;
+    object.model = ObjectMatrix(mat, pos, rot, scale);
+    ObjectBuffer().Update(object);
+
+    glDrawElementsBaseVertex(GL_TRIANGLES, ptr->bufferIndices, GL_UNSIGNED_INT, (void *)(ptr->firstIndex * sizeof(GLuint)), ptr->baseVertex);
+}
+
+/*
+Draw the selection outline over the default frame buffer. Its depth-stencil
+buffer is copied into a texture first, which is read by the outline shader.
+
+Parameters
+----------
+shader : Shader &
+    Outline shader program
+width : int
+    Width of the default frame buffer
+height : int
+    Height of the default frame buffer
+lineWidth : float
+    Outline width in pixels, at most OUTLINE_MAX_WIDTH
+color : const float[4]
+    Outline color and opacity
+bounds : const glm::mat4 *
+    Clip space matrix of the [-1, 1] box holding the object, by default NULL (whole screen)
+padding : float
+    Pixels the object draws past its projected box, by default 0.0
+
+Returns
+-------
+None
+*/
+void OutlinePass::Draw(Shader & shader, int width, int height, float lineWidth, const float color[4], const glm::mat4 * bounds, float padding)
+{
+    PROFILE_ZONE("OutlinePass::Draw");
+
+    if (width <= 0 || height <= 0) return;
+
+    lineWidth = std::min(lineWidth, (float)OUTLINE_MAX_WIDTH);
+
+    // Only pixels within the line width of the projected box can be outlined
+    int x0 = 0, y0 = 0, x1 = width, y1 = height;
+    if (bounds != NULL && !ScreenBounds(*bounds, width, height, x0, y0, x1, y1)) return;
+
+    int margin = (int)std::ceil(lineWidth + padding) + 1;
+    x0 = std::max(x0 - margin, 0);
+    y0 = std::max(y0 - margin, 0);
+    x1 = std::min(x1 + margin, width);
+    y1 = std::min(y1 + margin, height);
+    if (x0 >= x1 || y0 >= y1) return;
 
-    // Global transformation matrices
+    if (width != OutlinePass::width || height != OutlinePass::height) {
+        Delete();
+        Init(width, height);
+    }
 
-    glm::mat4 gtrans = MAT_IDENTITY;
-    glm::mat4 grot = MAT_IDENTITY;
-    glm::mat4 gsca = MAT_IDENTITY;
+    // Stencil is only copied together with depth, both formats match the default frame buffer
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, ID);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    // Apply translation, rotation, and scale to transformation matrices
-    trans = glm::translate(trans, pos);
-    rotat = glm::mat4_cast(rot);
-    sca = glm::scale(sca, scale);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_STENCIL_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // Send transformation matrices and model matrix to shader
-    shader.setMat4("translation", trans);
-    shader.setMat4("rotation", rotat);
-    shader.setMat4("scale", sca);
-    shader.setMat4("model", mat);
+    shader.Activate();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, stencilID);
+    shader.setInt("stencilMap", 0);
+    shader.setInt("selected", OUTLINE_STENCIL);
+    shader.setFloat("lineWidth", lineWidth);
+    shader.setVec4("color", color[0], color[1], color[2], color[3]);
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x0, y0, x1 - x0, y1 - y0);
+
+    glBindVertexArray(vaoID);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    glDrawElements(GL_TRIANGLES, mesh->indices.size(), GL_UNSIGNED_INT, 0);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_BLEND);
+    glEnable(GL_STENCIL_TEST);
+    glEnable(GL_DEPTH_TEST);
 }
 
-void SelectionFBO::DrawSelection(Shader &shader, Camera &camera, VAO<PosVertex> &vao, Mesh * ptr)
+/*
+Pixel rectangle covered by the projection of a [-1, 1] box
+
+Parameters
+----------
+bounds : const glm::mat4 &
+    Clip space matrix of the box
+width, height : int
+    Size of the frame buffer
+x0, y0, x1, y1 : int &
+    Output rectangle, the whole frame buffer if the box crosses the camera plane
+
+Returns
+-------
+visible : bool
+    False if the box is entirely behind the camera
+*/
+bool OutlinePass::ScreenBounds(const glm::mat4 & bounds, int width, int height, int & x0, int & y0, int & x1, int & y1)
 {
-    glm::mat4 mat   = MAT_IDENTITY;
-    glm::vec3 pos   = ptr->pos;
-    glm::quat rot   = QUAT_IDENTITY;
-    glm::vec3 scale = ONES;
+    glm::vec2 lo(1.0f), hi(-1.0f);
+    int behind = 0;
 
-    shader.Activate();
-    vao.Bind();
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec4 clip = bounds * glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, corner & 4 ? 1.0f : -1.0f, 1.0f);
+
+        if (clip.w <= 0.0f) {
+            behind++;
+            continue;
+        }
 
-    camera.Matrix(shader, "camMatrix");
+        glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+        lo = glm::min(lo, ndc);
+        hi = glm::max(hi, ndc);
+    }
+
+    if (behind == 8) return false;
+
+    x0 = 0; y0 = 0; x1 = width; y1 = height;
+
+    // A box through the camera plane can project anywhere
+    if (behind > 0) return true;
+
+    lo = glm::clamp(lo, glm::vec2(-1.0f), glm::vec2(1.0f));
+    hi = glm::clamp(hi, glm::vec2(-1.0f), glm::vec2(1.0f));
+
+    x0 = (int)std::floor((lo.x * 0.5f + 0.5f) * width);
+    y0 = (int)std::floor((lo.y * 0.5f + 0.5f) * height);
+    x1 = (int)std::ceil((hi.x * 0.5f + 0.5f) * width);
+    y1 = (int)std::ceil((hi.y * 0.5f + 0.5f) * height);
+
+    return true;
+}
+
+void OutlinePass::Init(int width, int height)
+{
+    OutlinePass::width = width;
+    OutlinePass::height = height;
+
+    glGenFramebuffers(1, &ID);
+    glBindFramebuffer(GL_FRAMEBUFFER, ID);
 
-    // Create transformation matrices for mesh
+    // Sampled as unsigned stencil indices
+    glGenTextures(1, &stencilID);
+    glBindTexture(GL_TEXTURE_2D, stencilID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_DEPTH_STENCIL_TEXTURE_MODE, GL_STENCIL_INDEX);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, stencilID, 0);
 
-    glm::mat4 trans = MAT_IDENTITY;
-    glm::mat4 rotat = MAT_IDENTITY;
-    glm::mat4 sca = MAT_IDENTITY;
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
 
-    // Global transformation matrices
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
 
-    glm::mat4 gtrans = MAT_IDENTITY;
-    glm::mat4 grot = MAT_IDENTITY;
-    glm::mat4 gsca = MAT_IDENTITY;
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Frame Buffer error, status: 0x%x\n", status);
+    }
 
-    // Apply translation, rotation, and scale to transformation matrices
-    trans = glm::translate(trans, pos);
-    rotat = glm::mat4_cast(rot);
-    sca = glm::scale(sca, scale);
+    glGenVertexArrays(1, &vaoID);
 
-    // Send transformation matrices and model matrix to shader
-    shader.setMat4("translation", trans);
-    shader.setMat4("rotation", rotat);
-    shader.setMat4("scale", sca);
-    shader.setMat4("model", mat);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
 
-    glDrawElements(GL_TRIANGLES, ptr->indices.size(), GL_UNSIGNED_INT, 0);
+void OutlinePass::Delete()
+{
+    if (ID != 0) glDeleteFramebuffers(1, &ID);
+    if (stencilID != 0) glDeleteTextures(1, &stencilID);
+    if (vaoID != 0) glDeleteVertexArrays(1, &vaoID);
+
+    ID = 0;
+    stencilID = 0;
+    vaoID = 0;
+    width = 0;
+    height = 0;
 }
@@ -0,0 +1,69 @@
+#include "FileCache.hpp"
+#include <filesystem>
+
+/*
+64 bit FNV-1a hash of a buffer
+
+Parameters
+----------
+data : const void *
+    Bytes to hash
+size : size_t
+    Number of bytes
+hash : uint64_t
+    Hash of the preceding buffers, by default FILE_CACHE_HASH_SEED
+
+Returns
+-------
+hash : uint64_t
+    Hash of the preceding buffers followed by data
+*/
+uint64_t FileCache::Hash64(const void * data, size_t size, uint64_t hash)
+{
+    const unsigned char * bytes = (const unsigned char *)data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/*
+Write a file through a temporary file, so an interrupted write never leaves
+a truncated file at path and readers see either the old or the new file.
+
+Parameters
+----------
+path : const std::string&
+    Destination file
+write : const std::function<bool(std::ofstream&)>&
+    Writes the contents to the stream, returns false to abandon the file
+
+Returns
+-------
+success : bool
+    True if path holds the new contents
+*/
+bool FileCache::WriteAtomic(const std::string& path, const std::function<bool(std::ofstream&)>& write)
+{
+    std::string tempFile = path + ".tmp";
+    std::error_code error;
+
+    std::ofstream out(tempFile, std::ios::binary);
+    if (!out) return false;
+
+    bool written = write(out);
+    out.close();
+
+    if (!written || !out) {
+        std::filesystem::remove(tempFile, error);
+        return false;
+    }
+
+    std::filesystem::rename(tempFile, path, error);
+    if (error) std::filesystem::remove(tempFile, error);
+
+    return !error;
+}
@@ -0,0 +1,187 @@
+#include "ImageDecoder.hpp"
+#include <algorithm>
+#include <stb/stb_image.h>
+
+/*
+Start background image decoder
+
+Parameters
+----------
+workerCount : unsigned int
+    Number of worker threads, by default 0 (chosen from hardware concurrency)
+
+Returns
+-------
+ImageDecoder Object
+*/
+ImageDecoder::ImageDecoder(unsigned int workerCount)
+{
+    if (workerCount == 0) {
+        workerCount = std::thread::hardware_concurrency();
+        if (workerCount < 1) workerCount = 1;
+        if (workerCount > 6) workerCount = 6;
+    }
+
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&ImageDecoder::Work, this);
+    }
+}
+
+ImageDecoder::~ImageDecoder()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCond.notify_all();
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+
+    for (auto & [key, job] : jobs) {
+        if (job->image.pixels != NULL) stbi_image_free(job->image.pixels);
+        delete job;
+    }
+
+    jobs.clear();
+}
+
+/*
+Queue an image to be decoded in the background
+
+Parameters
+----------
+path : const std::string&
+    Path to image file
+
+flip : bool
+    Whether to flip the image vertically on load
+
+Returns
+-------
+None
+*/
+void ImageDecoder::Request(const std::string& path, bool flip)
+{
+    std::string key = Key(path, flip);
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        if (jobs.find(key) != jobs.end()) return;
+
+        Job * job = new Job;
+        job->path = path;
+        job->flip = flip;
+
+        jobs[key] = job;
+        pending.push_back(job);
+    }
+    queueCond.notify_one();
+}
+
+/*
+Collect a decoded image. Images that were requested are taken from the
+workers, images no worker has started yet and images that were never
+requested are decoded on the calling thread instead of waiting.
+
+Parameters
+----------
+path : const std::string&
+    Path to image file
+
+flip : bool
+    Whether to flip the image vertically on load
+
+Returns
+-------
+image : Image
+    Decoded image owned by the caller, free pixels with stbi_image_free
+*/
+Image ImageDecoder::Get(const std::string& path, bool flip)
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+
+    auto found = jobs.find(Key(path, flip));
+    if (found == jobs.end()) {
+        lock.unlock();
+        return Decode(path, flip);
+    }
+
+    Job * job = found->second;
+    jobs.erase(found);
+
+    if (!job->started) {
+        pending.erase(std::find(pending.begin(), pending.end(), job));
+        lock.unlock();
+        delete job;
+        return Decode(path, flip);
+    }
+
+    doneCond.wait(lock, [job] { return job->done; });
+    lock.unlock();
+
+    Image image = job->image;
+    delete job;
+
+    return image;
+}
+
+/*
+Decoder shared by textures, cubemaps, and models.
+Workers are started on first use and joined at exit.
+
+Parameters
+----------
+None
+
+Returns
+-------
+decoder : ImageDecoder&
+    Shared decoder
+*/
+ImageDecoder& ImageDecoder::Shared()
+{
+    static ImageDecoder decoder;
+    return decoder;
+}
+
+void ImageDecoder::Work()
+{
+    while (true) {
+        Job * job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCond.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (stopping) return;
+
+            job = pending.front();
+            pending.pop_front();
+            job->started = true;
+        }
+
+        Image image = Decode(job->path, job->flip);
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            job->image = image;
+            job->done = true;
+        }
+        doneCond.notify_all();
+    }
+}
+
+Image ImageDecoder::Decode(const std::string& path, bool flip)
+{
+    Image image;
+
+    // Flip setting is per thread so concurrent decodes do not race on it
+    stbi_set_flip_vertically_on_load_thread(flip);
+    image.pixels = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, 0);
+
+    return image;
+}
+
+std::string ImageDecoder::Key(const std::string& path, bool flip)
+{
+    return path + (flip ? "|flip" : "|noflip");
+}
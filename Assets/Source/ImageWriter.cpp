@@ -0,0 +1,149 @@
+#include "ImageWriter.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <stb/stb_image_write.h>
+
+/*
+Start background image writer
+
+Parameters
+----------
+workerCount : unsigned int
+    Number of worker threads, by default 0 (chosen from hardware concurrency)
+
+Returns
+-------
+ImageWriter Object
+*/
+ImageWriter::ImageWriter(unsigned int workerCount)
+{
+    if (workerCount == 0) {
+        workerCount = std::thread::hardware_concurrency() / 2;
+        if (workerCount < 1) workerCount = 1;
+    }
+
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&ImageWriter::Work, this);
+    }
+}
+
+ImageWriter::~ImageWriter()
+{
+    Finish();
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCond.notify_all();
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+/*
+Queue an image to be encoded and written in the background
+
+Parameters
+----------
+path : const std::string&
+    Output PNG file
+pixels : std::vector<unsigned char>&
+    Image rows from bottom to top, moved into the writer (left empty on return)
+width : int
+    Image width in pixels
+height : int
+    Image height in pixels
+channels : int
+    Bytes per pixel
+
+Returns
+-------
+None
+*/
+void ImageWriter::Write(const std::string& path, std::vector<unsigned char>& pixels, int width, int height, int channels)
+{
+    Job * job = new Job;
+    job->path = path;
+    job->pixels.swap(pixels);
+    job->width = width;
+    job->height = height;
+    job->channels = channels;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        pending.push_back(job);
+    }
+    queueCond.notify_one();
+}
+
+int ImageWriter::Finish()
+{
+    std::unique_lock<std::mutex> lock(queueMutex);
+    doneCond.wait(lock, [this] { return pending.empty() && active == 0; });
+
+    int failed = failures;
+    failures = 0;
+
+    return failed;
+}
+
+size_t ImageWriter::Pending()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return pending.size() + active;
+}
+
+void ImageWriter::Work()
+{
+    while (true) {
+        Job * job;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCond.wait(lock, [this] { return stopping || !pending.empty(); });
+            if (stopping && pending.empty()) return;
+
+            job = pending.front();
+            pending.pop_front();
+            active++;
+        }
+
+        bool success = Encode(*job);
+        delete job;
+
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            active--;
+            if (!success) failures++;
+        }
+        doneCond.notify_all();
+    }
+}
+
+bool ImageWriter::Encode(Job& job)
+{
+    size_t stride = (size_t)job.width * job.channels;
+
+    if (job.pixels.size() < stride * job.height) {
+        printf("ERROR::IMAGE_WRITER: No pixels read for %s\n", job.path.c_str());
+        return false;
+    }
+
+    // OpenGL rows start at the bottom, flipped here since the stb flip setting is global
+    std::vector<unsigned char> row(stride);
+    for (int y = 0; y < job.height / 2; y++) {
+        unsigned char * top = job.pixels.data() + stride * y;
+        unsigned char * bottom = job.pixels.data() + stride * (job.height - 1 - y);
+        memcpy(row.data(), top, stride);
+        memcpy(top, bottom, stride);
+        memcpy(bottom, row.data(), stride);
+    }
+
+    if (!stbi_write_png(job.path.c_str(), job.width, job.height, job.channels, job.pixels.data(), (int)stride)) {
+        printf("ERROR::IMAGE_WRITER: Could not write %s\n", job.path.c_str());
+        return false;
+    }
+
+    return true;
+}
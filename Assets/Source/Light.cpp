@@ -14,6 +14,10 @@ Light::Light(unsigned int ID, LightType caster)
 
 void Light::Init(unsigned int ID, LightType caster)
 {
+    // Decode both maps at the same time
+    Texture::Prefetch("Assets/Textures/Alb/planks.png", GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR);
+    Texture::Prefetch("Assets/Textures/Spec/planksSpec.png", GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST);
+
     Texture textures[] = 
     {
         Texture("Assets/Textures/Alb/planks.png", "diffuse", 0, GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR),  // Load diffusion texture
@@ -97,6 +101,14 @@ void Light::UpdateUniforms(Shader &shader) {
 void Light::Display(WindowData &win, Camera &camera, Shaders &shaders)
 {
     UpdateUniforms(shaders["default"]);
+
+    if (shaders.find("default" HEIGHTFIELD_SUFFIX) != shaders.end()) {
+        UpdateUniforms(shaders["default" HEIGHTFIELD_SUFFIX]);
+    }
+
+    if (shaders.find("default" BATCHED_SUFFIX) != shaders.end()) {
+        UpdateUniforms(shaders["default" BATCHED_SUFFIX]);
+    }
     
     if (selID == ID) {
         DisplayUI(win, camera);
@@ -135,9 +147,6 @@ void Light::DisplayStencil(Shaders &shaders, Camera & camera)
     shaders["stencil"].Activate();
     shaders["stencil"].setVec4("color", BLACK);
     shaders["stencil"].setFloat("outlining", 10.0f);
-    shaders["stencil"].setMat4("gTranslation", glm::translate(MAT_IDENTITY, pos));
-    shaders["stencil"].setMat4("gRotation", glm::mat4_cast(rot));
-    shaders["stencil"].setMat4("gScale", glm::scale(MAT_IDENTITY, scale));
     
     // Pass stencil test only when not equal to one
     glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
@@ -48,26 +48,10 @@ void Line::Draw(
     shader.Activate();
     vao.Bind();
 
-    // Send camera position to shader and perform camera matrix calculations
-    shader.setVec3("camPos", camera.position.x, camera.position.y, camera.position.z);
-    camera.Matrix(shader, "camMatrix");
-
-    // Create transformation matrices for mesh
-
-    glm::mat4 trans = MAT_IDENTITY;
-    glm::mat4 rot = MAT_IDENTITY;
-    glm::mat4 sca = MAT_IDENTITY;
-
-    // Apply translation, rotation, and scale to transformation matrices
-    trans = glm::translate(trans, translation);
-    rot = glm::mat4_cast(rotation);
-    sca = glm::scale(sca, scale);
-
-    // Send transformation matrices and model matrix to shader
-    shader.setMat4("translation", trans);
-    shader.setMat4("rotation", rot);
-    shader.setMat4("scale", sca);
-    shader.setMat4("model", matrix);
+    // Send model matrix to the object block
+    ObjectBlock object;
+    object.model = ObjectMatrix(matrix, translation, rotation, scale);
+    ObjectBuffer().Update(object);
 
 
     glDrawElements(primative, indices.size(), GL_UNSIGNED_INT, 0);
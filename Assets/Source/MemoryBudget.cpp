@@ -0,0 +1,112 @@
+#include "MemoryBudget.hpp"
+#include "NMRMesh.hpp"
+#include "Profiler.hpp"
+#include <vector>
+#include <algorithm>
+#include <imgui/imgui.h>
+
+#define MB (1024.0 * 1024.0)
+
+size_t MemoryBudget::budget = (size_t)MEMORY_BUDGET_MB * 1024 * 1024;
+bool MemoryBudget::showUI = false;
+std::map<NMRMesh *, unsigned long> MemoryBudget::meshes;
+unsigned long MemoryBudget::frame = 0;
+size_t MemoryBudget::released = 0;
+
+// NMR library heap figures, refreshed whenever rdMutex is free
+static NMR_INT libraryUsed = 0;
+static NMR_INT libraryReused = 0;
+
+void MemoryBudget::Register(NMRMesh * mesh)
+{
+    meshes[mesh] = frame;
+}
+
+void MemoryBudget::Unregister(NMRMesh * mesh)
+{
+    meshes.erase(mesh);
+}
+
+void MemoryBudget::Touch(NMRMesh * mesh)
+{
+    auto entry = meshes.find(mesh);
+    if (entry != meshes.end()) entry->second = frame;
+}
+
+/*
+Release CPU copies of the least recently viewed meshes while usage exceeds the budget.
+Meshes viewed this frame are released last, their data is already on the GPU.
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+void MemoryBudget::Enforce()
+{
+    PROFILE_ZONE("MemoryBudget::Enforce");
+
+    frame++;
+
+    size_t usage = Usage();
+    if (usage <= budget) return;
+
+    std::vector<std::pair<unsigned long, NMRMesh *>> order;
+    for (auto& [mesh, viewed] : meshes) order.push_back({viewed, mesh});
+
+    std::sort(order.begin(), order.end());
+
+    for (auto& [viewed, mesh] : order) {
+        if (usage <= budget) break;
+
+        size_t bytes = mesh->ReleaseMemory();
+        usage -= std::min(usage, bytes);
+        released += bytes;
+    }
+}
+
+size_t MemoryBudget::Usage()
+{
+    size_t usage = 0;
+
+    for (auto& [mesh, viewed] : meshes) usage += mesh->MemoryUsage();
+
+    return usage;
+}
+
+void MemoryBudget::DisplayUI()
+{
+    if (!showUI) return;
+
+    if (!ImGui::Begin("Memory Budget", &showUI)) {
+        ImGui::End();
+        return;
+    }
+
+    size_t usage = Usage();
+
+    // Loader workers hold rdMutex for whole file reads, show the last figures meanwhile
+    std::unique_lock<std::mutex> lock(NMRMesh::rdMutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        getMemUsed(&libraryUsed, &libraryReused);
+        lock.unlock();
+    }
+
+    int budgetMB = (int)(budget / (1024 * 1024));
+    if (ImGui::SliderInt("Budget", &budgetMB, 64, MEMORY_BUDGET_MAX_MB, "%d MB")) {
+        budget = (size_t)budgetMB * 1024 * 1024;
+    }
+
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "%.1f / %d MB", usage / MB, budgetMB);
+    ImGui::ProgressBar(budget > 0 ? std::min((float)usage / (float)budget, 1.0f) : 1.0f, ImVec2(-1.0f, 0.0f), overlay);
+
+    ImGui::Text("Spectral data %.1f MB in %zu spectra", usage / MB, meshes.size());
+    ImGui::Text("NMR library heap %.1f MB", libraryUsed / MB);
+    ImGui::Text("Released %.1f MB", released / MB);
+
+    ImGui::End();
+}
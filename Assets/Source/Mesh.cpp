@@ -1,5 +1,6 @@
 #include "Mesh.hpp"
 #include "Constants.hpp"
+#include <algorithm>
 
 Mesh::Mesh(){
 
@@ -14,10 +15,6 @@ void Mesh::initMesh(Vertices& vertices, Indices& indices, Textures& textures){
     Mesh::indices = indices;
     Mesh::textures = textures;
 
-    for (auto vert : vertices){
-        Mesh::posVertices.push_back(PosVertex{vert.position});
-    }
-    
     // Vertex array object MUST be created before vertex buffer object
     // Vertex buffer is a different kind of buffer than the front and back buffer
     
@@ -43,31 +40,150 @@ void Mesh::initMesh(Vertices& vertices, Indices& indices, Textures& textures){
     vao.Unbind();
     vbo.Unbind();
     ebo.Unbind();
+
+    vboID = vbo.ID;
+    eboID = ebo.ID;
+    bufferVertices = Mesh::vertices.size();
+    bufferIndices = Mesh::indices.size();
+
+    initPickVAO();
 }
 
-void Mesh::SetPrimative(GLenum primative){
-    Mesh::primative = primative;
+/*
+Allocate mesh buffers and take ownership of the given data without uploading it,
+allowing large meshes to be streamed to the GPU over several frames
+
+Parameters
+----------
+vertices : Vertices&
+    Mesh vertices, swapped into the mesh (left empty on return)
+indices : Indices&
+    Mesh indices, swapped into the mesh (left empty on return)
+textures : Textures&
+    Mesh textures
+
+Returns
+-------
+None
+*/
+void Mesh::beginUpload(Vertices& vertices, Indices& indices, Textures& textures)
+{
+    Mesh::vertices.swap(vertices);
+    Mesh::indices.swap(indices);
+    Mesh::textures = textures;
+    bufferVertices = Mesh::vertices.size();
+    bufferIndices = Mesh::indices.size();
+
+    // Bind Vertex Array Object (VAO)
+    vao.Bind();
+
+    // Allocate vertex and index storage, data is filled by UploadStep
+    VBO<Vertex> vbo;
+    vbo.BufferData(Mesh::vertices.size());
+    EBO ebo;
+    ebo.BufferData(Mesh::indices.size());
+
+    // Position, normal, color and texture coordinate layouts
+    vao.LinkAttrib(vbo, 0, 3, GL_FLOAT, sizeof(Vertex), (void *)0);
+    vao.LinkAttrib(vbo, 1, 3, GL_FLOAT, sizeof(Vertex), (void *)(3 * sizeof(float)));
+    vao.LinkAttrib(vbo, 2, 3, GL_FLOAT, sizeof(Vertex), (void *)(6 * sizeof(float)));
+    vao.LinkAttrib(vbo, 3, 2, GL_FLOAT, sizeof(Vertex), (void *)(9 * sizeof(float)));
+
+    vao.Unbind();
+    vbo.Unbind();
+    ebo.Unbind();
+
+    vboID = vbo.ID;
+    eboID = ebo.ID;
+    initPickVAO();
+
+    ownsBuffers = true;
+    baseVertex = 0;
+    firstIndex = 0;
+    vertexOffset = 0;
+    indexOffset = 0;
+    uploaded = Mesh::vertices.empty() && Mesh::indices.empty();
 }
 
-void Mesh::Draw(
-    Shader& shader, Camera& camera,
-    glm::mat4 matrix,
-    glm::vec3 translation,
-    glm::quat rotation,
-    glm::vec3 scale,
-    glm::vec3 globalTranslation,
-    glm::quat globalRotation,
-    glm::vec3 globalScale
-){
+/*
+Take ownership of the given data and link the mesh to a range of shared buffers,
+such as a MeshArena page. Data is streamed into the range by UploadStep.
 
-    // Activate shader and bind vao to shader
-    shader.Activate();
+Parameters
+----------
+vertices : Vertices&
+    Mesh vertices, swapped into the mesh (left empty on return)
+indices : Indices&
+    Mesh indices, swapped into the mesh (left empty on return)
+textures : Textures&
+    Mesh textures
+vbo : GLuint
+    Shared vertex buffer
+ebo : GLuint
+    Shared index buffer
+baseVertex : GLint
+    First vertex of the mesh in vbo
+firstIndex : GLuint
+    First index of the mesh in ebo, indices are relative to baseVertex
+
+Returns
+-------
+None
+*/
+void Mesh::beginSharedUpload(Vertices& vertices, Indices& indices, Textures& textures,
+                             GLuint vbo, GLuint ebo, GLint baseVertex, GLuint firstIndex)
+{
+    Mesh::vertices.swap(vertices);
+    Mesh::indices.swap(indices);
+    Mesh::textures = textures;
+    bufferVertices = Mesh::vertices.size();
+    bufferIndices = Mesh::indices.size();
+
+    vboID = vbo;
+    eboID = ebo;
+
+    // Position, normal, color and texture coordinate layouts, offset by baseVertex at draw time
     vao.Bind();
+    glBindBuffer(GL_ARRAY_BUFFER, vboID);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(9 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboID);
+    vao.Unbind();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    initPickVAO();
+
+    ownsBuffers = false;
+    Mesh::baseVertex = baseVertex;
+    Mesh::firstIndex = firstIndex;
+    vertexOffset = 0;
+    indexOffset = 0;
+    uploaded = Mesh::vertices.empty() && Mesh::indices.empty();
+}
 
+/*
+Name the sampler uniform of each texture, numbering textures of each
+type in order (diffuse0, diffuse1, specular0, ...)
+
+Returns
+-------
+None
+*/
+void Mesh::initSamplerNames()
+{
     // Initialize diffuse texture and specular texture count
     unsigned int numDiffuse = 0;
     unsigned int numSpecular = 0;
 
+    samplerNames.clear();
+    samplerHandles.clear();
+
     // For loop iterates over all textures, and categorizes each texture
     // as diffuse or specular
     for (unsigned int i = 0; i < textures.size(); i++) {
@@ -82,49 +198,206 @@ void Mesh::Draw(
             num = std::to_string(numSpecular++); // Increment happens after line is run
         }
 
+        samplerNames.push_back(type + num);
+    }
+}
+
+/*
+Link the picking vertex array to the mesh's own vertex and index buffers,
+so selection reuses the uploaded geometry instead of copying it.
+Called whenever the mesh buffers are created.
+
+Returns
+-------
+None
+*/
+void Mesh::initPickVAO()
+{
+    // Bind Vertex Array Object (VAO)
+    pickVAO.Bind();
+
+    // Position Coordinate layout (layout 0), read from the full mesh vertex
+    glBindBuffer(GL_ARRAY_BUFFER, vboID);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+    glEnableVertexAttribArray(0);
+
+    // Index Buffer Object (EBO) is recorded in the vao
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboID);
+
+    pickVAO.Unbind();
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/*
+Stream part of a staged mesh upload to the GPU
+
+Parameters
+----------
+maxBytes : size_t
+    Maximum number of bytes to upload during this call, 0 uploads all remaining data
+
+Returns
+-------
+True if the mesh is fully uploaded
+*/
+bool Mesh::UploadStep(size_t maxBytes)
+{
+    if (uploaded) return true;
+
+    size_t vertexBytes = vertices.size() * sizeof(Vertex);
+    size_t indexBytes = indices.size() * sizeof(GLuint);
+    size_t budget = (maxBytes == 0) ? vertexBytes + indexBytes : maxBytes;
+    size_t count;
+
+    if (budget > 0 && vertexOffset < vertexBytes) {
+        count = std::min(budget, vertexBytes - vertexOffset);
+        glBindBuffer(GL_ARRAY_BUFFER, vboID);
+        glBufferSubData(GL_ARRAY_BUFFER, baseVertex * sizeof(Vertex) + vertexOffset, count, (const char *)vertices.data() + vertexOffset);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        vertexOffset += count;
+        budget -= count;
+    }
+
+    if (budget > 0 && indexOffset < indexBytes) {
+        count = std::min(budget, indexBytes - indexOffset);
+        // Element buffer binding is VAO state, bind through the mesh VAO
+        vao.Bind();
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboID);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex * sizeof(GLuint) + indexOffset, count, (const char *)indices.data() + indexOffset);
+        vao.Unbind();
+        indexOffset += count;
+    }
+
+    uploaded = (vertexOffset >= vertexBytes) && (indexOffset >= indexBytes);
+
+    return uploaded;
+}
+
+float Mesh::UploadProgress()
+{
+    size_t total = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(GLuint);
+
+    if (uploaded || total == 0) return 1.0f;
+
+    return static_cast<float>(vertexOffset + indexOffset) / static_cast<float>(total);
+}
+
+size_t Mesh::ReleaseVertexData()
+{
+    if (!uploaded) return 0;
+
+    size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(GLuint);
+
+    // Swap with empty vectors, clear() keeps the capacity
+    Vertices().swap(vertices);
+    Indices().swap(indices);
+
+    return bytes;
+}
+
+/*
+Delete the vertex arrays and buffers of the mesh. Copies of a mesh share
+its buffers, so this is only called by owners of meshes that are never copied.
+
+Returns
+-------
+None
+*/
+void Mesh::Delete()
+{
+    vao.Delete();
+    pickVAO.Delete();
+
+    if (ownsBuffers && vboID != 0) glDeleteBuffers(1, &vboID);
+    if (ownsBuffers && eboID != 0) glDeleteBuffers(1, &eboID);
+
+    vboID = 0;
+    eboID = 0;
+}
+
+void Mesh::SetPrimative(GLenum primative){
+    Mesh::primative = primative;
+}
+
+void Mesh::Draw(
+    Shader& shader, Camera& camera,
+    glm::mat4 matrix,
+    glm::vec3 translation,
+    glm::quat rotation,
+    glm::vec3 scale,
+    glm::vec3 globalTranslation,
+    glm::quat globalRotation,
+    glm::vec3 globalScale
+){
+    BindUniforms(shader, camera, matrix, translation, rotation, scale, globalTranslation, globalRotation, globalScale);
+
+    // Bind vao to shader
+    vao.Bind();
+
+    glDrawElementsBaseVertex(primative, bufferIndices, GL_UNSIGNED_INT, (void *)(firstIndex * sizeof(GLuint)), baseVertex);
+}
+
+/*
+Activate shader and bind the textures and material uniforms of the mesh
+
+Parameters
+----------
+shader : Shader&
+    Shader program to draw with
+
+Returns
+-------
+None
+*/
+void Mesh::BindMaterial(Shader& shader)
+{
+    // Activate shader
+    shader.Activate();
+
+    const std::vector<UniformHandle>& samplers = Samplers(shader);
+
+    for (unsigned int i = 0; i < textures.size(); i++) {
         // Add texture to texUnit based on number given
-        textures[i].texUnit(shader, (type + num).c_str(),   i);
+        shader.setInt(samplers[i], i);
         // Bind the texture to shader
         textures[i].Bind();
     }
-    // Send camera position to shader and perform camera matrix calculations
-    shader.setVec3("camPos", camera.position.x, camera.position.y, camera.position.z);
-    shader.setVec3("material.ambient", glm::vec3(1.0f, 0.5f, 0.31f));
-    shader.setFloat("material.shininess", 32.0f);
-    camera.Matrix(shader, "camMatrix");
-
-    // Create transformation matrices for mesh
-
-    glm::mat4 trans = MAT_IDENTITY;
-    glm::mat4 rot = MAT_IDENTITY;
-    glm::mat4 sca = MAT_IDENTITY;
-
-    // Global transformation matrices
-
-    glm::mat4 gtrans = MAT_IDENTITY;
-    glm::mat4 grot = MAT_IDENTITY;
-    glm::mat4 gsca = MAT_IDENTITY;
-
-    // Apply translation, rotation, and scale to transformation matrices
-    trans = glm::translate(trans, translation);
-    rot = glm::mat4_cast(rotation);
-    sca = glm::scale(sca, scale);
-
-    // Apply translation, rotation, and scale, to global transformation matrices
-    gtrans = glm::translate(gtrans, globalTranslation);
-    grot = glm::mat4_cast(globalRotation);
-    gsca = glm::scale(gsca, globalScale);
-
-    // Send transformation matrices and model matrix to shader
-    shader.setMat4("translation", trans);
-    shader.setMat4("rotation", rot);
-    shader.setMat4("scale", sca);
-    shader.setMat4("model", matrix);
-    
-    // Send global transformation matrices and model matrix to shader
-    shader.setMat4("gTranslation", gtrans);
-    shader.setMat4("gRotation", grot);
-    shader.setMat4("gScale", gsca);
+    shader.setVec3(shader.Common().materialAmbient, glm::vec3(1.0f, 0.5f, 0.31f));
+    shader.setFloat(shader.Common().materialShininess, 32.0f);
+}
+
+const std::vector<UniformHandle>& Mesh::Samplers(const Shader& shader)
+{
+    if (samplerNames.size() != textures.size()) {
+        initSamplerNames();
+    }
+
+    for (auto& entry : samplerHandles) {
+        if (entry.program == shader.ID) return entry.handles;
+    }
+
+    SamplerHandles entry;
+    entry.program = shader.ID;
+    for (auto& name : samplerNames) entry.handles.push_back(shader.Uniform(name));
+
+    samplerHandles.push_back(entry);
+    return samplerHandles.back().handles;
+}
+
+void Mesh::BindUniforms(
+    Shader& shader, Camera& camera,
+    glm::mat4 matrix,
+    glm::vec3 translation,
+    glm::quat rotation,
+    glm::vec3 scale,
+    glm::vec3 globalTranslation,
+    glm::quat globalRotation,
+    glm::vec3 globalScale
+){
+    BindMaterial(shader);
 
-    glDrawElements(primative, indices.size(), GL_UNSIGNED_INT, 0);
+    // Camera matrix and position come from the camera block, only the model matrix changes per draw
+    ObjectBlock object;
+    object.model = ObjectMatrix(matrix, translation, rotation, scale, globalTranslation, globalRotation, globalScale);
+    ObjectBuffer().Update(object);
 }
\ No newline at end of file
@@ -390,6 +390,20 @@ Textures Model::getTextures(){
 	std::string fileStr = std::string(file);
 	std::string fileDirectory = fileStr.substr(0, fileStr.find_last_of('/') + 1);
 
+	// Start decoding every image of the model so they decode in parallel
+	for (unsigned int i = 0; i < JSON["images"].size(); i++)
+	{
+		std::string texPath = JSON["images"][i]["uri"];
+		if (texPath.find("baseColor") != std::string::npos || texPath.find("diffuse") != std::string::npos)
+		{
+			Texture::Prefetch((fileDirectory + texPath).c_str(), GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR);
+		}
+		else if (texPath.find("metallicRoughness") != std::string::npos || texPath.find("specular") != std::string::npos)
+		{
+			Texture::Prefetch((fileDirectory + texPath).c_str(), GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST);
+		}
+	}
+
 	// Iterate over all of the images contained by the JSON.
     // Keep track of the texture unit during iteration.
     // Obtain texture type based on name of the texture.
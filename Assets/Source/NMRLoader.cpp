@@ -0,0 +1,263 @@
+#include "NMRLoader.hpp"
+
+/*
+Start background NMR loader
+
+Parameters
+----------
+workerCount : unsigned int
+    Number of worker threads, by default 0 (chosen from hardware concurrency)
+
+Returns
+-------
+NMRLoader Object
+*/
+NMRLoader::NMRLoader(unsigned int workerCount)
+{
+    // Workers choose terrain for spectra too large for a heightfield texture
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+
+    if (workerCount == 0) {
+        workerCount = std::thread::hardware_concurrency() / 2;
+        if (workerCount < 1) workerCount = 1;
+        if (workerCount > 4) workerCount = 4;
+    }
+
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&NMRLoader::Work, this);
+    }
+}
+
+NMRLoader::~NMRLoader()
+{
+    Shutdown();
+}
+
+/*
+Stop the worker threads and release every unfinished job. Meshes that are
+still uploading own OpenGL buffers, so this must be called before the
+context is destroyed.
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+void NMRLoader::Shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueCond.notify_all();
+
+    for (auto & worker : workers) {
+        worker.join();
+    }
+
+    workers.clear();
+
+    for (auto & [file, job] : jobs) {
+        if (job->mesh != NULL) {
+            delete job->mesh;
+        } else {
+            NMRMesh::FreeData(job->data);
+        }
+        delete job;
+    }
+
+    jobs.clear();
+    pending.clear();
+    finished.clear();
+    uploading.clear();
+}
+
+/*
+Queue an NMR file to be read and meshed in the background
+
+Parameters
+----------
+file : std::string
+    Path to NMR file
+
+Returns
+-------
+None
+*/
+void NMRLoader::Request(std::string file)
+{
+    if (file.empty()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+
+        if (jobs.find(file) != jobs.end()) return;
+
+        Job * job = new Job;
+        job->file = file;
+
+        jobs[file] = job;
+        pending.push_back(job);
+    }
+
+    queueCond.notify_one();
+}
+
+void NMRLoader::RequestMissing(std::map<std::string, NMRMesh *> &nmrMeshes)
+{
+    for (auto const& [file, ptr] : nmrMeshes) {
+        if (ptr == NULL) Request(file);
+    }
+}
+
+/*
+Hand finished files to OpenGL. Must be called from the thread owning the OpenGL context.
+Mesh buffers are streamed at most uploadBudget bytes per call so that
+large spectra do not stall a frame, and the mesh is only inserted into
+nmrMeshes once it is fully uploaded.
+
+Parameters
+----------
+nmrMeshes : std::map<std::string, NMRMesh *>&
+    Map of NMR file paths to NMRMesh pointers, NULL while loading
+
+Returns
+-------
+None
+*/
+void NMRLoader::Poll(std::map<std::string, NMRMesh *> &nmrMeshes)
+{
+    std::deque<Job *> ready;
+    std::vector<Job *> done;
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        ready.swap(finished);
+    }
+
+    // Create meshes for finished data
+    for (auto job : ready) {
+        auto entry = nmrMeshes.find(job->file);
+
+        if (!job->error.empty()) {
+            printf("Failed to load %s: %s\n", job->file.c_str(), job->error.c_str());
+            if (entry != nmrMeshes.end() && entry->second == NULL) nmrMeshes.erase(entry);
+            done.push_back(job);
+            continue;
+        }
+
+        // File was closed while loading
+        if (entry == nmrMeshes.end() || entry->second != NULL) {
+            NMRMesh::FreeData(job->data);
+            done.push_back(job);
+            continue;
+        }
+
+        job->mesh = new NMRMesh(job->data);
+        job->mesh->resetAttributes();
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        job->stage = UPLOADING;
+        uploading.push_back(job);
+    }
+
+    // Stream buffer data for the oldest mesh
+    if (!uploading.empty()) {
+        Job * job = uploading.front();
+        auto entry = nmrMeshes.find(job->file);
+
+        if (entry == nmrMeshes.end() || entry->second != NULL) {
+            delete job->mesh;
+            job->mesh = NULL;
+            uploading.pop_front();
+            done.push_back(job);
+        } else if (job->mesh->UploadStep(uploadBudget)) {
+            entry->second = job->mesh;
+            job->mesh = NULL;
+            uploading.pop_front();
+            done.push_back(job);
+        }
+    }
+
+    if (done.empty()) return;
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    for (auto job : done) {
+        jobs.erase(job->file);
+        delete job;
+    }
+}
+
+bool NMRLoader::IsLoading(std::string file)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return jobs.find(file) != jobs.end();
+}
+
+bool NMRLoader::Busy()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return !jobs.empty();
+}
+
+/*
+Query loading progress of a file
+
+Parameters
+----------
+file : std::string
+    Path to NMR file
+stage : Stage&
+    Output current loading stage
+progress : float&
+    Output progress of the current stage in the range [0, 1]
+
+Returns
+-------
+True if file is currently loading
+*/
+bool NMRLoader::Progress(std::string file, Stage &stage, float &progress)
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+
+    auto entry = jobs.find(file);
+    if (entry == jobs.end()) return false;
+
+    Job * job = entry->second;
+    stage = job->stage;
+
+    // Mesh is only touched by the OpenGL thread, which is the only caller while uploading
+    progress = (stage == UPLOADING) ? job->mesh->UploadProgress() : job->progress.load();
+
+    return true;
+}
+
+void NMRLoader::Work()
+{
+    while (true) {
+        Job * job;
+
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCond.wait(lock, [this] { return stopping || !pending.empty(); });
+
+            if (stopping) return;
+
+            job = pending.front();
+            pending.pop_front();
+            job->stage = READING;
+        }
+
+        try {
+            NMRMesh::LoadData(job->file, job->data, true, &job->progress, !heightfield, useCache, maxTextureSize);
+        } catch (const std::exception & e) {
+            job->error = e.what();
+        }
+
+        std::lock_guard<std::mutex> lock(queueMutex);
+        finished.push_back(job);
+    }
+}
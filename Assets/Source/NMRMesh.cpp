@@ -1,7 +1,15 @@
 #include "NMRMesh.hpp"
+#include "NMRLoader.hpp"
+#include "FBO.hpp"
+#include "PlaneReader.hpp"
+#include "SpectrumCache.hpp"
+#include <algorithm>
 
 unsigned int NMRMesh::nextID = 1;
 GLuint NMRMesh::selID = 0;
+Cubemap * NMRMesh::boundingBox = NULL;
+unsigned int NMRMesh::meshCount = 0;
+std::mutex NMRMesh::rdMutex;
 ImGuizmo::OPERATION NMRMesh::mCurrentGizmoOperation = ImGuizmo::TRANSLATE;
 ImGuizmo::MODE NMRMesh::mCurrentGizmoMode = ImGuizmo::WORLD;
 
@@ -9,38 +17,316 @@ NMRMesh::NMRMesh(){
     NMRMesh::Constructor(nextID++);
 }
 
-// NMRMesh::~NMRMesh()
-// {
-//     delete boundingBox;
-// }
+NMRMesh::~NMRMesh()
+{
+    MemoryBudget::Unregister(this);
+
+    if (hfTexture != 0) glDeleteTextures(1, &hfTexture);
+    hfVAO.Delete();
+
+    // Meshes are owned through pointers and never copied
+    MeshArena::Shared().Free(arenaRange);
+    Mesh::Delete();
+
+    CancelTerrain();
+    delete terrain;
+    terrain = NULL;
+
+    delete cache;
+    cache = NULL;
+
+    // Joins the prefetch thread, which takes rdMutex
+    delete planes;
+    planes = NULL;
+
+    // Shared textures are deleted with their last user
+    for (Texture& texture : textures) texture.Delete();
+
+    // The bounding box is shared by every mesh and deleted with the last one
+    if (--meshCount == 0 && boundingBox != NULL) {
+        boundingBox->Delete();
+        delete boundingBox;
+        boundingBox = NULL;
+    }
+
+    std::lock_guard<std::mutex> lock(rdMutex);
+
+    if (mat != NULL) freeNMRMapped(mat, totalSize, matMap, matMapSize);
+    freeMesh(vertexList, vertexCount, indexList, indexCount, normXYZ, normCount);
 
-NMRMesh::NMRMesh(std::string file, GLenum primative){
+    mat = NULL;
+    matMap = NULL;
+    vertexList = NULL;
+    indexList = NULL;
+    normXYZ = NULL;
+}
+
+NMRMesh::NMRMesh(std::string file, GLenum primative, bool mapFile){
     NMRMesh::primative = primative;
 
+    NMRData data;
+
+    LoadData(file, data, mapFile);
+
+    FromData(data);
+
+    UploadStep();
+
+    NMRMesh::Constructor(nextID++);
+}
+
+NMRMesh::NMRMesh(NMRData &data, GLenum primative)
+{
+    NMRMesh::primative = primative;
+
+    FromData(data);
+
+    NMRMesh::Constructor(nextID++);
+}
+
+/*
+Read an NMR file and build the CPU-side mesh for it.
+Performs no OpenGL calls, so it is safe to run on a worker thread.
+
+Parameters
+----------
+file : std::string
+    Path to NMR file
+data : NMRData&
+    Output NMR spectrum, vertex and index data
+mapFile : bool
+    Memory map the spectrum instead of copying it into a heap buffer
+progress : std::atomic<float> *
+    Optional progress output in the range [0, 1]
+buildMesh : bool
+    Build vertex, index and normal data, skipped for spectra displayed as heightfields
+useCache : bool
+    Open 2D spectra from their cache file without reading them, the cache is
+    written on the first open. Cached spectra are displayed as terrain.
+maxTextureSize : int
+    Largest heightfield texture of the OpenGL context, 2D spectra loaded without
+    a mesh that exceed it are given a terrain. By default 0 (not checked)
+
+Returns
+-------
+None
+*/
+void NMRMesh::LoadData(std::string file, NMRData &data, bool mapFile, std::atomic<float> * progress, bool buildMesh, bool useCache, int maxTextureSize)
+{
     int error;
-    char * inName = &file[0];    
+    char * inName = &file[0];
     char errorMsg[64];
 
-    error = readNMR( inName, NMRMesh::fdata, &mat, NMRMesh::sizeList, NMRMesh::qSizeList, &totalSize, &qSize, &dimCount);
+    data.file = file;
 
-    if (error != 0) {
-        sprintf(errorMsg, "Error whilst reading NMR file! Error code %d", error);
-        throw std::runtime_error(errorMsg);
+    if (progress) *progress = 0.0f;
+
+    // Header, range and terrain come from the cache, the spectrum is read when another render mode needs it
+    if (useCache && (data.cache = SpectrumCache::Open(file)) != NULL) {
+        data.cache->Fill(data);
+        data.terrain = new Terrain(*data.cache);
+        if (progress) *progress = 1.0f;
+        return;
     }
 
-    minVal = vecMin64(mat, totalSize);
-    maxVal = vecMax64(mat, totalSize);
+    // 3D/4D data and file series are read one plane at a time
+    PlaneReader * planes = new PlaneReader();
 
-    error = mat2mesh(&vertexList, &vertexCount, &indexList, &indexCount, mat, qSize*sizeList[XLOC], sizeList[YLOC], minVal, maxVal, (float)0.01);
+    if (planes->Open(file)) {
+        data.planes = planes;
+
+        memcpy(data.fdata, planes->fdata, sizeof(float)*FDATASIZE);
+        memcpy(data.sizeList, planes->sizeList, sizeof(int)*MAXDIM);
+        memcpy(data.qSizeList, planes->qSizeList, sizeof(int)*MAXDIM);
+
+        data.dimCount = planes->dimCount;
+        data.qSize = planes->qSize;
+        data.totalSize = planes->planePts;
+        data.mat = planes->Take(0);
+
+        if (data.mat == NULL) {
+            FreeData(data);
+            throw std::runtime_error("Error whilst reading NMR plane!");
+        }
+
+        planes->Prefetch(0);
+
+        if (progress) *progress = 0.2f;
+
+        std::lock_guard<std::mutex> lock(rdMutex);
+
+        data.minVal = vecMin64(data.mat, data.totalSize);
+        data.maxVal = vecMax64(data.mat, data.totalSize);
+    } else {
+        delete planes;
+
+        // The NMR library keeps global state (byte swap flag, memory counters)
+        std::lock_guard<std::mutex> lock(rdMutex);
+
+        if (mapFile) {
+            error = readNMRMapped( inName, data.fdata, &data.mat, data.sizeList, data.qSizeList, &data.totalSize, &data.qSize, &data.dimCount, &data.matMap, &data.matMapSize);
+        } else {
+            error = readNMR( inName, data.fdata, &data.mat, data.sizeList, data.qSizeList, &data.totalSize, &data.qSize, &data.dimCount);
+        }
+
+        if (error != 0) {
+            sprintf(errorMsg, "Error whilst reading NMR file! Error code %d", error);
+            throw std::runtime_error(errorMsg);
+        }
+
+        if (progress) *progress = 0.2f;
+
+        data.minVal = vecMin64(data.mat, data.totalSize);
+        data.maxVal = vecMax64(data.mat, data.totalSize);
+    }
+
+    if (progress) *progress = 0.3f;
+
+    // Opened as terrain from the new cache, as it will be on every later open
+    if (useCache && data.planes == NULL && SpectrumCache::Create(file, data)) {
+        data.cache = SpectrumCache::Open(file);
+    }
+
+    int xSize = data.qSize*data.sizeList[XLOC];
+    int ySize = data.sizeList[YLOC];
+
+    // Terrain levels and the mesh of spectra that cannot be heightfields
+    // are built here, so the OpenGL thread only uploads
+    try {
+        if (data.cache != NULL) {
+            data.terrain = new Terrain(*data.cache);
+        } else if (buildMesh || data.dimCount < 2 || xSize < 2 || ySize < 2) {
+            BuildMeshData(data);
+        } else if (maxTextureSize > 0 && (xSize > maxTextureSize || ySize > maxTextureSize)) {
+            data.terrain = new Terrain(data.mat, xSize, ySize, data.minVal, data.maxVal);
+        }
+    } catch (const std::exception &) {
+        FreeData(data);
+        throw;
+    }
+
+    if (progress) *progress = 1.0f;
+}
+
+/*
+Build vertex, index and normal data for the spectrum held by data
+
+Parameters
+----------
+data : NMRData&
+    NMR spectrum, on return holds mesh vertices and indices
+
+Returns
+-------
+None
+*/
+void NMRMesh::BuildMeshData(NMRData &data)
+{
+    int error;
+    char errorMsg[64];
+
+    {
+        std::lock_guard<std::mutex> lock(rdMutex);
+
+        // Vertices and normals in one threaded pass
+        error = mat2meshNormals(&data.vertexList, &data.vertexCount, &data.indexList, &data.indexCount,
+                                &data.normXYZ, &data.normCount, data.mat, data.qSize*data.sizeList[XLOC], data.sizeList[YLOC],
+                                data.minVal, data.maxVal, (float)0.01, 0);
+    }
 
-    error = findGridNormals(&normXYZ, &normCount, mat, qSize*sizeList[XLOC], sizeList[YLOC], minVal, maxVal);
-    
     if (error != 0) {
         sprintf(errorMsg, "Error whilst converting to mesh! Error code %d", error);
         throw std::runtime_error(errorMsg);
     }
 
-    NMRToVertex();
+    NMRToVertex(data);
+
+    data.meshBuilt = true;
+}
+
+/*
+Release NMR library buffers owned by data
+
+Parameters
+----------
+data : NMRData&
+    Data returned by LoadData that was not passed to a NMRMesh
+
+Returns
+-------
+None
+*/
+void NMRMesh::FreeData(NMRData &data)
+{
+    // Reads mat or the cache mapping
+    delete data.terrain;
+    data.terrain = NULL;
+
+    // Joins the prefetch thread, which takes rdMutex
+    delete data.planes;
+    data.planes = NULL;
+
+    delete data.cache;
+    data.cache = NULL;
+
+    std::lock_guard<std::mutex> lock(rdMutex);
+
+    if (data.mat != NULL) freeNMRMapped(data.mat, data.totalSize, data.matMap, data.matMapSize);
+    freeMesh(data.vertexList, data.vertexCount, data.indexList, data.indexCount, data.normXYZ, data.normCount);
+
+    data.mat = NULL;
+    data.matMap = NULL;
+    data.vertexList = NULL;
+    data.indexList = NULL;
+    data.normXYZ = NULL;
+
+    data.vertices.clear();
+    data.indices.clear();
+}
+
+void NMRMesh::FromData(NMRData &data)
+{
+    file = data.file;
+    memcpy(fdata, data.fdata, sizeof(float)*FDATASIZE);
+    memcpy(sizeList, data.sizeList, sizeof(int)*MAXDIM);
+    memcpy(qSizeList, data.qSizeList, sizeof(int)*MAXDIM);
+
+    dimCount    = data.dimCount;
+    totalSize   = data.totalSize;
+    qSize       = data.qSize;
+    vertexCount = data.vertexCount;
+    indexCount  = data.indexCount;
+    normCount   = data.normCount;
+    minVal      = data.minVal;
+    maxVal      = data.maxVal;
+    meshBuilt   = data.meshBuilt;
+
+    hfRange[0] = minVal;
+    hfRange[1] = maxVal;
+
+    // Take ownership of NMR library buffers
+    mat        = data.mat;
+    matMap     = data.matMap;
+    matMapSize = data.matMapSize;
+    vertexList = data.vertexList;
+    indexList  = data.indexList;
+    normXYZ    = data.normXYZ;
+    planes     = data.planes;
+    cache      = data.cache;
+    terrain    = data.terrain;
+
+    data.planes = NULL;
+    data.cache = NULL;
+    data.terrain = NULL;
+    data.mat = NULL;
+    data.matMap = NULL;
+    data.vertexList = NULL;
+    data.indexList = NULL;
+    data.normXYZ = NULL;
+
+    // Decode both maps at the same time, skipped once the shared textures are loaded
+    Texture::Prefetch("Assets/Textures/Alb/3f4647ff.png", GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR);
+    Texture::Prefetch("Assets/Textures/Spec/FFFFFFFF.png", GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST);
 
     NMRMesh::textures.push_back(
         Texture("Assets/Textures/Alb/3f4647ff.png", "diffuse", 0, GL_NEAREST_MIPMAP_LINEAR, GL_LINEAR) // Load diffusion texture
@@ -50,10 +336,415 @@ NMRMesh::NMRMesh(std::string file, GLenum primative){
         Texture("Assets/Textures/Spec/FFFFFFFF.png", "specular", 1, GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST) // Load Specular Map for Texture
     );
 
-    // Consider emptying mat here since data is now in vertices
-    initMesh(NMRMesh::vertices, NMRMesh::indices, NMRMesh::textures);
+    // Allocate buffers, vertex data is streamed by UploadStep
+    beginMeshUpload(data.vertices, data.indices);
+
+    // Spectra loaded without a mesh are displayed as heightfields, or as terrain
+    // when too large for a single texture or opened from a cache. The fallbacks
+    // below only run for data loaded without a maximum texture size
+    if (terrain != NULL) {
+        terrainLOD = true;
+    } else if (!meshBuilt) {
+        heightfield = InitHeightfield();
+        if (!heightfield) terrainLOD = InitTerrain();
+        if (!heightfield && !terrainLOD) BuildMesh();
+    }
+}
 
-    NMRMesh::Constructor(nextID++);
+/*
+Upload the spectrum as a single channel texture holding one texel per grid point.
+Heightfield shaders rebuild the grid from gl_VertexID, so only 4 bytes (2 bytes quantized)
+per point are stored on the GPU instead of a vertex and six indices.
+
+Returns
+-------
+True if the texture was created, false if the spectrum cannot be drawn as a heightfield
+*/
+bool NMRMesh::InitHeightfield()
+{
+    int xSize = qSize*sizeList[XLOC];
+    int ySize = sizeList[YLOC];
+    GLint maxSize;
+
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+
+    if (!Reload() || dimCount < 2 || xSize < 2 || ySize < 2) return false;
+
+    if (xSize > maxSize || ySize > maxSize) {
+        printf("Spectrum of %d x %d points exceeds maximum texture size %d, using mesh\n", xSize, ySize, maxSize);
+        return false;
+    }
+
+    if (hfTexture == 0) glGenTextures(1, &hfTexture);
+
+    glActiveTexture(GL_TEXTURE0 + HEIGHTFIELD_UNIT);
+    glBindTexture(GL_TEXTURE_2D, hfTexture);
+
+    // Points are read with texelFetch, no filtering or mipmaps
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (hfQuantize) {
+        // Normalize intensities to 0 ... 65535 across the data range
+        std::vector<GLushort> quantized((size_t)xSize * ySize);
+        float range = maxVal - minVal;
+        float factor = (range > 0.0f) ? 65535.0f / range : 0.0f;
+
+        for (size_t i = 0; i < quantized.size(); i++) {
+            quantized[i] = (GLushort)((mat[i] - minVal) * factor + 0.5f);
+        }
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16, xSize, ySize, 0, GL_RED, GL_UNSIGNED_SHORT, quantized.data());
+
+        hfDecode[0] = minVal;
+        hfDecode[1] = range;
+    } else {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, xSize, ySize, 0, GL_RED, GL_FLOAT, mat);
+
+        hfDecode[0] = 0.0f;
+        hfDecode[1] = 1.0f;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+
+    hfQuantized = hfQuantize;
+
+    return true;
+}
+
+/*
+Create the level of detail terrain of a 2D spectrum. Downsampled levels are
+built on a background thread and taken by TerrainReady, or mapped from the
+cache file. Tiles are meshed on demand while drawing.
+
+Returns
+-------
+True if the terrain exists or is being built, false if the spectrum is not 2D
+*/
+bool NMRMesh::InitTerrain()
+{
+    int xSize = qSize*sizeList[XLOC];
+    int ySize = sizeList[YLOC];
+
+    if (terrain != NULL || terrainTask.valid()) return true;
+
+    if (cache != NULL) {
+        terrain = new Terrain(*cache);
+        return true;
+    }
+
+    if (!Reload() || dimCount < 2 || xSize < 2 || ySize < 2) return false;
+
+    // mat is kept until the task is taken or cancelled
+    float * spectrum = mat;
+    float low = minVal;
+    float high = maxVal;
+
+    terrainTask = std::async(std::launch::async, [=]() {
+        return new Terrain(spectrum, xSize, ySize, low, high);
+    });
+
+    return true;
+}
+
+/*
+Take the terrain started by InitTerrain if its levels have been built
+
+Returns
+-------
+True if the terrain can be drawn
+*/
+bool NMRMesh::TerrainReady()
+{
+    if (terrainTask.valid() && terrainTask.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        try {
+            terrain = terrainTask.get();
+        } catch (const std::exception & e) {
+            printf("%s\n", e.what());
+            terrainLOD = false;
+        }
+    }
+
+    return terrain != NULL;
+}
+
+/*
+Wait for a terrain still being built and delete it, called before mat is freed
+
+Returns
+-------
+None
+*/
+void NMRMesh::CancelTerrain()
+{
+    if (!terrainTask.valid()) return;
+
+    try {
+        delete terrainTask.get();
+    } catch (const std::exception &) {}
+}
+
+/*
+Build the vertex mesh of a spectrum that was loaded for heightfield display only.
+Runs on the OpenGL thread and uploads the mesh immediately.
+
+Returns
+-------
+None
+*/
+void NMRMesh::BuildMesh()
+{
+    if (meshBuilt || !Reload()) return;
+
+    NMRData data;
+
+    memcpy(data.sizeList, sizeList, sizeof(int)*MAXDIM);
+    data.dimCount = dimCount;
+    data.qSize = qSize;
+    data.minVal = minVal;
+    data.maxVal = maxVal;
+    data.mat = mat;
+
+    try {
+        BuildMeshData(data);
+    } catch (const std::exception & e) {
+        printf("%s\n", e.what());
+        return;
+    }
+
+    vertexCount = data.vertexCount;
+    indexCount  = data.indexCount;
+    normCount   = data.normCount;
+    vertexList  = data.vertexList;
+    indexList   = data.indexList;
+    normXYZ     = data.normXYZ;
+    meshBuilt   = true;
+
+    // Replace the empty buffers allocated when the spectrum was loaded
+    if (arenaRange.page >= 0) {
+        MeshArena::Shared().Free(arenaRange);
+    } else {
+        glDeleteBuffers(1, &vboID);
+        glDeleteBuffers(1, &eboID);
+    }
+
+    beginMeshUpload(data.vertices, data.indices);
+    UploadStep();
+}
+
+/*
+Replace the displayed plane of 3D/4D data. Planes read ahead by the
+plane reader are used without reading, the neighbours of the new plane
+are then read ahead on its thread.
+
+Parameters
+----------
+z : int
+    Z plane, from 0
+a : int
+    A plane, from 0
+
+Returns
+-------
+success : bool
+    False for 2D data or if the plane could not be read
+*/
+bool NMRMesh::SetPlane(int z, int a)
+{
+    if (planes == NULL) return false;
+
+    z = std::clamp(z, 0, planes->zSize - 1);
+    a = std::clamp(a, 0, planes->aSize - 1);
+
+    if (z == plane[0] && a == plane[1]) return true;
+
+    float * data = planes->Take(z + a * planes->zSize);
+    if (data == NULL) return false;
+
+    // Terrain reads mat, the other render modes are rebuilt when selected
+    CancelTerrain();
+    delete terrain;
+    terrain = NULL;
+
+    if (hfTexture != 0 && !heightfield) {
+        glDeleteTextures(1, &hfTexture);
+        hfTexture = 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(rdMutex);
+
+        if (mat != NULL) freeNMRMapped(mat, totalSize, matMap, matMapSize);
+        freeMesh(vertexList, vertexCount, indexList, indexCount, normXYZ, normCount);
+
+        mat = data;
+        matMap = NULL;
+        matMapSize = 0;
+        vertexList = NULL;
+        indexList = NULL;
+        normXYZ = NULL;
+
+        minVal = vecMin64(mat, totalSize);
+        maxVal = vecMax64(mat, totalSize);
+    }
+
+    plane[0] = z;
+    plane[1] = a;
+    planes->Prefetch(z + a * planes->zSize);
+
+    hfRange[0] = minVal;
+    hfRange[1] = maxVal;
+    meshBuilt = false;
+
+    if (heightfield) heightfield = InitHeightfield();
+    else if (terrainLOD) terrainLOD = InitTerrain();
+    if (!heightfield && !terrainLOD) BuildMesh();
+
+    return true;
+}
+
+size_t NMRMesh::MemoryUsage()
+{
+    size_t bytes = vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(GLuint);
+
+    // Mapped files are counted as they are paged in on first use
+    if (mat != NULL) bytes += (matMap != NULL) ? (size_t)matMapSize : sizeof(float) * (size_t)totalSize;
+
+    if (vertexList != NULL) bytes += sizeof(float) * 3 * (size_t)vertexCount;
+    if (indexList != NULL) bytes += sizeof(int) * (size_t)indexCount;
+    if (normXYZ != NULL) bytes += sizeof(float) * (size_t)normCount;
+
+    if (planes != NULL) bytes += planes->CacheBytes();
+
+    return bytes;
+}
+
+size_t NMRMesh::ReleaseMemory()
+{
+    // Still streaming, or mat is still read by a terrain being built
+    if (!uploaded || terrainTask.valid()) return 0;
+
+    size_t before = MemoryUsage();
+    bool keepMat = terrainLOD && terrain != NULL && cache == NULL;
+
+    ReleaseVertexData();
+
+    if (!keepMat) {
+        delete terrain;
+        terrain = NULL;
+    }
+
+    bool libraryData = vertexList != NULL || indexList != NULL || normXYZ != NULL || (!keepMat && mat != NULL);
+
+    // Loader workers hold rdMutex for whole file reads, rather than stall the
+    // frame the library data is left for a later call if the mutex is busy
+    std::unique_lock<std::mutex> lock(rdMutex, std::defer_lock);
+
+    if (libraryData && lock.try_lock()) {
+        // Library mesh buffers are only read while building vertices
+        freeMesh(vertexList, vertexCount, indexList, indexCount, normXYZ, normCount);
+
+        vertexList = NULL;
+        indexList = NULL;
+        normXYZ = NULL;
+
+        if (!keepMat && mat != NULL) {
+            freeNMRMapped(mat, totalSize, matMap, matMapSize);
+
+            mat = NULL;
+            matMap = NULL;
+            matMapSize = 0;
+        }
+    }
+
+    return before - std::min(before, MemoryUsage());
+}
+
+/*
+Read the spectrum released by ReleaseMemory again, from the plane reader
+for 3D/4D data or by mapping the file for 2D data
+
+Parameters
+----------
+None
+
+Returns
+-------
+success : bool
+    True if mat holds the spectrum
+*/
+bool NMRMesh::Reload()
+{
+    if (mat != NULL) return true;
+
+    if (planes != NULL) {
+        mat = planes->Take(plane[0] + plane[1] * planes->zSize);
+        return mat != NULL;
+    }
+
+    if (file.empty()) return false;
+
+    float header[FDATASIZE];
+    int sizes[MAXDIM], qSizes[MAXDIM], dims, quad;
+    NMR_INT total;
+    int error;
+
+    std::lock_guard<std::mutex> lock(rdMutex);
+
+    error = readNMRMapped(&file[0], header, &mat, sizes, qSizes, &total, &quad, &dims, &matMap, &matMapSize);
+
+    // File changed since it was loaded
+    if (error == 0 && total != totalSize) {
+        freeNMRMapped(mat, total, matMap, matMapSize);
+        error = -1;
+    }
+
+    if (error != 0) {
+        printf("ERROR::NMRMESH: Could not read %s again, error code %d\n", file.c_str(), error);
+        mat = NULL;
+        matMap = NULL;
+        matMapSize = 0;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+Store mesh data in the shared mesh arena so the mesh can be drawn together with
+other spectra by a RenderQueue. Falls back to buffers of its own if the arena
+cannot hold the mesh.
+
+Parameters
+----------
+vertices : Vertices&
+    Mesh vertices, swapped into the mesh
+indices : Indices&
+    Mesh indices, swapped into the mesh
+
+Returns
+-------
+None
+*/
+void NMRMesh::beginMeshUpload(Vertices& vertices, Indices& indices)
+{
+    MeshArena& arena = MeshArena::Shared();
+
+    if (arena.Allocate(vertices.size(), indices.size(), arenaRange)) {
+        beginSharedUpload(vertices, indices, NMRMesh::textures,
+                          arena.VertexBuffer(arenaRange.page), arena.IndexBuffer(arenaRange.page),
+                          arenaRange.baseVertex, arenaRange.firstIndex);
+    } else {
+        beginUpload(vertices, indices, NMRMesh::textures);
+    }
 }
 
 void NMRMesh::Constructor(unsigned int ID)
@@ -63,53 +754,55 @@ void NMRMesh::Constructor(unsigned int ID)
 
     sprintf(IDTag, "##%d", NMRMesh::ID);
 
-    // ***********************
-    // * Create Bounding Box *
-    // ***********************
-
-    boundingBox = new Cubemap("Assets/Textures/Skybox/SolidColor/", PNG);
-
-    boundingBox->BindTextures();
+    // Bounding box is created when first drawn, no OpenGL calls while loading
+    meshCount++;
 
+    MemoryBudget::Register(this);
 }
 
-void NMRMesh::NMRToVertex()
+void NMRMesh::NMRToVertex(NMRData &data)
 {
-    switch (NMRMesh::dimCount)
+    switch (data.dimCount)
     {
     case 2:
     default:
-        NMR2DToVertex();
+        NMR2DToVertex(data);
         break;
     }
 };
 
-void NMRMesh::NMR2DToVertex(){
+void NMRMesh::NMR2DToVertex(NMRData &data){
     Vertex newVert;
-    for (int i = 0; i < indexCount; i++)
+
+    // One vertex per grid point, shared by all triangles that touch it
+    data.vertices.reserve(data.vertexCount);
+
+    for (int i = 0; i < data.vertexCount; i++)
     {
         newVert.position = 
-            glm::vec3(vertexList[indexList[i]],
-            vertexList[indexList[i] + 1],
-            vertexList[indexList[i] + 2]);
+            glm::vec3(data.vertexList[3*i],
+            data.vertexList[3*i + 1],
+            data.vertexList[3*i + 2]);
 
         newVert.normal =
-            glm::vec3(normXYZ[indexList[i]],
-                normXYZ[indexList[i] + 1],
-                normXYZ[indexList[i] + 2]);
+            glm::vec3(data.normXYZ[3*i],
+                data.normXYZ[3*i + 1],
+                data.normXYZ[3*i + 2]);
 
         newVert.color = 
             glm::vec3(1.0f, 1.0f, 1.0f);
 
         newVert.texUV = glm::vec2(0.0, 0.0);
 
-        NMRMesh::vertices.push_back(newVert);
+        data.vertices.push_back(newVert);
+    }
 
-        if (i >= 0) {
-            NMRMesh::indices.push_back((GLuint) i);
-        } else {
-            NMRMesh::indices.push_back((GLuint) -1 * i);
-        }
+    // indexList holds offsets of x,y,z triplets, convert to vertex indices
+    data.indices.reserve(data.indexCount);
+
+    for (int i = 0; i < data.indexCount; i++)
+    {
+        data.indices.push_back((GLuint) (data.indexList[i] / 3));
     }
     
 }
@@ -161,28 +854,181 @@ void NMRMesh::Draw(
     Mesh::Draw(shader, camera, matrix, translation, rotation, scale);
 }
 
+/*
+Draw NMRMesh from its heightfield texture. X and Z of each vertex are derived from
+gl_VertexID and Y from the texture, so no vertex buffer is bound.
+
+Parameters
+----------
+shader : Shader&
+    Heightfield variant of a shader (see initializeHeightfieldShaders)
+camera : Camera&
+    Camera to draw to
+matrix : glm::mat4
+    Model matrix
+translation : glm::vec3
+    Translation of the mesh
+rotation : glm::quat
+    Rotation of the mesh
+scale : glm::vec3
+    Scale of the mesh
+
+Returns
+-------
+None
+*/
+void NMRMesh::DrawHeightfield(
+    Shader& shader, Camera& camera, 
+    glm::mat4 matrix, glm::vec3 translation,
+    glm::quat rotation, glm::vec3 scale
+    ){
+    int xSize = qSize*sizeList[XLOC];
+    int ySize = sizeList[YLOC];
+    bool points = (primative == GL_POINTS);
+
+    if (hfTexture == 0) return;
+
+    BindUniforms(shader, camera, matrix, translation, rotation, scale);
+    BindHeightfield(shader, points);
+
+    hfVAO.Bind();
+
+    // One vertex per point, or two triangles per grid cell
+    glDrawArrays(primative, 0, points ? xSize * ySize : (xSize - 1) * (ySize - 1) * 6);
+
+    hfVAO.Unbind();
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void NMRMesh::BindHeightfield(Shader& shader, bool points)
+{
+    glActiveTexture(GL_TEXTURE0 + HEIGHTFIELD_UNIT);
+    glBindTexture(GL_TEXTURE_2D, hfTexture);
+
+    const CommonUniforms& common = shader.Common();
+
+    shader.setInt(common.heightMap, HEIGHTFIELD_UNIT);
+    shader.setIVec2(common.hfSize, glm::ivec2(qSize*sizeList[XLOC], sizeList[YLOC]));
+    shader.setVec2(common.hfDecode, glm::vec2(hfDecode[0], hfDecode[1]));
+    shader.setVec2(common.hfRange, glm::vec2(hfRange[0], hfRange[1]));
+    shader.setBool(common.hfPoints, points);
+}
+
+/*
+Draw the normal of every grid point once as a line. Each line is an instance
+of a two vertex draw, the shader reads the point of the instance from the
+vertex buffer, the terrain tiles, or the heightfield texture.
+
+Parameters
+----------
+shaders : Shaders&
+    Shader map holding "normals" and "normals" HEIGHTFIELD_SUFFIX
+camera : Camera&
+    Camera to draw to
+matrix : glm::mat4
+    Global transform of the mesh
+translation : glm::vec3
+    Mesh translation
+rotation : glm::quat
+    Mesh rotation
+scale : glm::vec3
+    Mesh scale
+
+Returns
+-------
+None
+*/
+void NMRMesh::DrawNormals(
+    Shaders& shaders, Camera& camera, 
+    glm::mat4 matrix, glm::vec3 translation,
+    glm::quat rotation, glm::vec3 scale
+    ){
+    // Same draw mode choice as Display
+    if (terrainLOD && terrain != NULL) {
+        BindUniforms(shaders["normals"], camera, matrix, translation, rotation, scale);
+        terrain->DrawNormals();
+    }
+    else if (heightfield) {
+        if (hfTexture == 0) return;
+
+        Shader& shader = shaders["normals" HEIGHTFIELD_SUFFIX];
+        BindUniforms(shader, camera, matrix, translation, rotation, scale);
+        BindHeightfield(shader, true);
+
+        hfVAO.Bind();
+        glDrawArraysInstanced(GL_LINES, 0, 2, qSize*sizeList[XLOC] * sizeList[YLOC]);
+        hfVAO.Unbind();
+        glActiveTexture(GL_TEXTURE0);
+    }
+    else {
+        if (vboID == 0 || !uploaded) return;
+
+        BindUniforms(shaders["normals"], camera, matrix, translation, rotation, scale);
+
+        // Base instance skips to the mesh in shared arena buffers
+        hfVAO.Bind();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, NORMALS_BINDING, vboID);
+        glDrawArraysInstancedBaseInstance(GL_LINES, 0, 2, (GLsizei)bufferVertices, (GLuint)baseVertex);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, NORMALS_BINDING, 0);
+        hfVAO.Unbind();
+    }
+}
+
+/*
+Draw the terrain tiles chosen by the last Terrain::Select
+
+Parameters
+----------
+shader : Shader&
+    Shader to draw tiles with
+camera : Camera&
+    Camera to draw to
+matrix : glm::mat4
+    Model matrix
+translation : glm::vec3
+    Translation of the mesh
+rotation : glm::quat
+    Rotation of the mesh
+scale : glm::vec3
+    Scale of the mesh
+
+Returns
+-------
+None
+*/
+void NMRMesh::DrawTerrain(
+    Shader& shader, Camera& camera, 
+    glm::mat4 matrix, glm::vec3 translation,
+    glm::quat rotation, glm::vec3 scale
+    ){
+    if (terrain == NULL) return;
+
+    BindUniforms(shader, camera, matrix, translation, rotation, scale);
+
+    terrain->Draw(primative);
+}
+
 void NMRMesh::updateUniforms(Shaders & shaders)
 {
-    // **************************
-    // * Normal Vector Settings *
-    // **************************
+    // Regular and heightfield variants share the same settings
+    for (std::string suffix : {"", HEIGHTFIELD_SUFFIX}) {
+
+        if (shaders.find("default" + suffix) == shaders.end()) continue;
 
-    shaders["normals"].Activate();
-    shaders["normals"].setFloat("hairLength", normalLength);
+        // **************************
+        // * Normal Vector Settings *
+        // **************************
 
-    // ******************
-    // * Point Settings *
-    // ******************
+        shaders["normals" + suffix].Activate();
+        shaders["normals" + suffix].setFloat("hairLength", normalLength);
 
-    shaders["points"].Activate();
-    shaders["points"].setFloat("pointSize", pointSize);
+        // ******************
+        // * Point Settings *
+        // ******************
 
-    // ********************
-    // * Stencil Settings *
-    // ********************
-    shaders["stencil"].Activate(); // Activate stencil outline program
-    shaders["stencil"].setFloat("outlining", outline);
-    shaders["stencil"].setVec4("color", stencil_color[0], stencil_color[1], stencil_color[2], stencil_color[3]);
+        shaders["points" + suffix].Activate();
+        shaders["points" + suffix].setFloat("pointSize", pointSize);
+    }
 
 }
 
@@ -194,7 +1040,7 @@ void NMRMesh::resetAttributes()
     eulerRotation = glm::eulerAngles(rot);
 }
 
-void NMRMesh::Display(WindowData &win, Camera & camera, Shaders &shaders)
+void NMRMesh::Display(WindowData &win, Camera & camera, Shaders &shaders, RenderQueue * queue)
 {
 
     // ***********************
@@ -205,9 +1051,9 @@ void NMRMesh::Display(WindowData &win, Camera & camera, Shaders &shaders)
 
     glDisable(GL_CULL_FACE);
 
-    // Enable writing to entire stencil buffer
+    // Enable writing to entire stencil buffer, the selected spectrum is marked for the outline pass
     //            function | ref | bitwise AND mask
-    glStencilFunc(GL_ALWAYS,  1,    0xFF);
+    glStencilFunc(GL_ALWAYS, (selID == ID) ? OUTLINE_STENCIL : 1, 0xFF);
     glStencilMask(0xFF);
 
     // **************
@@ -228,34 +1074,60 @@ void NMRMesh::Display(WindowData &win, Camera & camera, Shaders &shaders)
     // * Mesh Drawing *
     // ****************
 
+    if (drawShape) MemoryBudget::Touch(this);
+
     // First Draw Pass
-    if (drawShape){
+    if (drawShape && terrainLOD && InitTerrain() && !TerrainReady()){
+        // Nothing to draw until the terrain levels are built
+        MarkDirty(1);
+    }
+    else if (drawShape && terrainLOD && terrain != NULL){
+        // Choose tiles once, every pass of this frame draws the same tiles
+        terrain->Select(camera, drawMat * glm::translate(MAT_IDENTITY, pos) * glm::mat4_cast(rot) * glm::scale(MAT_IDENTITY, nmrSize * scale));
+        // Keep drawing until every visible tile is at its final level
+        if (terrain->refining) MarkDirty(1);
+
+        if (drawPoints){
+            SetPrimative(GL_POINTS);
+            DrawTerrain(shaders["points"], camera, drawMat, pos, rot, nmrSize * scale);
+        } else {
+            SetPrimative(GL_TRIANGLES);
+            DrawTerrain(shaders["default"], camera, drawMat, pos, rot, nmrSize * scale);
+        }
+    }
+    else if (drawShape && heightfield){
+        SetPrimative(drawPoints ? GL_POINTS : GL_TRIANGLES);
+        DrawHeightfield(shaders[drawPoints ? "points" HEIGHTFIELD_SUFFIX : "default" HEIGHTFIELD_SUFFIX], camera, drawMat, pos, rot, nmrSize * scale);
+    }
+    else if (drawShape){
         if (drawPoints){
             SetPrimative(GL_POINTS);
             Draw(shaders["points"], camera, drawMat, pos, rot, nmrSize * scale);
+        } else if (queue != NULL && selID != ID && arenaRange.page >= 0) {
+            // Drawn together with the other spectra by the queue
+            SetPrimative(GL_TRIANGLES);
+            queue->Submit(shaders["default" BATCHED_SUFFIX], *this, arenaRange, ObjectMatrix(drawMat, pos, rot, nmrSize * scale));
         } else {
             SetPrimative(GL_TRIANGLES);
             Draw(shaders["default"], camera, drawMat, pos, rot, nmrSize * scale);
         }
-        if (showNormals) {
-            Draw(shaders["normals"], camera, drawMat, pos, rot, nmrSize * scale);
-        }
+    }
+
+    if (drawShape && showNormals) {
+        DrawNormals(shaders, camera, drawMat, pos, rot, nmrSize * scale);
     }
 
     // ******************************************
     // * Post Processing & Additional Rendering *
     // ******************************************
 
+    // Only the spectrum itself is outlined
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+
     if (drawBoundingBox) {
         DisplayBoundingBox(camera, shaders);
     }
 
-    if (selID == ID) {
-        if (drawShape) {
-            DisplayStencil(camera, shaders);
-        }
-    }
-
     glEnable(GL_CULL_FACE);
 }
 
@@ -309,6 +1181,12 @@ void NMRMesh::DisplayUI(WindowData &win, Camera & camera, Shaders &shaders)
 
 void NMRMesh::DisplayBoundingBox(Camera & camera, Shaders &shaders)
 {
+    // One box for every mesh, its face textures come from the asset cache
+    if (boundingBox == NULL) {
+        boundingBox = new Cubemap("Assets/Textures/Skybox/SolidColor/", PNG);
+        boundingBox->BindTextures();
+    }
+
     // Draw bounding box with inverted culling
     glEnable(GL_CULL_FACE);
     glCullFace(GL_FRONT);
@@ -317,29 +1195,14 @@ void NMRMesh::DisplayBoundingBox(Camera & camera, Shaders &shaders)
     glDisable(GL_CULL_FACE);
 }
 
-void NMRMesh::DisplayStencil(Camera &camera, Shaders &shaders)
+void NMRMesh::DisplayStencil(OutlinePass &pass, WindowData &win, Camera &camera, Shaders &shaders)
 {
-    // Pass stencil test only when not equal to one
-    glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-    // Disable writing to stencil mask to avoid modifying afterwards
-    glStencilMask(0x00);
-    // Disable depth buffer to avoid modifying
-    glDisable(GL_DEPTH_TEST);
-    // Enable rgb + alpha blending
-    glEnable(GL_BLEND);
-    
-    // Redraw objects with post-processing
-    if (drawShape){
-        Draw(shaders["stencil"], camera, drawMat, pos, rot, nmrSize * scale);
-    }
+    if (!drawShape) return;
 
-    // Disable RGB + Alpha blending
-    glDisable(GL_BLEND);
-    // Clear stencil mask and stencil test
-    glStencilMask(0xFF);
-    glStencilFunc(GL_ALWAYS, 0, 0xFF);
-    // Re-enable depth buffer
-    glEnable(GL_DEPTH_TEST);
+    // Spectra span -1.0 to 1.0 on every axis before the model transform
+    glm::mat4 bounds = camera.cameraMatrix * ObjectMatrix(drawMat, pos, rot, nmrSize * scale);
+
+    pass.Draw(shaders["outline"], win.width, win.height, outline, stencil_color, &bounds, drawPoints ? 0.5f * pointSize : 0.0f);
 }
 
 void NMRMesh::SpectraUI(){
@@ -355,6 +1218,51 @@ void NMRMesh::SpectraUI(){
 
     ImGui::Separator();                                                                 // ------------------
 
+    ImGui::Text("Render Mode");                                                         // Text for render mode
+    if (ImGui::RadioButton(UITxt("Vertex Mesh"), !heightfield && !terrainLOD)) {        // Vertex buffer mesh
+        BuildMesh();
+        if (meshBuilt) heightfield = terrainLOD = false;
+    }
+    ImGui::SameLine();
+    if (ImGui::RadioButton(UITxt("GPU Heightfield"), heightfield == true)) {            // Texture heightfield
+        if ((hfTexture != 0) || InitHeightfield()) {
+            heightfield = true;
+            terrainLOD = false;
+        }
+    }
+    ImGui::SameLine();
+    if (ImGui::RadioButton(UITxt("LOD Terrain"), terrainLOD == true)) {                 // Level of detail tiles
+        if (InitTerrain()) {
+            terrainLOD = true;
+            heightfield = false;
+        }
+    }
+    // Plane of 3D/4D data
+    if (planes != NULL) {
+        int z = plane[0] + 1;
+        int a = plane[1] + 1;
+        bool changed = ImGui::SliderInt(UITxt("Z Plane"), &z, 1, planes->zSize);       // Plane along Z
+        if (planes->aSize > 1)
+            changed |= ImGui::SliderInt(UITxt("A Plane"), &a, 1, planes->aSize);        // Plane along A
+        if (changed) SetPlane(z - 1, a - 1);
+    }
+    // Terrain display settings
+    if (terrainLOD && terrain != NULL) {
+        ImGui::SliderFloat(UITxt("Detail"), &terrain->lodFactor, 0.5f, 8.0f);          // Distance to refine tiles at
+        ImGui::Text("Tiles drawn %zu, resident %zu, levels %d",
+            terrain->drawnTiles, terrain->residentTiles, terrain->LevelCount());
+    }
+    // Heightfield display settings
+    if (heightfield) {
+        if (ImGui::Checkbox(UITxt("16-bit Heightfield"), &hfQuantize) && hfQuantize != hfQuantized)
+            InitHeightfield();                                                          // Re-upload in new format
+        ImGui::SliderFloat(UITxt("Range Min"), &hfRange[0], minVal, maxVal);            // Lower clipping intensity
+        ImGui::SliderFloat(UITxt("Range Max"), &hfRange[1], minVal, maxVal);            // Upper clipping intensity
+        if (hfRange[1] < hfRange[0]) hfRange[1] = hfRange[0];
+    }
+
+    ImGui::Separator();                                                                 // ------------------
+
     ImGui::Text("Display Type");                                                        // Text for drawing type
     if (ImGui::RadioButton(UITxt("Mesh"), drawPoints == false))                         // Mesh draw type
         drawPoints = false;
@@ -374,7 +1282,7 @@ void NMRMesh::SpectraUI(){
 
 void NMRMesh::StencilUI() {
     ImGui::Text("Change the Outline Thickness?");        // Text that appears in the window
-    ImGui::SliderFloat(UITxt("Thickness"), &outline, 0.1f, 2.0f); // Size slider that appears in the window
+    ImGui::SliderFloat(UITxt("Thickness"), &outline, 1.0f, (float)OUTLINE_MAX_WIDTH); // Size slider that appears in the window
  
     ImGui::Text("Change the Outline Color?");
     ImGui::ColorPicker4(UITxt("Color"), stencil_color);
@@ -459,17 +1367,37 @@ void NMRMesh::EditTransform(const Camera &camera, WindowData win)
     
 }
 
-void MeshList(std::map<std::string, void *> nmrMeshes)
+void MeshList(std::map<std::string, NMRMesh *> nmrMeshes, NMRLoader * loader)
 {
     if (nmrMeshes.empty()) {
         return;
     }
 
+    NMRLoader::Stage stage;
+    float progress;
+
     ImGui::Begin("Mesh List");
+    if (loader != NULL) {
+        bool heightfield = loader->heightfield;
+        if (ImGui::Checkbox("Load as Heightfield", &heightfield)) loader->heightfield = heightfield;
+        bool useCache = loader->useCache;
+        if (ImGui::Checkbox("Use Cache Files", &useCache)) loader->useCache = useCache;
+        ImGui::Separator();
+    }
     for (auto [file, meshPtr] : nmrMeshes) {
         if (!file.empty()) {
-            NMRMesh * mesh = static_cast<NMRMesh *>(meshPtr);
-            ImGui::Checkbox(fs::path(file).stem().string().c_str(), &mesh->drawShape);
+            std::string name = fs::path(file).stem().string();
+            if (meshPtr == NULL) {
+                // Mesh is still being loaded in the background
+                if (loader != NULL && loader->Progress(file, stage, progress)) {
+                    const char * label = (stage == NMRLoader::UPLOADING) ? "Uploading" : (stage == NMRLoader::READING) ? "Reading" : "Queued";
+                    ImGui::Text("%s", name.c_str());
+                    ImGui::ProgressBar(progress, ImVec2(-1.0f, 0.0f), label);
+                }
+                continue;
+            }
+            NMRMesh * mesh = meshPtr;
+            ImGui::Checkbox(name.c_str(), &mesh->drawShape);
         }
     }
     ImGui::End();
@@ -0,0 +1,302 @@
+#include "Offscreen.hpp"
+#include <stdio.h>
+#include <string.h>
+
+/*
+Create an OpenGL context without a window and make it current on the calling thread.
+The Mesa surfaceless platform is tried first, then the default EGL display.
+
+Parameters
+----------
+major : int
+    OpenGL major version
+minor : int
+    OpenGL minor version
+
+Returns
+-------
+success : bool
+    True if a context was created and loaded
+*/
+bool OffscreenContext::Init(int major, int minor)
+{
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if (getPlatformDisplay != NULL) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+
+    EGLint eglMajor, eglMinor;
+
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajor, &eglMinor)) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajor, &eglMinor)) {
+            printf("ERROR::OFFSCREEN: Could not initialize an EGL display\n");
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        printf("ERROR::OFFSCREEN: EGL display does not support desktop OpenGL\n");
+        Delete();
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+
+    if (!eglChooseConfig(display, configAttribs, &config, 1, &configCount) || configCount == 0) {
+        printf("ERROR::OFFSCREEN: No EGL config supports OpenGL\n");
+        Delete();
+        return false;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, major,
+        EGL_CONTEXT_MINOR_VERSION, minor,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+
+    if (context == EGL_NO_CONTEXT) {
+        printf("ERROR::OFFSCREEN: Could not create an OpenGL %d.%d core context\n", major, minor);
+        Delete();
+        return false;
+    }
+
+    // Rendering only goes to frame buffer objects, a surface is only created if required
+    const char * extensions = eglQueryString(display, EGL_EXTENSIONS);
+    bool surfaceless = extensions != NULL && strstr(extensions, "EGL_KHR_surfaceless_context") != NULL;
+
+    if (!surfaceless) {
+        const EGLint surfaceAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    }
+
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        printf("ERROR::OFFSCREEN: Could not make the OpenGL context current\n");
+        Delete();
+        return false;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+        printf("ERROR::OFFSCREEN: Could not load OpenGL functions\n");
+        Delete();
+        return false;
+    }
+
+    return true;
+}
+
+void OffscreenContext::Delete()
+{
+    if (display == EGL_NO_DISPLAY) return;
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+
+    if (surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+    if (context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+    eglTerminate(display);
+
+    display = EGL_NO_DISPLAY;
+    context = EGL_NO_CONTEXT;
+    surface = EGL_NO_SURFACE;
+}
+
+/*
+Create the multisampled draw target and the single sampled target it resolves into
+
+Parameters
+----------
+width : int
+    Image width in pixels
+height : int
+    Image height in pixels
+samples : int
+    Samples per pixel of the draw target
+
+Returns
+-------
+None
+*/
+void OffscreenTarget::Init(int width, int height, int samples)
+{
+    OffscreenTarget::width = width;
+    OffscreenTarget::height = height;
+
+    // Draw target, depth and stencil are needed by the mesh render settings
+    glGenFramebuffers(1, &ID);
+    glBindFramebuffer(GL_FRAMEBUFFER, ID);
+
+    glGenRenderbuffers(1, &colorID);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorID);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorID);
+
+    glGenRenderbuffers(1, &depthID);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthID);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthID);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Frame Buffer error, status: 0x%x\n", status);
+    }
+
+    // Resolve target read back to the CPU
+    glGenFramebuffers(1, &resolveID);
+    glBindFramebuffer(GL_FRAMEBUFFER, resolveID);
+
+    glGenRenderbuffers(1, &resolveColorID);
+    glBindRenderbuffer(GL_RENDERBUFFER, resolveColorID);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveColorID);
+
+    status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Frame Buffer error, status: 0x%x\n", status);
+    }
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void OffscreenTarget::Bind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, ID);
+    glViewport(0, 0, width, height);
+}
+
+/*
+Resolve the drawn image and copy it into the next free pixel buffer.
+The copy runs on the GPU, the image is collected later with Poll.
+
+Parameters
+----------
+name : const std::string&
+    Name returned with the image, e.g. its output path
+
+Returns
+-------
+None
+*/
+void OffscreenTarget::Read(const std::string& name)
+{
+    if (readCount == OFFSCREEN_READS) return;
+
+    PendingRead & read = reads[(readHead + readCount) % OFFSCREEN_READS];
+
+    if (read.pbo == 0) {
+        glGenBuffers(1, &read.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, ID);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveID);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveID);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // Returns immediately with a pack buffer bound
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *)0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    read.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    read.name = name;
+    readCount++;
+}
+
+bool OffscreenTarget::Full()
+{
+    return readCount == OFFSCREEN_READS;
+}
+
+bool OffscreenTarget::Busy()
+{
+    return readCount > 0;
+}
+
+/*
+Collect the oldest queued image once its copy finished
+
+Parameters
+----------
+image : Image&
+    Output image and the name it was queued under
+wait : bool
+    Block until the oldest read is finished instead of returning false
+
+Returns
+-------
+ready : bool
+    True if image was filled
+*/
+bool OffscreenTarget::Poll(Image& image, bool wait)
+{
+    if (readCount == 0) return false;
+
+    PendingRead & read = reads[readHead];
+
+    GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+    GLenum status = glClientWaitSync(read.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if (status == GL_TIMEOUT_EXPIRED) return false;
+
+    glDeleteSync(read.fence);
+    read.fence = 0;
+    readHead = (readHead + 1) % OFFSCREEN_READS;
+    readCount--;
+
+    image.name = read.name;
+    image.width = width;
+    image.height = height;
+    image.pixels.clear();
+
+    if (status == GL_WAIT_FAILED) return true;
+
+    size_t size = (size_t)width * height * 4;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, read.pbo);
+    unsigned char * pixels = (unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+
+    if (pixels != NULL) {
+        image.pixels.assign(pixels, pixels + size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return true;
+}
+
+void OffscreenTarget::Delete()
+{
+    for (PendingRead& read : reads) {
+        if (read.fence != 0) glDeleteSync(read.fence);
+        if (read.pbo != 0) glDeleteBuffers(1, &read.pbo);
+        read = PendingRead();
+    }
+    readHead = 0;
+    readCount = 0;
+
+    glDeleteFramebuffers(1, &ID);
+    glDeleteFramebuffers(1, &resolveID);
+    glDeleteRenderbuffers(1, &colorID);
+    glDeleteRenderbuffers(1, &depthID);
+    glDeleteRenderbuffers(1, &resolveColorID);
+}
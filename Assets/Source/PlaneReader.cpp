@@ -0,0 +1,352 @@
+#include "PlaneReader.hpp"
+#include "NMRMesh.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+/*
+Count the integer conversions of a file name template
+
+Parameters
+----------
+name : const std::string&
+    File name, or template such as "test%03d.ft3"
+
+Returns
+-------
+count : int
+    Number of %d conversions, -1 if the template holds any other conversion
+*/
+static int countSpecifiers(const std::string& name)
+{
+    int count = 0;
+
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] != '%') continue;
+
+        if (i + 1 < name.size() && name[i + 1] == '%') {
+            i++;
+            continue;
+        }
+
+        // Only zero padded widths are accepted, e.g. %d or %03d
+        size_t j = i + 1;
+        while (j < name.size() && isdigit((unsigned char)name[j])) j++;
+
+        if (j >= name.size() || name[j] != 'd') return -1;
+
+        count++;
+        i = j;
+    }
+
+    return count;
+}
+
+/*
+Format a file name template with one or two file numbers
+
+Parameters
+----------
+name : const std::string&
+    Template checked by countSpecifiers
+first : int
+    First file number
+second : int
+    Second file number, ignored by templates with one conversion
+
+Returns
+-------
+file : std::string
+    File name
+*/
+static std::string formatName(const std::string& name, int first, int second)
+{
+    std::vector<char> buffer(name.size() + 64);
+
+    snprintf(buffer.data(), buffer.size(), name.c_str(), first, second);
+
+    return std::string(buffer.data());
+}
+
+// Number of files of a series, counted from 1 until a file is missing
+static int countFiles(const std::string& name, bool alongFirst)
+{
+    int count = 0;
+
+    while (true) {
+        std::string file = alongFirst ? formatName(name, count + 1, 1) : formatName(name, 1, count + 1);
+        if (!fs::exists(file)) return count;
+        count++;
+    }
+}
+
+PlaneReader::PlaneReader()
+{
+
+}
+
+PlaneReader::~PlaneReader()
+{
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            stopping = true;
+        }
+        queueCond.notify_all();
+        worker.join();
+    }
+
+    for (auto& [index, data] : cache) Free(data);
+    cache.clear();
+}
+
+/*
+Read the header and geometry of 3D/4D data. Single files are plane indexed
+when they hold more than one plane, templates are plane indexed when the
+first file of the series exists. Z planes are numbered within a file and
+by the last file number of a series, A planes by the first file number.
+
+Parameters
+----------
+file : const std::string&
+    NMRPipe file, or file name template of a multi-file series
+
+Returns
+-------
+success : bool
+    False if the data is not plane indexed, or could not be read
+*/
+bool PlaneReader::Open(const std::string& file)
+{
+    NMR_INT totalPts;
+    int fileDims;
+
+    PlaneReader::file = file;
+    specifiers = countSpecifiers(file);
+
+    if (specifiers < 0 || specifiers > 2) return false;
+
+    std::string first = (specifiers == 0) ? file : formatName(file, 1, 1);
+
+    {
+        std::lock_guard<std::mutex> lock(NMRMesh::rdMutex);
+
+        if (readNMRParms(&first[0], fdata, sizeList, qSizeList, &totalPts, &qSize, &fileDims)) return false;
+    }
+
+    if (specifiers == 2) {
+        aSize = countFiles(file, true);
+        zSize = countFiles(file, false);
+    } else if (specifiers == 1) {
+        aSize = countFiles(file, true);
+    }
+
+    // Planes past X and Y in each file, getNMRParms leaves unused sizes at 1
+    filePlanes = sizeList[ZLOC] * sizeList[ALOC];
+
+    if (specifiers == 0) {
+        if (filePlanes < 2) return false;
+        zSize = sizeList[ZLOC];
+        aSize = sizeList[ALOC];
+    } else if (specifiers == 1) {
+        // One plane per file along Z, or one cube per file along A
+        if (filePlanes > 1) {
+            zSize = filePlanes;
+        } else {
+            zSize = aSize;
+            aSize = 1;
+        }
+    } else if (filePlanes > 1) {
+        printf("ERROR::PLANE_READER: Series %s with two file numbers must hold one plane per file\n", file.c_str());
+        return false;
+    }
+
+    if (zSize < 1 || aSize < 1 || sizeList[XLOC] < 1 || sizeList[YLOC] < 1) return false;
+
+    sizeList[ZLOC] = zSize;
+    sizeList[ALOC] = aSize;
+    dimCount = (aSize > 1) ? 4 : 3;
+
+    // Same plane layout as the mesh, which reads qSize * X points per row
+    planePts = (NMR_INT)qSize * sizeList[XLOC] * sizeList[YLOC];
+
+    worker = std::thread(&PlaneReader::Work, this);
+
+    return true;
+}
+
+/*
+Get a plane, waiting for it if the prefetch thread is reading it,
+or reading it on the calling thread if it was not read ahead
+
+Parameters
+----------
+plane : int
+    Z index + A index * zSize
+
+Returns
+-------
+data : float *
+    Plane of planePts points owned by the caller, NULL on failure
+*/
+float * PlaneReader::Take(int plane)
+{
+    if (plane < 0 || plane >= zSize * aSize) return NULL;
+
+    {
+        std::unique_lock<std::mutex> lock(cacheMutex);
+        readCond.wait(lock, [this, plane] { return reading.count(plane) == 0; });
+
+        auto entry = cache.find(plane);
+        if (entry != cache.end()) {
+            float * data = entry->second;
+            cache.erase(entry);
+            return data;
+        }
+
+        requests.erase(std::remove(requests.begin(), requests.end(), plane), requests.end());
+    }
+
+    return Read(plane);
+}
+
+void PlaneReader::Prefetch(int plane)
+{
+    std::vector<float *> dropped;
+    int z = plane % zSize;
+    int a = plane / zSize;
+
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+
+        current = plane;
+        requests.clear();
+
+        for (auto entry = cache.begin(); entry != cache.end();) {
+            if (Near(entry->first, plane, zSize)) {
+                entry++;
+            } else {
+                dropped.push_back(entry->second);
+                entry = cache.erase(entry);
+            }
+        }
+
+        // Closest planes first, scrolling along Z is the common case
+        std::vector<int> neighbours;
+        for (int d = 1; d <= PLANE_PREFETCH; d++) {
+            if (z + d < zSize) neighbours.push_back(plane + d);
+            if (z - d >= 0) neighbours.push_back(plane - d);
+        }
+        if (a + 1 < aSize) neighbours.push_back(plane + zSize);
+        if (a - 1 >= 0) neighbours.push_back(plane - zSize);
+
+        for (int neighbour : neighbours) {
+            if (cache.count(neighbour) == 0 && reading.count(neighbour) == 0) {
+                requests.push_back(neighbour);
+            }
+        }
+    }
+    queueCond.notify_one();
+
+    for (float * data : dropped) Free(data);
+}
+
+size_t PlaneReader::CacheBytes()
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    return cache.size() * sizeof(float) * (size_t)planePts;
+}
+
+std::string PlaneReader::FileName(int plane, NMR_INT& index)
+{
+    int z = plane % zSize;
+    int a = plane / zSize;
+
+    if (specifiers == 0) {
+        index = plane;
+        return file;
+    }
+
+    if (specifiers == 1 && filePlanes > 1) {
+        index = z;
+        return formatName(file, a + 1, 0);
+    }
+
+    index = 0;
+
+    if (specifiers == 1) return formatName(file, z + 1, 0);
+
+    return formatName(file, a + 1, z + 1);
+}
+
+float * PlaneReader::Read(int plane)
+{
+    NMR_INT index;
+    std::string name = FileName(plane, index);
+    float header[FDATASIZE];
+    float * data;
+    int error;
+
+    {
+        std::lock_guard<std::mutex> lock(NMRMesh::rdMutex);
+        error = readNMRPlane(&name[0], header, &data, planePts, index);
+    }
+
+    if (error != 0) {
+        printf("ERROR::PLANE_READER: Could not read plane %lld of %s, error code %d\n", (long long)index + 1, name.c_str(), error);
+        return NULL;
+    }
+
+    return data;
+}
+
+bool PlaneReader::Near(int plane, int other, int zSize)
+{
+    int dz = plane % zSize - other % zSize;
+    int da = plane / zSize - other / zSize;
+
+    return (da == 0 && abs(dz) <= PLANE_PREFETCH) || (dz == 0 && abs(da) <= 1);
+}
+
+void PlaneReader::Free(float * data)
+{
+    std::lock_guard<std::mutex> lock(NMRMesh::rdMutex);
+    (void) freeNMRMapped(data, planePts, NULL, 0);
+}
+
+void PlaneReader::Work()
+{
+    while (true) {
+        int plane;
+
+        {
+            std::unique_lock<std::mutex> lock(cacheMutex);
+            queueCond.wait(lock, [this] { return stopping || !requests.empty(); });
+
+            if (stopping) return;
+
+            plane = requests.front();
+            requests.pop_front();
+            reading.insert(plane);
+        }
+
+        float * data = Read(plane);
+
+        {
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            reading.erase(plane);
+
+            // Keep plane unless the current plane moved away while it was read
+            if (data != NULL && Near(plane, current, zSize) && cache.count(plane) == 0) {
+                cache[plane] = data;
+                data = NULL;
+            }
+        }
+        readCond.notify_all();
+
+        if (data != NULL) Free(data);
+    }
+}
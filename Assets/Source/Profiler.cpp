@@ -0,0 +1,363 @@
+#include "Profiler.hpp"
+#include <cstdio>
+#include <cfloat>
+#include <algorithm>
+#include <imgui/imgui.h>
+
+bool Profiler::enabled = true;
+bool Profiler::showUI = false;
+std::chrono::steady_clock::time_point Profiler::origin = std::chrono::steady_clock::now();
+std::deque<Profiler::Frame> Profiler::history;
+Profiler::Frame Profiler::current;
+std::vector<size_t> Profiler::stack;
+bool Profiler::recording = false;
+bool Profiler::gpuOpen = false;
+size_t Profiler::gpuZone = 0;
+unsigned long Profiler::frameIndex = 0;
+Profiler::QuerySet Profiler::querySets[GPU_QUERY_FRAMES];
+
+double Profiler::Now()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+}
+
+/*
+Start recording a frame
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+void Profiler::BeginFrame()
+{
+    recording = enabled;
+    if (!recording) return;
+
+    current.index = frameIndex;
+    current.start = Now();
+    current.zones.clear();
+    stack.clear();
+
+    // Results of the frame that used this set last are dropped if still pending
+    QuerySet& set = querySets[frameIndex % GPU_QUERY_FRAMES];
+    set.used = 0;
+    set.zones.clear();
+    set.frame = frameIndex;
+    set.pending = false;
+}
+
+/*
+Finish the frame, store it in the history, and collect
+GPU results of earlier frames that became available
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+void Profiler::EndFrame()
+{
+    if (!recording) return;
+
+    // Close zones left open by early returns
+    while (!stack.empty()) End();
+
+    current.end = Now();
+    querySets[frameIndex % GPU_QUERY_FRAMES].pending = querySets[frameIndex % GPU_QUERY_FRAMES].used > 0;
+
+    history.push_back(current);
+    while (history.size() > PROFILE_FRAMES) history.pop_front();
+
+    frameIndex++;
+    recording = false;
+
+    CollectQueries();
+}
+
+/*
+Open a zone nested in the currently open zone
+
+Parameters
+----------
+name : const char *
+    Zone name, must outlive the profiler (string literals)
+
+gpu : bool
+    Also time the GPU work issued inside the zone with a GL_TIME_ELAPSED query.
+    Ignored if another GPU zone is open since elapsed queries cannot nest.
+
+Returns
+-------
+None
+*/
+void Profiler::Begin(const char * name, bool gpu)
+{
+    if (!recording) return;
+
+    Zone zone;
+    zone.name = name;
+    zone.depth = (int)stack.size();
+    zone.start = Now();
+    zone.end = zone.start;
+
+    stack.push_back(current.zones.size());
+    current.zones.push_back(zone);
+
+    if (gpu && !gpuOpen) {
+        QuerySet& set = querySets[frameIndex % GPU_QUERY_FRAMES];
+        if (set.used == set.queries.size()) {
+            GLuint query;
+            glGenQueries(1, &query);
+            set.queries.push_back(query);
+        }
+        set.zones.push_back(stack.back());
+        glBeginQuery(GL_TIME_ELAPSED, set.queries[set.used++]);
+
+        gpuOpen = true;
+        gpuZone = stack.back();
+    }
+}
+
+/*
+Close the most recently opened zone
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+void Profiler::End()
+{
+    if (!recording || stack.empty()) return;
+
+    size_t index = stack.back();
+    stack.pop_back();
+    current.zones[index].end = Now();
+
+    if (gpuOpen && gpuZone == index) {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuOpen = false;
+    }
+}
+
+Profiler::Frame * Profiler::FindFrame(unsigned long index)
+{
+    if (history.empty()) return NULL;
+
+    unsigned long first = history.front().index;
+    if (index < first || index - first >= history.size()) return NULL;
+
+    return &history[index - first];
+}
+
+void Profiler::CollectQueries()
+{
+    for (QuerySet& set : querySets) {
+        if (!set.pending) continue;
+
+        // Results arrive in order, checking the last query of the frame is enough
+        GLint available = 0;
+        glGetQueryObjectiv(set.queries[set.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+
+        Frame * frame = FindFrame(set.frame);
+        for (size_t i = 0; i < set.used && frame != NULL; i++) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(set.queries[i], GL_QUERY_RESULT, &elapsed);
+            frame->zones[set.zones[i]].gpu = (double)elapsed / 1.0e6;
+        }
+        set.pending = false;
+    }
+}
+
+/*
+Draw the profiler window: frame time graph, timeline of the
+selected frame, and per zone averages over the history
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+void Profiler::DisplayUI()
+{
+    if (!showUI) return;
+
+    if (!ImGui::Begin("Profiler", &showUI)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Checkbox("Record", &enabled);
+    ImGui::SameLine();
+    if (ImGui::Button("Export Trace")) {
+        ExportTrace("profile_trace.json");
+    }
+
+    if (history.empty()) {
+        ImGui::End();
+        return;
+    }
+
+    // Frame time graph
+    std::vector<float> frameTimes;
+    frameTimes.reserve(history.size());
+    for (const Frame& frame : history) frameTimes.push_back((float)(frame.end - frame.start));
+    const Frame& last = history.back();
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "%.2f ms", last.end - last.start);
+    ImGui::PlotLines("Frame", frameTimes.data(), (int)frameTimes.size(), 0, overlay, 0.0f, FLT_MAX, ImVec2(0, 60));
+
+    // Timeline of the newest frame whose GPU results are in, one row per nesting level
+    unsigned long collected = frameIndex;
+    for (const QuerySet& set : querySets) {
+        if (set.pending) collected = std::min(collected, set.frame);
+    }
+    const Frame * shown = FindFrame(collected - 1);
+    if (shown == NULL) shown = &last;
+
+    int depth = 1;
+    for (const Zone& zone : shown->zones) depth = std::max(depth, zone.depth + 1);
+
+    const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = std::max(ImGui::GetContentRegionAvail().x, 100.0f);
+    double duration = std::max(shown->end - shown->start, 1.0e-3);
+    ImDrawList * draw = ImGui::GetWindowDrawList();
+
+    for (size_t i = 0; i < shown->zones.size(); i++) {
+        const Zone& zone = shown->zones[i];
+        float x0 = origin.x + (float)((zone.start - shown->start) / duration) * width;
+        float x1 = origin.x + (float)((zone.end - shown->start) / duration) * width;
+        float y0 = origin.y + zone.depth * rowHeight;
+        if (x1 - x0 < 1.0f) x1 = x0 + 1.0f;
+
+        ImU32 color = ImGui::GetColorU32(ImVec4(0.3f + 0.1f * (i % 5), 0.45f, 0.7f - 0.08f * (i % 5), 1.0f));
+        draw->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y0 + rowHeight - 1.0f), color);
+        draw->PushClipRect(ImVec2(x0, y0), ImVec2(x1, y0 + rowHeight), true);
+        draw->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32_WHITE, zone.name);
+        draw->PopClipRect();
+
+        if (ImGui::IsMouseHoveringRect(ImVec2(x0, y0), ImVec2(x1, y0 + rowHeight))) {
+            if (zone.gpu >= 0.0) ImGui::SetTooltip("%s\nCPU %.3f ms\nGPU %.3f ms", zone.name, zone.end - zone.start, zone.gpu);
+            else ImGui::SetTooltip("%s\nCPU %.3f ms", zone.name, zone.end - zone.start);
+        }
+    }
+    ImGui::Dummy(ImVec2(width, depth * rowHeight));
+
+    // Average of each zone over the history
+    struct Total { const char * name; int depth; double cpu, gpu; int count, gpuCount; };
+    std::vector<Total> totals;
+    for (const Frame& frame : history) {
+        for (const Zone& zone : frame.zones) {
+            auto found = std::find_if(totals.begin(), totals.end(), [&zone](const Total& t) {
+                return t.name == zone.name && t.depth == zone.depth;
+            });
+            if (found == totals.end()) {
+                totals.push_back({ zone.name, zone.depth, 0.0, 0.0, 0, 0 });
+                found = totals.end() - 1;
+            }
+            found->cpu += zone.end - zone.start;
+            found->count++;
+            if (zone.gpu >= 0.0) {
+                found->gpu += zone.gpu;
+                found->gpuCount++;
+            }
+        }
+    }
+
+    if (ImGui::BeginTable("Zones", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)) {
+        ImGui::TableSetupColumn("Zone");
+        ImGui::TableSetupColumn("CPU ms / frame");
+        ImGui::TableSetupColumn("GPU ms / frame");
+        ImGui::TableHeadersRow();
+        double frames = (double)history.size();
+        for (const Total& total : totals) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%*s%s", total.depth * 2, "", total.name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", total.cpu / frames);
+            ImGui::TableNextColumn();
+            if (total.gpuCount > 0) ImGui::Text("%.3f", total.gpu / total.gpuCount * ((double)total.count / frames));
+            else ImGui::TextUnformatted("-");
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::End();
+}
+
+// Write name as the contents of a JSON string
+static void writeJSONString(FILE * file, const char * name)
+{
+    for (const char * c = name; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20) fprintf(file, "\\u%04x", (unsigned char)*c);
+        else fputc(*c, file);
+    }
+}
+
+/*
+Write recorded frames in the Chrome trace event format. CPU zones are written
+as complete events on thread 1, GPU timings on thread 2 starting with their zone.
+
+Parameters
+----------
+path : const std::string&
+    Output JSON file
+
+Returns
+-------
+success : bool
+    False if the file could not be written
+*/
+bool Profiler::ExportTrace(const std::string& path)
+{
+    FILE * file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        printf("ERROR::PROFILER: Could not write trace %s\n", path.c_str());
+        return false;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+
+    for (const Frame& frame : history) {
+        fprintf(file, ",\n{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"index\":%lu}}",
+            frame.start * 1000.0, (frame.end - frame.start) * 1000.0, frame.index);
+
+        for (const Zone& zone : frame.zones) {
+            fprintf(file, ",\n{\"name\":\"");
+            writeJSONString(file, zone.name);
+            fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+                zone.start * 1000.0, (zone.end - zone.start) * 1000.0);
+            if (zone.gpu >= 0.0) {
+                fprintf(file, ",\n{\"name\":\"");
+                writeJSONString(file, zone.name);
+                fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f}",
+                    zone.start * 1000.0, zone.gpu * 1000.0);
+            }
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    bool success = ferror(file) == 0;
+    fclose(file);
+
+    return success;
+}
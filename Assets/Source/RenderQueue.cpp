@@ -0,0 +1,393 @@
+#include "RenderQueue.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
+
+/*
+Reserve space for a mesh in the shared buffers
+
+Parameters
+----------
+vertexCount : size_t
+    Number of vertices of the mesh
+indexCount : size_t
+    Number of indices of the mesh
+range : ArenaRange&
+    Output location of the mesh
+
+Returns
+-------
+success : bool
+    False if no page could hold the mesh, or it is too large to share a page
+*/
+bool MeshArena::Allocate(size_t vertexCount, size_t indexCount, ArenaRange& range)
+{
+    range = ArenaRange();
+    if (vertexCount == 0 || indexCount == 0) return false;
+
+    // Larger meshes are drawn from buffers of their own, sized exactly
+    if (vertexCount > ARENA_PAGE_MAX_VERTICES || indexCount > (size_t)ARENA_PAGE_MAX_VERTICES * ARENA_PAGE_INDEX_RATIO) return false;
+
+    for (int i = 0; i <= (int)pages.size(); i++) {
+        if (i == (int)pages.size()) {
+            i = NewPage(vertexCount, indexCount);
+            if (i < 0) return false;
+        }
+
+        Page * page = pages[i];
+        if (page == NULL) continue;
+
+        size_t vertexOffset, indexOffset;
+        if (!Take(page->freeVertices, vertexCount, vertexOffset)) continue;
+        if (!Take(page->freeIndices, indexCount, indexOffset)) {
+            Give(page->freeVertices, vertexOffset, vertexCount);
+            continue;
+        }
+
+        page->users++;
+
+        range.page = i;
+        range.baseVertex = (GLint)vertexOffset;
+        range.firstIndex = (GLuint)indexOffset;
+        range.vertexCount = vertexCount;
+        range.indexCount = indexCount;
+
+        return true;
+    }
+
+    return false;
+}
+
+void MeshArena::Free(ArenaRange& range)
+{
+    if (range.page < 0 || range.page >= (int)pages.size() || pages[range.page] == NULL) return;
+
+    Page * page = pages[range.page];
+    Give(page->freeVertices, range.baseVertex, range.vertexCount);
+    Give(page->freeIndices, range.firstIndex, range.indexCount);
+
+    // Slots of deleted pages stay empty so the page numbers of other meshes do not change
+    if (--page->users == 0) {
+        glDeleteVertexArrays(1, &page->vaoID);
+        glDeleteBuffers(1, &page->vboID);
+        glDeleteBuffers(1, &page->eboID);
+        delete page;
+        pages[range.page] = NULL;
+    }
+
+    range = ArenaRange();
+}
+
+GLuint MeshArena::VertexBuffer(int page)
+{
+    return pages[page]->vboID;
+}
+
+GLuint MeshArena::IndexBuffer(int page)
+{
+    return pages[page]->eboID;
+}
+
+GLuint MeshArena::VertexArray(int page)
+{
+    return pages[page]->vaoID;
+}
+
+/*
+Arena shared by all NMR meshes, created on first use
+
+Parameters
+----------
+None
+
+Returns
+-------
+arena : MeshArena&
+    Shared arena
+*/
+MeshArena& MeshArena::Shared()
+{
+    static MeshArena arena;
+    return arena;
+}
+
+int MeshArena::PageCount()
+{
+    int count = 0;
+
+    for (auto page : pages) {
+        if (page != NULL) count++;
+    }
+
+    return count;
+}
+
+// Smallest power of two that is at least count
+static size_t PowerOfTwo(size_t count)
+{
+    size_t power = 1;
+    while (power < count) power <<= 1;
+    return power;
+}
+
+/*
+Create a page of the arena. The first page starts small so that a single
+small spectrum does not reserve a large buffer, each later page doubles
+the minimum capacity up to ARENA_PAGE_MAX_VERTICES.
+
+Parameters
+----------
+vertexCount : size_t
+    Vertices the page must hold
+indexCount : size_t
+    Indices the page must hold
+
+Returns
+-------
+page : int
+    Index of the new page, -1 if its buffers could not be created
+*/
+int MeshArena::NewPage(size_t vertexCount, size_t indexCount)
+{
+    size_t minVertices = (size_t)ARENA_PAGE_MIN_VERTICES << std::min(PageCount(), 16);
+    minVertices = std::min(minVertices, (size_t)ARENA_PAGE_MAX_VERTICES);
+
+    Page * page = new Page;
+    page->vertexCapacity = std::max(std::min(PowerOfTwo(vertexCount), (size_t)ARENA_PAGE_MAX_VERTICES), minVertices);
+    page->indexCapacity = std::max(std::min(PowerOfTwo(indexCount), (size_t)ARENA_PAGE_MAX_VERTICES * ARENA_PAGE_INDEX_RATIO),
+                                   minVertices * ARENA_PAGE_INDEX_RATIO);
+
+    // Clear errors of earlier calls so only failures of these buffers are seen
+    while (glGetError() != GL_NO_ERROR) {}
+
+    glGenBuffers(1, &page->vboID);
+    glBindBuffer(GL_ARRAY_BUFFER, page->vboID);
+    glBufferData(GL_ARRAY_BUFFER, page->vertexCapacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &page->eboID);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, page->eboID);
+    glBufferData(GL_COPY_WRITE_BUFFER, page->indexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    bool outOfMemory = false;
+    for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError()) {
+        if (error == GL_OUT_OF_MEMORY) outOfMemory = true;
+    }
+
+    if (outOfMemory) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glDeleteBuffers(1, &page->vboID);
+        glDeleteBuffers(1, &page->eboID);
+        delete page;
+        return -1;
+    }
+
+    // Same layout as Mesh vertex arrays
+    glGenVertexArrays(1, &page->vaoID);
+    glBindVertexArray(page->vaoID);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)(9 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, page->eboID);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    page->freeVertices[0] = page->vertexCapacity;
+    page->freeIndices[0] = page->indexCapacity;
+
+    // Reuse the slot of a deleted page
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (pages[i] == NULL) {
+            pages[i] = page;
+            return (int)i;
+        }
+    }
+
+    pages.push_back(page);
+    return (int)pages.size() - 1;
+}
+
+bool MeshArena::Take(std::map<size_t, size_t>& freeList, size_t count, size_t& offset)
+{
+    for (auto range = freeList.begin(); range != freeList.end(); range++) {
+        if (range->second < count) continue;
+
+        offset = range->first;
+        size_t remaining = range->second - count;
+        freeList.erase(range);
+        if (remaining > 0) freeList[offset + count] = remaining;
+
+        return true;
+    }
+
+    return false;
+}
+
+void MeshArena::Give(std::map<size_t, size_t>& freeList, size_t offset, size_t count)
+{
+    auto next = freeList.lower_bound(offset);
+
+    // Merge with the following free range
+    if (next != freeList.end() && offset + count == next->first) {
+        count += next->second;
+        next = freeList.erase(next);
+    }
+
+    // Merge with the preceding free range
+    if (next != freeList.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += count;
+            return;
+        }
+    }
+
+    freeList[offset] = count;
+}
+
+/*
+Queue a draw of a mesh stored in the mesh arena
+
+Parameters
+----------
+shader : Shader&
+    Batched shader variant (see initializeBatchedShaders)
+mesh : Mesh&
+    Mesh providing primative and textures, must stay alive until Flush
+range : const ArenaRange&
+    Location of the mesh in the arena
+model : const glm::mat4&
+    Model matrix of the draw
+
+Returns
+-------
+None
+*/
+void RenderQueue::Submit(Shader& shader, Mesh& mesh, const ArenaRange& range, const glm::mat4& model)
+{
+    if (range.page < 0) return;
+
+    Draw draw;
+    draw.shader = &shader;
+    draw.mesh = &mesh;
+    draw.program = shader.ID;
+    draw.primative = mesh.primative;
+    draw.page = range.page;
+    draw.range = range;
+    draw.model = model;
+
+    for (Texture& texture : mesh.textures) draw.textures.push_back(texture.ID);
+
+    draws.push_back(draw);
+}
+
+/*
+Issue queued draws, one multi draw per run of draws sharing program, primative,
+textures, and arena page. Stencil writes match the regular mesh pass.
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+void RenderQueue::Flush()
+{
+    PROFILE_ZONE("RenderQueue::Flush");
+
+    if (draws.empty()) return;
+
+    // Order by state so that matching draws are adjacent
+    std::stable_sort(draws.begin(), draws.end(), [](const Draw& a, const Draw& b) {
+        if (a.program != b.program) return a.program < b.program;
+        if (a.primative != b.primative) return a.primative < b.primative;
+        if (a.textures != b.textures) return a.textures < b.textures;
+        return a.page < b.page;
+    });
+
+    commands.clear();
+    models.clear();
+
+    for (const Draw& draw : draws) {
+        Command command;
+        command.count = (GLuint)draw.range.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = draw.range.firstIndex;
+        command.baseVertex = draw.range.baseVertex;
+        command.baseInstance = 0;
+
+        commands.push_back(command);
+        models.push_back(draw.model);
+    }
+
+    Reserve(GL_DRAW_INDIRECT_BUFFER, commandID, commandCapacity, commands.size() * sizeof(Command));
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(Command), commands.data());
+
+    Reserve(GL_SHADER_STORAGE_BUFFER, modelID, modelCapacity, models.size() * sizeof(glm::mat4));
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, models.size() * sizeof(glm::mat4), models.data());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_BINDING, modelID);
+
+    glStencilFunc(GL_ALWAYS, 1, 0xFF);
+    glStencilMask(0xFF);
+
+    size_t first = 0;
+    while (first < draws.size()) {
+        const Draw& head = draws[first];
+        size_t last = first + 1;
+
+        while (last < draws.size() &&
+               draws[last].program == head.program &&
+               draws[last].primative == head.primative &&
+               draws[last].textures == head.textures &&
+               draws[last].page == head.page) {
+            last++;
+        }
+
+        head.mesh->BindMaterial(*head.shader);
+        head.shader->setInt(head.shader->Common().drawOffset, (int)first);
+
+        glBindVertexArray(MeshArena::Shared().VertexArray(head.page));
+        glMultiDrawElementsIndirect(head.primative, GL_UNSIGNED_INT,
+                                    (void *)(first * sizeof(Command)), (GLsizei)(last - first), 0);
+
+        first = last;
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    draws.clear();
+}
+
+size_t RenderQueue::Size()
+{
+    return draws.size();
+}
+
+void RenderQueue::Delete()
+{
+    if (commandID != 0) glDeleteBuffers(1, &commandID);
+    if (modelID != 0) glDeleteBuffers(1, &modelID);
+
+    commandID = 0;
+    modelID = 0;
+    commandCapacity = 0;
+    modelCapacity = 0;
+}
+
+void RenderQueue::Reserve(GLenum target, GLuint& ID, size_t& capacity, size_t size)
+{
+    if (ID == 0) glGenBuffers(1, &ID);
+    glBindBuffer(target, ID);
+
+    if (size > capacity) capacity = std::max(size, 2 * capacity);
+
+    // Orphan last frame's storage so the upload does not wait for its draws
+    glBufferData(target, capacity, NULL, GL_STREAM_DRAW);
+}
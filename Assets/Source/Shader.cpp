@@ -1,4 +1,5 @@
 #include "Shader.hpp"
+#include "FileCache.hpp"
 
 /*
 Obtain the contents of a file and return a string containing the data.
@@ -72,16 +73,26 @@ vertexFile : const char *
     Filepath to vertex file
 fragmentFile : const char *
     Filepath to fragment file
+geometryFile : const char *
+    Filepath to geometry file, geometry stage is skipped if the file is empty or missing
+vertexPrelude : const char *
+    Source inserted after the #version line of the vertex shader, by default NULL
 
 Returns
 -------
 Shader object
 */
-Shader::Shader(const char *vertexFile, const char *fragmentFile, const char *geometryFile)
+Shader::Shader(const char *vertexFile, const char *fragmentFile, const char *geometryFile, const char *vertexPrelude)
 {
     bool useGeometry = true;
 
     std::string vertexCode = get_file_contents(vertexFile);
+
+    if (vertexPrelude != NULL) {
+        size_t versionEnd = vertexCode.find('\n');
+        vertexCode.insert(versionEnd == std::string::npos ? vertexCode.size() : versionEnd + 1, vertexPrelude);
+    }
+
     std::string fragmentCode = get_file_contents(fragmentFile);
     std::string geometryCode = get_file_contents(geometryFile);
 
@@ -89,6 +100,13 @@ Shader::Shader(const char *vertexFile, const char *fragmentFile, const char *geo
         useGeometry = false;
     }
 
+    // Programs linked by a previous run with the same sources and driver are loaded without compiling
+    std::string cacheFile = binaryCacheFile(vertexCode, fragmentCode, geometryCode);
+    if (loadBinary(cacheFile)) {
+        cacheUniforms();
+        return;
+    }
+
     const char* vertexSource    = vertexCode.c_str();
     const char* fragmentSource  = fragmentCode.c_str();
     const char* geometrySource  = geometryCode.c_str();
@@ -144,18 +162,143 @@ Shader::Shader(const char *vertexFile, const char *fragmentFile, const char *geo
 
     // Create shader program and store as the Shader class ID, attach, then wrap shaders into shader program
     ID = glCreateProgram();
+    glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glAttachShader(ID, vertexShader);
     glAttachShader(ID, fragmentShader);
     if (useGeometry) glAttachShader(ID, geometryShader);
     glLinkProgram(ID);
     compileErrors(ID, "PROGRAM");
 
+    // Store the linked program for the next run
+    saveBinary(cacheFile);
+
+    // Look up every uniform location once
+    cacheUniforms();
+
     // Remove shaders now that the shaders are loaded to the program
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
     if (useGeometry) glDeleteShader(geometryShader);
 }
 
+/*
+Path of the program binary cache file for the given sources. The name is a
+64 bit FNV-1a hash of the sources and the driver strings, so editing a shader
+or changing driver selects a different file.
+
+Parameters
+----------
+vertexCode, fragmentCode, geometryCode : const std::string&
+    Final source of each stage
+
+Returns
+-------
+cacheFile : std::string
+    Path of cache file inside SHADER_CACHE_DIR
+*/
+std::string Shader::binaryCacheFile(const std::string& vertexCode, const std::string& fragmentCode, const std::string& geometryCode)
+{
+    const unsigned char separator = 0xFF;
+    uint64_t hash = FILE_CACHE_HASH_SEED;
+    auto add = [&hash, &separator](const char * data, size_t size) {
+        hash = FileCache::Hash64(data, size, hash);
+        // Separator so moving text between stages changes the hash
+        hash = FileCache::Hash64(&separator, 1, hash);
+    };
+
+    add(vertexCode.data(), vertexCode.size());
+    add(fragmentCode.data(), fragmentCode.size());
+    add(geometryCode.data(), geometryCode.size());
+
+    const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (GLenum name : driverStrings) {
+        const char * value = (const char *)glGetString(name);
+        if (value != NULL) add(value, strlen(value));
+    }
+
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "%016llx.bin", (unsigned long long)hash);
+
+    return std::string(SHADER_CACHE_DIR) + fileName;
+}
+
+/*
+Create the program from a cached binary
+
+Parameters
+----------
+cacheFile : const std::string&
+    Path of cache file
+
+Returns
+-------
+loaded : bool
+    True if ID holds a linked program, false if the program must be compiled
+*/
+bool Shader::loadBinary(const std::string& cacheFile)
+{
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats < 1) return false;
+
+    std::string contents = get_file_contents(cacheFile.c_str());
+    if (contents.size() <= sizeof(GLenum)) return false;
+
+    // File holds the binary format followed by the binary
+    GLenum format;
+    memcpy(&format, contents.data(), sizeof(GLenum));
+
+    ID = glCreateProgram();
+    glProgramBinary(ID, format, contents.data() + sizeof(GLenum), (GLsizei)(contents.size() - sizeof(GLenum)));
+
+    // Drivers reject binaries from other driver builds, fall back to compiling
+    GLint linked = GL_FALSE;
+    glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE) {
+        glDeleteProgram(ID);
+        ID = 0;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+Write the linked program to the binary cache, failures only cost the next startup a compile
+
+Parameters
+----------
+cacheFile : const std::string&
+    Path of cache file
+
+Returns
+-------
+None
+*/
+void Shader::saveBinary(const std::string& cacheFile)
+{
+    GLint linked = GL_FALSE;
+    glGetProgramiv(ID, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE) return;
+
+    GLint length = 0;
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format;
+    glGetProgramBinary(ID, length, &length, &format, binary.data());
+
+    std::error_code error;
+    std::filesystem::create_directories(SHADER_CACHE_DIR, error);
+
+    FileCache::WriteAtomic(cacheFile, [&](std::ofstream& out) {
+        out.write((const char *)&format, sizeof(GLenum));
+        out.write(binary.data(), length);
+        return true;
+    });
+}
+
 /*
 Set OpenGL to use shader
 
@@ -184,69 +327,249 @@ None
 */
 void Shader::Delete(){
     glDeleteProgram(ID);
+    uniforms = std::make_shared<UniformCache>();
 }
 
 void Shader::setBool(const std::string &name, bool value) const
 {         
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+    setBool(Uniform(name), value); 
 }
 // ------------------------------------------------------------------------
 void Shader::setInt(const std::string &name, int value) const
 { 
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+    setInt(Uniform(name), value); 
 }
 void Shader::setUInt(const std::string &name, int value) const
 { 
-    glUniform1ui(glGetUniformLocation(ID, name.c_str()), value); 
+    setUInt(Uniform(name), value); 
 }
 // ------------------------------------------------------------------------
 void Shader::setFloat(const std::string &name, float value) const
 { 
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+    setFloat(Uniform(name), value); 
 }
 // ------------------------------------------------------------------------
 void Shader::setVec2(const std::string &name, const glm::vec2 &value) const
 { 
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    setVec2(Uniform(name), value); 
 }
 void Shader::setVec2(const std::string &name, float x, float y) const
 { 
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+    setVec2(Uniform(name), glm::vec2(x, y)); 
+}
+void Shader::setIVec2(const std::string &name, int x, int y) const
+{ 
+    setIVec2(Uniform(name), glm::ivec2(x, y)); 
 }
 // ------------------------------------------------------------------------
 void Shader::setVec3(const std::string &name, const glm::vec3 &value) const
 { 
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    setVec3(Uniform(name), value); 
 }
 void Shader::setVec3(const std::string &name, float x, float y, float z) const
 { 
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+    setVec3(Uniform(name), glm::vec3(x, y, z)); 
 }
 // ------------------------------------------------------------------------
 void Shader::setVec4(const std::string &name, const glm::vec4 &value) const
 { 
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+    setVec4(Uniform(name), value); 
 }
 void Shader::setVec4(const std::string &name, float x, float y, float z, float w) const
 { 
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+    setVec4(Uniform(name), glm::vec4(x, y, z, w)); 
 }
 // ------------------------------------------------------------------------
 void Shader::setMat2(const std::string &name, const glm::mat2 &mat) const
 {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+    setMat2(Uniform(name), mat);
 }
 // ------------------------------------------------------------------------
 void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const
 {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+    setMat3(Uniform(name), mat);
 }
 // ------------------------------------------------------------------------
 void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(mat));
+    setMat4(Uniform(name), mat);
 }
 
+// ------------------------------------------------------------------------
+// Handle based setters
+// ------------------------------------------------------------------------
+
+void Shader::setBool(UniformHandle handle, bool value) const
+{
+    setInt(handle, (int)value);
+}
+void Shader::setInt(UniformHandle handle, int value) const
+{
+    if (changed(handle, &value, sizeof(value)))
+        glUniform1i(uniforms->slots[handle].location, value);
+}
+void Shader::setUInt(UniformHandle handle, int value) const
+{
+    if (changed(handle, &value, sizeof(value)))
+        glUniform1ui(uniforms->slots[handle].location, value);
+}
+void Shader::setFloat(UniformHandle handle, float value) const
+{
+    if (changed(handle, &value, sizeof(value)))
+        glUniform1f(uniforms->slots[handle].location, value);
+}
+void Shader::setVec2(UniformHandle handle, const glm::vec2 &value) const
+{
+    if (changed(handle, &value[0], sizeof(value)))
+        glUniform2fv(uniforms->slots[handle].location, 1, &value[0]);
+}
+void Shader::setIVec2(UniformHandle handle, const glm::ivec2 &value) const
+{
+    if (changed(handle, &value[0], sizeof(value)))
+        glUniform2iv(uniforms->slots[handle].location, 1, &value[0]);
+}
+void Shader::setVec3(UniformHandle handle, const glm::vec3 &value) const
+{
+    if (changed(handle, &value[0], sizeof(value)))
+        glUniform3fv(uniforms->slots[handle].location, 1, &value[0]);
+}
+void Shader::setVec4(UniformHandle handle, const glm::vec4 &value) const
+{
+    if (changed(handle, &value[0], sizeof(value)))
+        glUniform4fv(uniforms->slots[handle].location, 1, &value[0]);
+}
+void Shader::setMat2(UniformHandle handle, const glm::mat2 &mat) const
+{
+    if (changed(handle, glm::value_ptr(mat), sizeof(mat)))
+        glUniformMatrix2fv(uniforms->slots[handle].location, 1, GL_FALSE, glm::value_ptr(mat));
+}
+void Shader::setMat3(UniformHandle handle, const glm::mat3 &mat) const
+{
+    if (changed(handle, glm::value_ptr(mat), sizeof(mat)))
+        glUniformMatrix3fv(uniforms->slots[handle].location, 1, GL_FALSE, glm::value_ptr(mat));
+}
+void Shader::setMat4(UniformHandle handle, const glm::mat4 &mat) const
+{
+    if (changed(handle, glm::value_ptr(mat), sizeof(mat)))
+        glUniformMatrix4fv(uniforms->slots[handle].location, 1, GL_FALSE, glm::value_ptr(mat));
+}
+
+/*
+Obtain the handle of a uniform for the handle based setters
+
+Parameters
+----------
+name : const std::string &
+    Name of the uniform as used in the shader, array elements as name[i]
+
+Returns
+-------
+Uniform handle, INVALID_UNIFORM if the uniform is not active in the program
+*/
+UniformHandle Shader::Uniform(const std::string &name) const
+{
+    auto entry = uniforms->handles.find(name);
+
+    if (entry == uniforms->handles.end()) return INVALID_UNIFORM;
+
+    return entry->second;
+}
+
+const CommonUniforms& Shader::Common() const
+{
+    return uniforms->common;
+}
+
+void Shader::InvalidateUniforms()
+{
+    for (auto & slot : uniforms->slots) {
+        slot.valid = false;
+    }
+}
+
+/*
+Build the uniform cache from the active uniforms of the linked program
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+void Shader::cacheUniforms()
+{
+    GLint count = 0;
+    GLint maxLength = 0;
+
+    uniforms = std::make_shared<UniformCache>();
+
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    std::vector<GLchar> buffer(maxLength + 1);
+
+    auto addSlot = [this](const std::string &name, GLint location) {
+        UniformCache::Slot slot;
+        slot.location = location;
+        uniforms->handles[name] = uniforms->slots.size();
+        uniforms->slots.push_back(slot);
+    };
+
+    for (GLint i = 0; i < count; i++) {
+        GLint size;
+        GLenum type;
+        GLsizei length = 0;
+
+        glGetActiveUniform(ID, i, buffer.size(), &length, &size, &type, buffer.data());
+
+        std::string name(buffer.data(), length);
+        GLint location = glGetUniformLocation(ID, name.c_str());
+
+        // Members of uniform blocks have no location
+        if (location < 0) continue;
+
+        // Arrays are reported once as name[0], register every element and the bare name
+        size_t bracket = name.rfind("[0]");
+        if (bracket != std::string::npos && bracket + 3 == name.size()) {
+            std::string base = name.substr(0, bracket);
+
+            for (GLint e = 0; e < size; e++) {
+                std::string element = base + "[" + std::to_string(e) + "]";
+                addSlot(element, glGetUniformLocation(ID, element.c_str()));
+            }
+
+            uniforms->handles[base] = uniforms->handles[base + "[0]"];
+        } else {
+            addSlot(name, location);
+        }
+    }
+
+    CommonUniforms & common = uniforms->common;
+    common.materialAmbient = Uniform("material.ambient");
+    common.materialShininess = Uniform("material.shininess");
+    common.drawOffset = Uniform("drawOffset");
+    common.heightMap = Uniform("heightMap");
+    common.hfSize = Uniform("hfSize");
+    common.hfDecode = Uniform("hfDecode");
+    common.hfRange = Uniform("hfRange");
+    common.hfPoints = Uniform("hfPoints");
+}
+
+bool Shader::changed(UniformHandle handle, const void * value, size_t size) const
+{
+    if (handle < 0 || handle >= (int)uniforms->slots.size()) return false;
+
+    UniformCache::Slot & slot = uniforms->slots[handle];
+
+    if (slot.valid && memcmp(slot.value, value, size) == 0) return false;
+
+    memcpy(slot.value, value, size);
+    slot.valid = true;
+
+    return true;
+}
 
 /*
 Check if compiling target shader or program leads to any errors
@@ -295,4 +618,70 @@ void initializeShaders(Shaders & shaders, std::string shader_path, std::vector<s
             )}
         );
     }
-}
\ No newline at end of file
+}
+
+/*
+Build heightfield variants of the given shaders, named with HEIGHTFIELD_SUFFIX.
+The vertex shader is compiled with HEIGHTFIELD defined and heightfield/heightfield.glsl
+prepended, the geometry and fragment shaders are shared with the regular shader.
+
+Parameters
+----------
+shaders : Shaders&
+    Map of shader programs to add variants to
+shader_path : std::string
+    Path to shader directory
+shader_list : std::vector<std::string>
+    Names of shaders to build variants of
+
+Returns
+-------
+None
+*/
+void initializeHeightfieldShaders(Shaders & shaders, std::string shader_path, std::vector<std::string> shader_list){
+    std::string prelude = "#define HEIGHTFIELD\n" + get_file_contents((shader_path + "heightfield/heightfield.glsl").c_str()) + "\n#line 2\n";
+
+    for (auto name : shader_list) {
+        shaders.insert({name + HEIGHTFIELD_SUFFIX, 
+            Shader(
+            shaderFile(shader_path, name, VERT).c_str(),
+            shaderFile(shader_path, name, FRAG).c_str(),
+            shaderFile(shader_path, name, GEOM).c_str(),
+            prelude.c_str()
+            )}
+        );
+    }
+}
+
+/*
+Build batched variants of the given shaders, named with BATCHED_SUFFIX.
+The vertex shader is compiled with BATCHED defined and reads the model matrix
+of each draw from the draw buffer of RenderQueue instead of the object block.
+
+Parameters
+----------
+shaders : Shaders&
+    Map of shader programs to add variants to
+shader_path : std::string
+    Path to shader directory
+shader_list : std::vector<std::string>
+    Names of shaders to build variants of
+
+Returns
+-------
+None
+*/
+void initializeBatchedShaders(Shaders & shaders, std::string shader_path, std::vector<std::string> shader_list){
+    std::string prelude = "#define BATCHED\n#line 2\n";
+
+    for (auto name : shader_list) {
+        shaders.insert({name + BATCHED_SUFFIX, 
+            Shader(
+            shaderFile(shader_path, name, VERT).c_str(),
+            shaderFile(shader_path, name, FRAG).c_str(),
+            shaderFile(shader_path, name, GEOM).c_str(),
+            prelude.c_str()
+            )}
+        );
+    }
+}
@@ -0,0 +1,416 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "SpectrumCache.hpp"
+#include "FileCache.hpp"
+#include "NMRMesh.hpp"
+#include "Terrain.hpp"
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#define CACHE_MAGIC "RSNCACHE"
+#define CACHE_VERSION 2
+#define CACHE_MAX_LEVELS 32
+
+// Sections start on page boundaries so tiles never share pages across sections
+#define CACHE_ALIGN 4096
+
+struct CacheLevel
+{
+    int32_t xSize, ySize;
+    int32_t xShift, yShift;
+    uint64_t values;            // File offset of tiled points
+    uint64_t normals;           // File offset of tiled normals
+};
+
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t tile;              // TERRAIN_TILE of the writer
+
+    // Source key, the cache is stale when any of these differ
+    uint64_t pathHash;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+
+    float fdata[FDATASIZE];
+    int32_t sizeList[MAXDIM], qSizeList[MAXDIM];
+    int32_t dimCount, qSize;
+    int64_t totalSize;
+    float minVal, maxVal;
+
+    uint32_t levelCount;
+    uint32_t reserved;
+    CacheLevel levels[CACHE_MAX_LEVELS];
+};
+
+static uint64_t alignOffset(uint64_t offset)
+{
+    return (offset + CACHE_ALIGN - 1) / CACHE_ALIGN * CACHE_ALIGN;
+}
+
+// Points stored for a level, partial tiles at the edges are padded to full tiles
+static size_t tiledPoints(int xSize, int ySize)
+{
+    size_t tilesX = (xSize + TERRAIN_TILE - 1) / TERRAIN_TILE;
+    size_t tilesY = (ySize + TERRAIN_TILE - 1) / TERRAIN_TILE;
+
+    return tilesX * tilesY * TERRAIN_TILE * TERRAIN_TILE;
+}
+
+/*
+Fill the source key of header from the spectrum file
+
+Parameters
+----------
+file : const std::string&
+    Path to NMR file
+header : CacheHeader&
+    Header receiving path hash, file size and modification time
+
+Returns
+-------
+success : bool
+    False if the file does not exist
+*/
+static bool sourceKey(const std::string& file, CacheHeader& header)
+{
+    std::error_code error;
+    fs::path path = fs::absolute(file, error).lexically_normal();
+
+    uintmax_t size = fs::file_size(path, error);
+    if (error) return false;
+
+    fs::file_time_type time = fs::last_write_time(path, error);
+    if (error) return false;
+
+    std::string name = path.string();
+
+    header.pathHash = FileCache::Hash64(name.data(), name.size());
+    header.sourceSize = size;
+    header.sourceTime = time.time_since_epoch().count();
+
+    return true;
+}
+
+// Run fn(i) for i in [0, count) across the hardware threads
+template <typename Fn>
+static void parallelFor(size_t count, Fn fn)
+{
+    size_t threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, count);
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; t++) {
+        threads.emplace_back([=] {
+            for (size_t i = t; i < count; i += threadCount) fn(i);
+        });
+    }
+
+    for (auto & thread : threads) thread.join();
+}
+
+SpectrumCache::~SpectrumCache()
+{
+    if (header == NULL) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile((LPCVOID)header);
+#else
+    munmap((void *)header, mapSize);
+#endif
+}
+
+/*
+Map the cache of a spectrum, looking next to the spectrum first and in SPECTRUM_CACHE_DIR second
+
+Parameters
+----------
+file : const std::string&
+    Path to NMR file
+
+Returns
+-------
+cache : SpectrumCache *
+    Mapped cache owned by the caller, NULL if no cache matches the path, size and time of file
+*/
+SpectrumCache * SpectrumCache::Open(const std::string& file)
+{
+    CacheHeader key;
+
+    if (!sourceKey(file, key)) return NULL;
+
+    SpectrumCache * cache = Map(SidecarPath(file), key);
+    if (cache == NULL) cache = Map(FallbackPath(file), key);
+
+    return cache;
+}
+
+/*
+Build the terrain pyramid and normals of a loaded 2D spectrum and write them
+to a cache file, next to the spectrum if its directory is writable.
+Tiles are computed in parallel one row of tiles at a time, so memory use
+stays at one row of tiles whatever the spectrum size.
+
+Parameters
+----------
+file : const std::string&
+    Path to NMR file
+data : const NMRData&
+    Spectrum read from file, with its intensity range
+
+Returns
+-------
+success : bool
+    False if the spectrum is not 2D or no cache file could be written
+*/
+bool SpectrumCache::Create(const std::string& file, const NMRData& data)
+{
+    int xSize = data.qSize * data.sizeList[XLOC];
+    int ySize = data.sizeList[YLOC];
+    CacheHeader header = {};
+
+    if (data.mat == NULL || data.dimCount < 2 || xSize < 2 || ySize < 2) return false;
+
+    if (!sourceKey(file, header)) return false;
+
+    // Same pyramid and normals as the terrain builds, no OpenGL objects exist before Select
+    Terrain terrain(data.mat, xSize, ySize, data.minVal, data.maxVal);
+
+    if (terrain.levels.size() > CACHE_MAX_LEVELS) return false;
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.tile = TERRAIN_TILE;
+
+    memcpy(header.fdata, data.fdata, sizeof(float)*FDATASIZE);
+    std::copy(data.sizeList, data.sizeList + MAXDIM, header.sizeList);
+    std::copy(data.qSizeList, data.qSizeList + MAXDIM, header.qSizeList);
+    header.dimCount = data.dimCount;
+    header.qSize = data.qSize;
+    header.totalSize = data.totalSize;
+    header.minVal = data.minVal;
+    header.maxVal = data.maxVal;
+    header.levelCount = terrain.levels.size();
+
+    uint64_t offset = alignOffset(sizeof(CacheHeader));
+
+    for (size_t l = 0; l < terrain.levels.size(); l++) {
+        Terrain::Level & L = terrain.levels[l];
+        CacheLevel & entry = header.levels[l];
+        size_t points = tiledPoints(L.xSize, L.ySize);
+
+        entry.xSize = L.xSize;
+        entry.ySize = L.ySize;
+        entry.xShift = L.xShift;
+        entry.yShift = L.yShift;
+
+        entry.values = offset;
+        offset = alignOffset(offset + points * sizeof(float));
+        entry.normals = offset;
+        offset = alignOffset(offset + points * 2 * sizeof(int16_t));
+    }
+
+    if (Write(SidecarPath(file), header, terrain)) return true;
+
+    std::error_code error;
+    fs::create_directories(SPECTRUM_CACHE_DIR, error);
+
+    return Write(FallbackPath(file), header, terrain);
+}
+
+void SpectrumCache::Fill(NMRData& data) const
+{
+    memcpy(data.fdata, header->fdata, sizeof(float)*FDATASIZE);
+    std::copy(header->sizeList, header->sizeList + MAXDIM, data.sizeList);
+    std::copy(header->qSizeList, header->qSizeList + MAXDIM, data.qSizeList);
+
+    data.dimCount = header->dimCount;
+    data.qSize = header->qSize;
+    data.totalSize = header->totalSize;
+    data.minVal = header->minVal;
+    data.maxVal = header->maxVal;
+}
+
+int SpectrumCache::LevelCount() const
+{
+    return header->levelCount;
+}
+
+void SpectrumCache::LevelSize(int level, int& xSize, int& ySize, int& xShift, int& yShift) const
+{
+    const CacheLevel & entry = header->levels[level];
+
+    xSize = entry.xSize;
+    ySize = entry.ySize;
+    xShift = entry.xShift;
+    yShift = entry.yShift;
+}
+
+const float * SpectrumCache::Values(int level) const
+{
+    return (const float *)((const char *)header + header->levels[level].values);
+}
+
+const int16_t * SpectrumCache::Normals(int level) const
+{
+    return (const int16_t *)((const char *)header + header->levels[level].normals);
+}
+
+bool SpectrumCache::Write(const std::string& path, const CacheHeader& header, Terrain& terrain)
+{
+    return FileCache::WriteAtomic(path, [&](std::ofstream& out) {
+        out.write((const char *)&header, sizeof(CacheHeader));
+
+        for (uint32_t l = 0; l < header.levelCount && out; l++) {
+            Terrain::Level & L = terrain.levels[l];
+            size_t tilesX = (L.xSize + TERRAIN_TILE - 1) / TERRAIN_TILE;
+            size_t tilesY = (L.ySize + TERRAIN_TILE - 1) / TERRAIN_TILE;
+            size_t tilePoints = TERRAIN_TILE * TERRAIN_TILE;
+
+            std::vector<float> values(tilesX * tilePoints);
+            std::vector<int16_t> normals(tilesX * tilePoints * 2);
+
+            for (size_t ty = 0; ty < tilesY && out; ty++) {
+                parallelFor(tilesX, [&](size_t tx) {
+                    for (int j = 0; j < TERRAIN_TILE; j++) {
+                        for (int i = 0; i < TERRAIN_TILE; i++) {
+                            // Padding repeats the edge points
+                            int x = std::min((int)tx * TERRAIN_TILE + i, L.xSize - 1);
+                            int y = std::min((int)ty * TERRAIN_TILE + j, L.ySize - 1);
+                            size_t index = tx * tilePoints + (size_t)j * TERRAIN_TILE + i;
+                            glm::vec3 normal = terrain.Normal(l, x, y);
+
+                            values[index] = terrain.Sample(l, x, y);
+                            normals[2 * index] = (int16_t)std::lround(normal.x * 32767.0f);
+                            normals[2 * index + 1] = (int16_t)std::lround(normal.z * 32767.0f);
+                        }
+                    }
+                });
+
+                // Rows of tiles are contiguous in both sections
+                out.seekp(header.levels[l].values + ty * values.size() * sizeof(float));
+                out.write((const char *)values.data(), values.size() * sizeof(float));
+                out.seekp(header.levels[l].normals + ty * normals.size() * sizeof(int16_t));
+                out.write((const char *)normals.data(), normals.size() * sizeof(int16_t));
+            }
+        }
+
+        // Pad the last section to the page size the offsets assume
+        CacheLevel last = header.levels[header.levelCount - 1];
+        uint64_t end = alignOffset(last.normals + tiledPoints(last.xSize, last.ySize) * 2 * sizeof(int16_t));
+        out.seekp(end - 1);
+        out.put(0);
+
+        return (bool)out;
+    });
+}
+
+std::string SpectrumCache::SidecarPath(const std::string& file)
+{
+    return file + SPECTRUM_CACHE_EXT;
+}
+
+std::string SpectrumCache::FallbackPath(const std::string& file)
+{
+    CacheHeader key = {};
+    (void) sourceKey(file, key);
+
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "%016llx" SPECTRUM_CACHE_EXT, (unsigned long long)key.pathHash);
+
+    return std::string(SPECTRUM_CACHE_DIR) + fileName;
+}
+
+/*
+Map a cache file and check it against the source key
+
+Parameters
+----------
+path : const std::string&
+    Path of cache file
+key : const CacheHeader&
+    Header holding the path hash, size and time of the spectrum
+
+Returns
+-------
+cache : SpectrumCache *
+    Mapped cache, NULL if the file is missing, truncated or stale
+*/
+SpectrumCache * SpectrumCache::Map(const std::string& path, const CacheHeader& key)
+{
+    std::error_code error;
+    uintmax_t size = fs::file_size(path, error);
+
+    if (error || size < sizeof(CacheHeader)) return NULL;
+
+    void * addr = NULL;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping != NULL) {
+        addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+
+    if (addr == NULL) return NULL;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return NULL;
+
+    addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (addr == MAP_FAILED) return NULL;
+
+    // Tiles are read in view order, not sequentially
+    (void) madvise(addr, size, MADV_RANDOM);
+#endif
+
+    SpectrumCache * cache = new SpectrumCache();
+    cache->header = (const CacheHeader *)addr;
+    cache->mapSize = size;
+
+    const CacheHeader & header = *cache->header;
+    bool valid = memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == CACHE_VERSION
+        && header.tile == TERRAIN_TILE
+        && header.pathHash == key.pathHash
+        && header.sourceSize == key.sourceSize
+        && header.sourceTime == key.sourceTime
+        && header.levelCount > 0 && header.levelCount <= CACHE_MAX_LEVELS;
+
+    for (uint32_t l = 0; valid && l < header.levelCount; l++) {
+        const CacheLevel & entry = header.levels[l];
+        size_t points = tiledPoints(entry.xSize, entry.ySize);
+
+        valid = entry.xSize > 0 && entry.ySize > 0
+            && entry.values + points * sizeof(float) <= size
+            && entry.normals + points * 2 * sizeof(int16_t) <= size;
+    }
+
+    if (!valid) {
+        delete cache;
+        return NULL;
+    }
+
+    cache->minVal = header.minVal;
+    cache->maxVal = header.maxVal;
+
+    return cache;
+}
@@ -0,0 +1,542 @@
+#include "Terrain.hpp"
+#include "SpectrumCache.hpp"
+#include "Profiler.hpp"
+#include <algorithm>
+#include <cmath>
+
+/*
+Create a level of detail terrain for a 2D spectrum
+
+Parameters
+----------
+mat : float *
+    Input 2D matrix [xSize*ySize], kept by reference
+xSize : int
+    X-Axis size of mat
+ySize : int
+    Y-Axis size of mat
+minVal : float
+    Lower clipping value for intensities in mat
+maxVal : float
+    Upper clipping value for intensities in mat
+
+Returns
+-------
+Terrain Object
+*/
+Terrain::Terrain(float * mat, int xSize, int ySize, float minVal, float maxVal)
+{
+    Terrain::mat = mat;
+    Terrain::minVal = minVal;
+    Terrain::maxVal = maxVal;
+
+    // *****************
+    // * Level Pyramid *
+    // *****************
+
+    levels.push_back(Level{xSize, ySize, 0, 0, {}});
+
+    // Halve each axis until the whole spectrum fits into a single tile
+    while (levels.back().xSize > TERRAIN_TILE + 1 || levels.back().ySize > TERRAIN_TILE + 1) {
+        int prev = levels.size() - 1;
+        Level & last = levels[prev];
+        int fx = (last.xSize > TERRAIN_TILE + 1) ? 2 : 1;
+        int fy = (last.ySize > TERRAIN_TILE + 1) ? 2 : 1;
+
+        // Enough points to reach the spectrum edge, the last cell of a level may be partial
+        Level next;
+        next.xSize  = (last.xSize - 1 + fx - 1) / fx + 1;
+        next.ySize  = (last.ySize - 1 + fy - 1) / fy + 1;
+        next.xShift = last.xShift + fx - 1;
+        next.yShift = last.yShift + fy - 1;
+        next.data.resize((size_t)next.xSize * next.ySize);
+
+        // Keep the value of largest magnitude in each block so peaks are not averaged away,
+        // a last point past the edge of the previous level takes the value at the edge
+        for (int y = 0; y < next.ySize; y++) {
+            for (int x = 0; x < next.xSize; x++) {
+                float best = Sample(prev, std::min(x * fx, last.xSize - 1), std::min(y * fy, last.ySize - 1));
+
+                for (int by = y * fy; by < std::min(y * fy + fy, last.ySize); by++) {
+                    for (int bx = x * fx; bx < std::min(x * fx + fx, last.xSize); bx++) {
+                        float value = Sample(prev, bx, by);
+                        if (std::fabs(value) > std::fabs(best)) best = value;
+                    }
+                }
+
+                next.data[(size_t)y * next.xSize + x] = best;
+            }
+        }
+
+        levels.push_back(std::move(next));
+    }
+}
+
+/*
+Create a level of detail terrain from a cache file. Levels and normals
+are read from the mapping, so only the pages of meshed tiles are loaded.
+
+Parameters
+----------
+cache : const SpectrumCache&
+    Mapped cache of a 2D spectrum, kept by reference
+
+Returns
+-------
+Terrain Object
+*/
+Terrain::Terrain(const SpectrumCache& cache)
+{
+    mat = NULL;
+    minVal = cache.minVal;
+    maxVal = cache.maxVal;
+
+    for (int level = 0; level < cache.LevelCount(); level++) {
+        Level next;
+
+        cache.LevelSize(level, next.xSize, next.ySize, next.xShift, next.yShift);
+        next.values = cache.Values(level);
+        next.normals = cache.Normals(level);
+
+        levels.push_back(std::move(next));
+    }
+}
+
+void Terrain::Init()
+{
+    // ************************
+    // * Shared Tile Topology *
+    // ************************
+
+    // Tile vertices: (T+1)^2 grid points followed by four skirts of T+1 points
+    // (bottom, top, left, right edge)
+    GLuint n = TERRAIN_TILE + 1;
+    std::vector<GLuint> indices;
+    indices.reserve(TERRAIN_TILE * TERRAIN_TILE * 6 + 4 * TERRAIN_TILE * 6);
+
+    // Two triangles per grid cell, same winding as mat2mesh
+    for (GLuint j = 0; j < TERRAIN_TILE; j++) {
+        for (GLuint i = 0; i < TERRAIN_TILE; i++) {
+            GLuint corner = j * n + i;
+            indices.insert(indices.end(), {corner, corner + n, corner + n + 1, corner, corner + n + 1, corner + 1});
+        }
+    }
+
+    // Skirt quads joining each edge to the points hanging below it
+    for (GLuint e = 0; e < 4; e++) {
+        for (GLuint k = 0; k < TERRAIN_TILE; k++) {
+            GLuint a, b;
+            GLuint sa = n * n + e * n + k;
+
+            switch (e) {
+                case 0:  a = k;               b = k + 1;               break;
+                case 1:  a = (n - 1) * n + k; b = (n - 1) * n + k + 1; break;
+                case 2:  a = k * n;           b = (k + 1) * n;         break;
+                default: a = k * n + n - 1;   b = (k + 1) * n + n - 1; break;
+            }
+
+            indices.insert(indices.end(), {a, sa, sa + 1, a, sa + 1, b});
+        }
+    }
+
+    indexCount = indices.size();
+    tileBytes = (size_t)(n * n + 4 * n) * sizeof(Vertex);
+
+    // Element buffer binding is VAO state, make sure no VAO picks it up
+    glBindVertexArray(0);
+    EBO ebo(indices);
+    ebo.Unbind();
+    eboID = ebo.ID;
+
+    // The coarsest tile is always resident so there is always something to draw
+    Build(levels.size() - 1, 0, 0);
+}
+
+Terrain::~Terrain()
+{
+    for (auto & [key, tile] : tiles) {
+        tile.vao.Delete();
+        glDeleteBuffers(1, &tile.vboID);
+    }
+
+    tiles.clear();
+
+    // Terrains that were never selected own no OpenGL objects
+    if (eboID != 0) glDeleteBuffers(1, &eboID);
+}
+
+int Terrain::LevelCount()
+{
+    return levels.size();
+}
+
+/*
+Choose tiles to draw for this frame. Tiles are refined while the camera is close
+to them relative to their size, tiles outside the view frustum are skipped.
+
+Parameters
+----------
+camera : Camera&
+    Camera the terrain is drawn to
+model : glm::mat4
+    Model matrix of the terrain
+
+Returns
+-------
+None
+*/
+void Terrain::Select(Camera &camera, glm::mat4 model)
+{
+    PROFILE_ZONE("Terrain::Select");
+
+    if (eboID == 0) Init();
+
+    frame++;
+    builds = 0;
+    refining = false;
+    selected.clear();
+
+    world = model;
+    clip = camera.cameraMatrix * model;
+    eye = camera.position;
+
+    Refine(levels.size() - 1, 0, 0);
+
+    Evict();
+
+    drawnTiles = selected.size();
+    residentTiles = tiles.size();
+}
+
+/*
+Draw the tiles chosen by Select. Shader uniforms (camera and transforms)
+must already be set on the active shader. Points are drawn from the grid
+vertices only, so skirts and shared corners are not drawn as points.
+
+Parameters
+----------
+primative : GLenum
+    Primative type to draw tiles with
+
+Returns
+-------
+None
+*/
+void Terrain::Draw(GLenum primative)
+{
+    int n = TERRAIN_TILE + 1;
+
+    for (auto tile : selected) {
+        tile->vao.Bind();
+
+        if (primative == GL_POINTS)
+            glDrawArrays(GL_POINTS, 0, n * n);
+        else
+            glDrawElements(primative, indexCount, GL_UNSIGNED_INT, 0);
+    }
+
+    glBindVertexArray(0);
+}
+
+void Terrain::DrawNormals()
+{
+    int n = TERRAIN_TILE + 1;
+
+    // Skirt vertices after the n * n grid points are skipped
+    for (auto tile : selected) {
+        tile->vao.Bind();
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, NORMALS_BINDING, tile->vboID);
+        glDrawArraysInstanced(GL_LINES, 0, 2, n * n);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, NORMALS_BINDING, 0);
+    glBindVertexArray(0);
+}
+
+bool Terrain::Refine(int level, int tx, int ty)
+{
+    glm::vec3 lo, hi;
+
+    Box(level, tx, ty, lo, hi);
+
+    if (Culled(lo, hi)) return true;
+
+    glm::vec3 center = glm::vec3(world * glm::vec4(0.5f * (lo + hi), 1.0f));
+    float size = glm::length(glm::vec3(world * glm::vec4(hi - lo, 0.0f)));
+
+    if (level > 0 && glm::length(eye - center) < lodFactor * size) {
+        // Axes that were not halved at this level have a single child along them
+        int cx = (levels[level - 1].xShift == levels[level].xShift) ? 1 : 2;
+        int cy = (levels[level - 1].yShift == levels[level].yShift) ? 1 : 2;
+        size_t mark = selected.size();
+        bool complete = true;
+
+        for (int j = 0; j < cy && complete; j++) {
+            for (int i = 0; i < cx && complete; i++) {
+                if (!Exists(level - 1, tx * cx + i, ty * cy + j)) continue;
+                complete = Refine(level - 1, tx * cx + i, ty * cy + j);
+            }
+        }
+
+        if (complete) return true;
+
+        // Children are not ready yet, draw this tile instead
+        selected.resize(mark);
+    }
+
+    return Use(level, tx, ty);
+}
+
+bool Terrain::Use(int level, int tx, int ty)
+{
+    auto entry = tiles.find(Key(level, tx, ty));
+    Tile * tile;
+
+    if (entry != tiles.end()) {
+        tile = &entry->second;
+    } else {
+        if (builds >= buildsPerFrame) {
+            refining = true;
+            return false;
+        }
+        builds++;
+        tile = &Build(level, tx, ty);
+    }
+
+    tile->lastUsed = frame;
+    selected.push_back(tile);
+
+    return true;
+}
+
+Terrain::Tile& Terrain::Build(int level, int tx, int ty)
+{
+    Level & L = levels[level];
+    int n = TERRAIN_TILE + 1;
+    int x0 = tx * TERRAIN_TILE;
+    int y0 = ty * TERRAIN_TILE;
+    glm::vec3 lo, hi;
+
+    Box(level, tx, ty, lo, hi);
+
+    std::vector<Vertex> vertices(n * n + 4 * n);
+
+    // Grid points, clamped to the spectrum edge for partial tiles
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int x = std::min(x0 + i, L.xSize - 1);
+            int y = std::min(y0 + j, L.ySize - 1);
+            vertices[j * n + i] = Vertex{Position(level, x, y), Normal(level, x, y), ONES, glm::vec2(0.0f)};
+        }
+    }
+
+    // Skirts hang to the lowest point of the tile, edges on the spectrum border get no skirt
+    bool border[4] = {
+        ty == 0, y0 + TERRAIN_TILE >= L.ySize - 1,
+        tx == 0, x0 + TERRAIN_TILE >= L.xSize - 1
+    };
+
+    for (int e = 0; e < 4; e++) {
+        for (int k = 0; k < n; k++) {
+            int edge;
+
+            switch (e) {
+                case 0:  edge = k;               break;
+                case 1:  edge = (n - 1) * n + k; break;
+                case 2:  edge = k * n;           break;
+                default: edge = k * n + n - 1;   break;
+            }
+
+            Vertex skirt = vertices[edge];
+            if (!border[e]) skirt.position.y = lo.y;
+            vertices[n * n + e * n + k] = skirt;
+        }
+    }
+
+    Tile & tile = tiles[Key(level, tx, ty)];
+
+    tile.vao.Bind();
+
+    VBO<Vertex> vbo(vertices);
+
+    tile.vao.LinkAttrib(vbo, 0, 3, GL_FLOAT, sizeof(Vertex), (void *)0);
+    tile.vao.LinkAttrib(vbo, 1, 3, GL_FLOAT, sizeof(Vertex), (void *)(3 * sizeof(float)));
+    tile.vao.LinkAttrib(vbo, 2, 3, GL_FLOAT, sizeof(Vertex), (void *)(6 * sizeof(float)));
+    tile.vao.LinkAttrib(vbo, 3, 2, GL_FLOAT, sizeof(Vertex), (void *)(9 * sizeof(float)));
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, eboID);
+
+    tile.vao.Unbind();
+    vbo.Unbind();
+
+    tile.vboID = vbo.ID;
+    tile.lastUsed = frame;
+
+    return tile;
+}
+
+void Terrain::Evict()
+{
+    unsigned long long root = Key(levels.size() - 1, 0, 0);
+    std::vector<std::pair<unsigned long, unsigned long long>> unused;
+
+    for (auto & [key, tile] : tiles) {
+        if (tile.lastUsed != frame && key != root) unused.push_back({tile.lastUsed, key});
+    }
+
+    if (unused.size() * tileBytes <= residentBudget) return;
+
+    // Oldest first
+    std::sort(unused.begin(), unused.end());
+
+    size_t excess = unused.size() - residentBudget / tileBytes;
+
+    for (size_t i = 0; i < excess; i++) {
+        Tile & tile = tiles[unused[i].second];
+        tile.vao.Delete();
+        glDeleteBuffers(1, &tile.vboID);
+        tiles.erase(unused[i].second);
+    }
+}
+
+bool Terrain::Exists(int level, int tx, int ty)
+{
+    Level & L = levels[level];
+
+    return tx * TERRAIN_TILE < std::max(L.xSize - 1, 1) && ty * TERRAIN_TILE < std::max(L.ySize - 1, 1);
+}
+
+void Terrain::Box(int level, int tx, int ty, glm::vec3 &lo, glm::vec3 &hi)
+{
+    Level & L = levels[level];
+    int x0 = tx * TERRAIN_TILE;
+    int y0 = ty * TERRAIN_TILE;
+    int x1 = std::min(x0 + TERRAIN_TILE, L.xSize - 1);
+    int y1 = std::min(y0 + TERRAIN_TILE, L.ySize - 1);
+
+    auto entry = bounds.find(Key(level, tx, ty));
+
+    // Height range is found once per tile
+    if (entry == bounds.end()) {
+        Bounds range = {Height(Sample(level, x0, y0)), Height(Sample(level, x0, y0))};
+
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                float height = Height(Sample(level, x, y));
+                range.yMin = std::min(range.yMin, height);
+                range.yMax = std::max(range.yMax, height);
+            }
+        }
+
+        entry = bounds.insert({Key(level, tx, ty), range}).first;
+    }
+
+    glm::vec3 first = Position(level, x0, y0);
+    glm::vec3 last = Position(level, x1, y1);
+
+    // Z decreases along the Y-axis of the matrix
+    lo = glm::vec3(first.x, entry->second.yMin, last.z);
+    hi = glm::vec3(last.x, entry->second.yMax, first.z);
+}
+
+bool Terrain::Culled(glm::vec3 lo, glm::vec3 hi)
+{
+    glm::vec4 corners[8];
+
+    for (int c = 0; c < 8; c++) {
+        corners[c] = clip * glm::vec4(
+            (c & 1) ? hi.x : lo.x,
+            (c & 2) ? hi.y : lo.y,
+            (c & 4) ? hi.z : lo.z,
+            1.0f
+        );
+    }
+
+    // Culled if every corner is outside the same clip plane
+    for (int axis = 0; axis < 3; axis++) {
+        bool below = true, above = true;
+
+        for (int c = 0; c < 8; c++) {
+            below = below && (corners[c][axis] < -corners[c].w);
+            above = above && (corners[c][axis] >  corners[c].w);
+        }
+
+        if (below || above) return true;
+    }
+
+    return false;
+}
+
+float Terrain::Sample(int level, int x, int y)
+{
+    if (levels[level].values != NULL) return levels[level].values[TileOffset(levels[level], x, y)];
+
+    if (level == 0) return mat[(size_t)y * levels[0].xSize + x];
+
+    return levels[level].data[(size_t)y * levels[level].xSize + x];
+}
+
+glm::vec3 Terrain::Position(int level, int x, int y)
+{
+    Level & L = levels[level];
+    int xSize = levels[0].xSize;
+    int ySize = levels[0].ySize;
+
+    // Points are at their true grid position, a last point past the spectrum edge is clamped to it
+    int ox = std::min(x << L.xShift, xSize - 1);
+    int oy = std::min(y << L.yShift, ySize - 1);
+
+    // Graphics X from -1.0 to 1.0 and Z from 1.0 to -1.0, as mat2mesh
+    return glm::vec3(
+        (xSize > 1) ? -1.0f + 2.0f * ox / (xSize - 1) : 0.0f,
+        Height(Sample(level, x, y)),
+        (ySize > 1) ?  1.0f - 2.0f * oy / (ySize - 1) : 0.0f
+    );
+}
+
+glm::vec3 Terrain::Normal(int level, int x, int y)
+{
+    Level & L = levels[level];
+
+    // Cached normals point up, Y follows from X and Z
+    if (L.normals != NULL) {
+        const int16_t * normal = L.normals + 2 * TileOffset(L, x, y);
+        float nx = normal[0] / 32767.0f;
+        float nz = normal[1] / 32767.0f;
+
+        return glm::vec3(nx, std::sqrt(std::max(1.0f - nx * nx - nz * nz, 0.0f)), nz);
+    }
+
+    // Central differences, one sided at the spectrum edge
+    glm::vec3 left  = Position(level, std::max(x - 1, 0), y);
+    glm::vec3 right = Position(level, std::min(x + 1, L.xSize - 1), y);
+    glm::vec3 front = Position(level, x, std::max(y - 1, 0));
+    glm::vec3 back  = Position(level, x, std::min(y + 1, L.ySize - 1));
+
+    float dYdX = (right.x != left.x) ? (right.y - left.y) / (right.x - left.x) : 0.0f;
+    float dYdZ = (back.z != front.z) ? (back.y - front.y) / (back.z - front.z) : 0.0f;
+
+    return glm::normalize(glm::vec3(-dYdX, 1.0f, -dYdZ));
+}
+
+size_t Terrain::TileOffset(const Level& L, int x, int y)
+{
+    size_t tilesX = (L.xSize + TERRAIN_TILE - 1) / TERRAIN_TILE;
+    size_t tile = (size_t)(y / TERRAIN_TILE) * tilesX + x / TERRAIN_TILE;
+
+    return tile * TERRAIN_TILE * TERRAIN_TILE + (y % TERRAIN_TILE) * TERRAIN_TILE + x % TERRAIN_TILE;
+}
+
+float Terrain::Height(float value)
+{
+    value = std::min(std::max(value, minVal), maxVal);
+
+    if (minVal == maxVal) return value - minVal;
+
+    return 2.0f * (value - minVal) / (maxVal - minVal) - 1.0f;
+}
+
+unsigned long long Terrain::Key(int level, int tx, int ty)
+{
+    return ((unsigned long long)level << 48) | ((unsigned long long)tx << 24) | (unsigned long long)ty;
+}
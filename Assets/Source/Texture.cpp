@@ -34,23 +34,78 @@ Texture::Texture(const char * image, const char * texType, GLuint slot, GLenum m
     // Assigns the type of the texture ot the texture object
     type = texType;
 
-    int width, height, numColCh;
-    stbi_set_flip_vertically_on_load(true);
-    // Loads image using file path while populating the following parameters:
+    // Texture containers hold about 16 textures concurrently, texture is bound to the container based on slot
+    unit = slot;
+
+    // Identical images with identical filtering share one OpenGL texture
+    ID = AssetCache::Acquire(
+        AssetCache::Key("texture", image, minLOD, magLOD),
+        [&](std::shared_ptr<void>&) { return Load(image, minLOD, magLOD); }
+    );
+}
+
+/*
+Start decoding image in the background if it is not loaded yet.
+Call for every texture about to be created so they decode in parallel.
+
+Parameters
+----------
+image : const char *
+    Image file path represented as character array
+
+minLOD : GLenum
+    Texture level of detail minimization algorithm
+
+magLOD : GLenum
+    Texture level of detail magnification algorithm
+
+Returns
+-------
+None
+*/
+void Texture::Prefetch(const char * image, GLenum minLOD, GLenum magLOD)
+{
+    if (AssetCache::Contains(AssetCache::Key("texture", image, minLOD, magLOD))) return;
+
+    ImageDecoder::Shared().Request(image, true);
+}
+
+/*
+Decode image and upload it into a new OpenGL texture
+
+Parameters
+----------
+image : const char *
+    Image file path represented as character array
+
+minLOD : GLenum
+    Texture level of detail minimization algorithm
+
+magLOD : GLenum
+    Texture level of detail magnification algorithm
+
+Returns
+-------
+ID : GLuint
+    OpenGL texture name
+*/
+GLuint Texture::Load(const char * image, GLenum minLOD, GLenum magLOD)
+{
+    // Collect the image from the decoder, populating the following parameters:
     // width, height, number of color channels
-    unsigned char* bytes = stbi_load(image, &width, &height, &numColCh, 0);
+    Image decoded = ImageDecoder::Shared().Get(image, true);
+    int width = decoded.width;
+    int height = decoded.height;
+    int numColCh = decoded.channels;
+    unsigned char* bytes = decoded.pixels;
 
     // ************************
     // * Load OpenGL Textures *
     // ************************
     // Generate 1 texture with given ID
+    GLuint ID;
     glGenTextures(1, &ID);
-
-    // Activate texture unit, aka the texture container
-    // Texture containers hold about 16 textures concurrently
-    glActiveTexture(GL_TEXTURE0 + slot); // Use texture container based on slot
-    unit = slot;
-    glBindTexture(GL_TEXTURE_2D, ID); // Bind texture to texture container based on slot
+    glBindTexture(GL_TEXTURE_2D, ID);
 
     // ********************
     // * Texture Settings *
@@ -89,6 +144,8 @@ Texture::Texture(const char * image, const char * texType, GLuint slot, GLenum m
         colCh = GL_RED;
         break;
     default:
+        stbi_image_free(bytes);
+        glDeleteTextures(1, &ID);
         throw std::invalid_argument("Automatic Texture type recognition failed please use RGBA, RGB, or RED");
         break;
     }
@@ -115,6 +172,8 @@ Texture::Texture(const char * image, const char * texType, GLuint slot, GLenum m
 
     // Unbinds the OpenGL Texture object so that it can't accidentally be modified
 	glBindTexture(GL_TEXTURE_2D, 0);
+
+    return ID;
 }
 
 /*
@@ -191,5 +250,7 @@ None
 */
 void Texture::Delete()
 {
-    glDeleteTextures(1, &ID);
+    // Texture is shared through the asset cache, only the last reference deletes it
+    AssetCache::Release(ID);
+    ID = 0;
 }
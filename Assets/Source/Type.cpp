@@ -1,4 +1,6 @@
 #include "Type.hpp"
+#include <cstring>
+#include <cstddef>
 
 glm::mat4 Type::projection = glm::ortho(0.0f, 800.0f, 0.0f, 800.0f);
 GLenum Type::unit = GL_TEXTURE0;
@@ -7,15 +9,50 @@ std::vector<GLuint> Type::indices = { 0, 2, 1, 0, 3, 2 };
 Type::Type(const char *fontFile)
 {
     int result = 0;
-    result = LoadFont(fontFile);
 
-    result += GenerateChars();
+    // Fonts are rasterized once, other Type objects using the same file share the atlas and glyph metrics
+    std::shared_ptr<void> glyphs;
+    atlas = AssetCache::Acquire(
+        AssetCache::Key("font", fontFile),
+        [&](std::shared_ptr<void>& data) -> GLuint {
+            if (LoadFont(fontFile) || GenerateChars()) return 0;
+            // Glyphs are only rendered once, the face is not needed afterwards
+            FT_Done_Face(face);
+            FT_Done_FreeType(ft);
+            data = std::make_shared<std::map<char, Character>>(Characters);
+            return atlas;
+        },
+        &glyphs
+    );
+    if (atlas == 0) result = -1;
+    else Characters = *std::static_pointer_cast<std::map<char, Character>>(glyphs);
 
     result += GenerateBuffers();
 
     if (result) throw(errno);
 }
 
+/*
+Release the glyph atlas and buffers
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+void Type::Delete()
+{
+    AssetCache::Release(atlas);
+    atlas = 0;
+
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+}
+
 int Type::LoadFont(const char * fontFile)
 {
     if (FT_Init_FreeType(&ft))
@@ -38,45 +75,83 @@ int Type::LoadFont(const char * fontFile)
 
 int Type::GenerateChars()
 {
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // disable byte-alignment restriction
-  
+    struct Glyph
+    {
+        std::vector<unsigned char> bitmap;
+        int x, y, width, rows;
+    };
+    std::vector<Glyph> glyphs(128);
+
+    // Render every glyph once and pack them into rows of the atlas
+    int pen_x = 0;
+    int pen_y = 0;
+    int row_height = 0;
     for (unsigned char c = 0; c < 128; c++)
     {
         // load character glyph 
         if (FT_Load_Char(face, c, FT_LOAD_RENDER))
         {
-            printf("ERROR::FREETYTPE: Failed to load Glyph %s\n", reinterpret_cast<char *>(c));
+            printf("ERROR::FREETYTPE: Failed to load Glyph %d\n", c);
             continue;
         }
-        // generate texture
-        unsigned int texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
-            0,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer
-        );
-        // set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        FT_Bitmap& bitmap = face->glyph->bitmap;
+        Glyph& glyph = glyphs[c];
+        glyph.width = bitmap.width;
+        glyph.rows = bitmap.rows;
+
+        // Start a new row when the glyph does not fit, keep one pixel between glyphs to avoid bleeding
+        if (pen_x + glyph.width + 1 > ATLAS_WIDTH) {
+            pen_x = 0;
+            pen_y += row_height + 1;
+            row_height = 0;
+        }
+        glyph.x = pen_x;
+        glyph.y = pen_y;
+        pen_x += glyph.width + 1;
+        if (glyph.rows > row_height) row_height = glyph.rows;
+
+        // Copy bitmap rows, pitch may be wider than the glyph
+        glyph.bitmap.resize(glyph.width * glyph.rows);
+        for (int row = 0; row < glyph.rows; row++) {
+            memcpy(&glyph.bitmap[row * glyph.width], bitmap.buffer + row * bitmap.pitch, glyph.width);
+        }
+
         // now store character for later use
         Character character = {
-            texture, 
-            glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
+            glm::vec2(0.0f),
+            glm::vec2(0.0f),
+            glm::ivec2(glyph.width, glyph.rows),
             glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
             static_cast<GLuint>(face->glyph->advance.x)
         };
         Characters.insert(std::pair<char, Character>(c, character));
     }
+    int atlas_height = pen_y + row_height;
+    if (atlas_height < 1) atlas_height = 1;
+
+    // Allocate atlas and copy every glyph into its place
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // disable byte-alignment restriction
+    glGenTextures(1, &atlas);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    std::vector<unsigned char> blank(ATLAS_WIDTH * atlas_height, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, atlas_height, 0, GL_RED, GL_UNSIGNED_BYTE, blank.data());
+
+    for (auto& pair : Characters)
+    {
+        Glyph& glyph = glyphs[static_cast<unsigned char>(pair.first)];
+        if (glyph.width > 0 && glyph.rows > 0) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, glyph.x, glyph.y, glyph.width, glyph.rows, GL_RED, GL_UNSIGNED_BYTE, glyph.bitmap.data());
+        }
+        pair.second.uvMin = glm::vec2((float)glyph.x / ATLAS_WIDTH, (float)glyph.y / atlas_height);
+        pair.second.uvMax = glm::vec2((float)(glyph.x + glyph.width) / ATLAS_WIDTH, (float)(glyph.y + glyph.rows) / atlas_height);
+    }
+
+    // set texture options
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
 
     return 0;
 }
@@ -91,21 +166,46 @@ int Type::GenerateBuffers()
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_DYNAMIC_DRAW);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 4 * 5, NULL, GL_DYNAMIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void *)offsetof(TextVertex, position));
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void *)offsetof(TextVertex, texUV));
     glEnableVertexAttribArray(1);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void *)offsetof(TextVertex, color));
+    glEnableVertexAttribArray(2);
+
     glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
+    Reserve(256);
+
     return 0;
 }
 
+void Type::Reserve(size_t quads)
+{
+    if (quads <= capacity) return;
+
+    size_t newCapacity = capacity ? capacity : 1;
+    while (newCapacity < quads) newCapacity *= 2;
+
+    // Index pattern is identical for every quad, only written when the buffer grows
+    std::vector<GLuint> quadIndices(newCapacity * indices.size());
+    for (size_t q = 0; q < newCapacity; q++) {
+        for (size_t i = 0; i < indices.size(); i++) {
+            quadIndices[q * indices.size() + i] = static_cast<GLuint>(q * 4 + indices[i]);
+        }
+    }
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, quadIndices.size() * sizeof(GLuint), quadIndices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    capacity = newCapacity;
+}
+
 void Type::SetProjection(float left, float right, float bottom, float top)
 {
     Type::projection = glm::ortho(left, right, bottom, top);
@@ -121,83 +221,100 @@ glm::mat4 Type::GetProjection()
     return Type::projection;
 }
 
-glm::vec4 Type::RenderText(Shader &shader, std::string text, float x, float y, float scale, glm::vec3 color, bool centerCoords)
+const Type::Layout& Type::GetLayout(const std::string& text)
 {
-    // activate corresponding render state	
-    shader.Activate();
-    shader.setVec3("textColor", color.x, color.y, color.z);
-    glActiveTexture(Type::unit);
-    glBindVertexArray(VAO);
-
-    if (centerCoords) {
-        std::string::const_iterator c;
-        float left = 0;
-        float bottom = 0;
-        float right = 0;
-        float top = 0;
-        for (c = text.begin(); c != text.end(); c++) {
-            Character ch = Characters[*c];
-            
-            float xpos = ch.Bearing.x * scale;
-            float ypos = - (ch.Size.y - ch.Bearing.y) * scale;
-            float h = ch.Size.y * scale;
-
-            right += (ch.Advance >> 6) * scale;
-            if (ypos < bottom) bottom = ypos;
-            if ((ypos + h) > top) top = ypos + h;
+    auto found = layouts.find(text);
+    if (found != layouts.end()) return found->second;
 
-        }
-        float width = right - left;
-        float height = (top - bottom);
+    // Strings that change every frame would grow the cache without bound
+    if (layouts.size() >= LAYOUT_CACHE_SIZE) layouts.clear();
 
-        x = x - width / 2;
-        y = y - height / 2 - bottom;
-    }
+    Layout& layout = layouts[text];
+    layout.vertices.reserve(text.size() * 4);
+    layout.bottom = 0;
+    layout.top = 0;
+    layout.minY = INFINITY;
+    layout.maxY = -INFINITY;
 
-    float x_start = x;
-    float min_y = INFINITY;
-    float max_y = 0;
-    // iterate through all characters
-    std::string::const_iterator c;
-    for (c = text.begin(); c != text.end(); c++)
+    float x = 0;
+    for (char c : text)
     {
-        Character ch = Characters[*c];
-
-        float xpos = x + ch.Bearing.x * scale;
-        float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-
-        float w = ch.Size.x * scale;
-        float h = ch.Size.y * scale;
-        // update VBO for each character
-        float vertices[4][5] = {
-            { xpos,     ypos + h,   0.0f, 0.0f, 0.0f },            
-            { xpos,     ypos,       0.0f, 0.0f, 1.0f },
-            { xpos + w, ypos,       0.0f, 1.0f, 1.0f },
-            { xpos + w, ypos + h,   0.0f, 1.0f, 0.0f }           
-        };
-        // render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.textureID);
-        // update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        // bind EBO
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        // render quad
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        Character ch = Characters[c];
+
+        float xpos = x + ch.Bearing.x;
+        float ypos = - (ch.Size.y - ch.Bearing.y);
+
+        float w = ch.Size.x;
+        float h = ch.Size.y;
+        // Quad corners, color is filled in when the layout is queued
+        layout.vertices.push_back({ glm::vec2(xpos,     ypos + h), glm::vec2(ch.uvMin.x, ch.uvMin.y), ZEROS });
+        layout.vertices.push_back({ glm::vec2(xpos,     ypos),     glm::vec2(ch.uvMin.x, ch.uvMax.y), ZEROS });
+        layout.vertices.push_back({ glm::vec2(xpos + w, ypos),     glm::vec2(ch.uvMax.x, ch.uvMax.y), ZEROS });
+        layout.vertices.push_back({ glm::vec2(xpos + w, ypos + h), glm::vec2(ch.uvMax.x, ch.uvMin.y), ZEROS });
 
         // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-        x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64)
-        if (ypos < min_y) min_y = ypos;
-        if ((ypos + h) > max_y) max_y = ypos + h;
+        x += (ch.Advance >> 6); // bitshift by 6 to get value in pixels (2^6 = 64)
+        if (ypos < layout.bottom) layout.bottom = ypos;
+        if ((ypos + h) > layout.top) layout.top = ypos + h;
+        if (ypos < layout.minY) layout.minY = ypos;
+        if ((ypos + h) > layout.maxY) layout.maxY = ypos + h;
     }
-    
+    layout.advance = x;
+
+    return layout;
+}
+
+glm::vec4 Type::RenderText(std::string text, float x, float y, float scale, glm::vec3 color, bool centerCoords)
+{
+    const Layout& layout = GetLayout(text);
+
+    if (centerCoords) {
+        float width = layout.advance * scale;
+        float height = (layout.top - layout.bottom) * scale;
+
+        x = x - width / 2;
+        y = y - height / 2 - layout.bottom * scale;
+    }
+
+    // Place the cached quads, the GPU sees them on the next Flush
+    size_t start = queue.size();
+    queue.resize(start + layout.vertices.size());
+    for (size_t i = 0; i < layout.vertices.size(); i++) {
+        const TextVertex& v = layout.vertices[i];
+        queue[start + i] = { glm::vec2(x, y) + v.position * scale, v.texUV, color };
+    }
+
+    if (text.empty()) return glm::vec4(x, 0.0f, y, 0.0f);
+
+    return glm::vec4(x, layout.advance * scale, y + layout.minY * scale, (layout.maxY - layout.minY) * scale);
+}
+
+void Type::Flush(Shader &shader)
+{
+    if (queue.empty()) return;
+
+    size_t quads = queue.size() / 4;
+    Reserve(quads);
+
+    // activate corresponding render state	
+    shader.Activate();
+    glActiveTexture(Type::unit);
+    glBindTexture(GL_TEXTURE_2D, atlas);
+    glBindVertexArray(VAO);
+
+    // Orphan last frame's storage so the driver does not wait for it, then stream this frame's quads
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, capacity * 4 * sizeof(TextVertex), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, queue.size() * sizeof(TextVertex), queue.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // render every queued glyph
+    glDrawElements(GL_TRIANGLES, quads * indices.size(), GL_UNSIGNED_INT, 0);
+
     glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    return glm::vec4(x_start, (x-x_start), min_y, (max_y - min_y));
+    queue.clear();
 }
 
 void Type::RenderCenter(Shader &shader, glm::vec2 center_point, glm::vec3 color)
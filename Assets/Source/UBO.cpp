@@ -0,0 +1,166 @@
+#include "UBO.hpp"
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+
+template class UBO<CameraBlock>;
+template class UBO<ObjectBlock>;
+
+/*
+Main constructor for UBO, the block is allocated once and
+rewritten with glBufferSubData on every update
+
+Parameters
+----------
+binding : GLuint
+    Uniform block binding point, shaders declare the block
+    with layout(std140, binding = binding)
+
+Returns
+-------
+UBO Object
+*/
+template <typename Block>
+UBO<Block>::UBO(GLuint binding)
+{
+    UBO::binding = binding;
+    glGenBuffers(1, &ID);
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    Bind();
+}
+
+/*
+Upload block to the uniform buffer. Consecutive draws of objects
+sharing a transform do not touch the buffer.
+
+Parameters
+----------
+block : const Block&
+    New contents of the uniform block
+
+Returns
+-------
+None
+*/
+template <typename Block>
+void UBO<Block>::Update(const Block& block)
+{
+    if (valid && std::memcmp(&last, &block, sizeof(Block)) == 0) {
+        return;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, ID);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    last = block;
+    valid = true;
+}
+
+/*
+Attach buffer to its binding point
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+template <typename Block>
+void UBO<Block>::Bind()
+{
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+}
+
+/*
+Delete buffer
+
+Parameters
+----------
+None
+
+Returns
+-------
+None
+*/
+template <typename Block>
+void UBO<Block>::Delete()
+{
+    glDeleteBuffers(1, &ID);
+    valid = false;
+}
+
+/*
+Object buffer shared by every draw call.
+Created on first use since a GL context must exist.
+
+Parameters
+----------
+None
+
+Returns
+-------
+object_buffer : UBO<ObjectBlock>&
+    Buffer attached to OBJECT_BINDING
+*/
+UBO<ObjectBlock>& ObjectBuffer()
+{
+    static UBO<ObjectBlock> * object_buffer = new UBO<ObjectBlock>(OBJECT_BINDING);
+    return *object_buffer;
+}
+
+/*
+Combine global and local transforms into the model matrix of the object block.
+Equivalent to gTranslation * gRotation * gScale * (model * translation * rotation * scale)
+
+Parameters
+----------
+matrix : glm::mat4
+    Model matrix of the object
+
+translation : glm::vec3
+    Local translation
+
+rotation : glm::quat
+    Local rotation
+
+scale : glm::vec3
+    Local scale
+
+globalTranslation : glm::vec3
+    Global translation
+
+globalRotation : glm::quat
+    Global rotation
+
+globalScale : glm::vec3
+    Global scale
+
+Returns
+-------
+model : glm::mat4
+    Complete transform of the object
+*/
+glm::mat4 ObjectMatrix(
+    glm::mat4 matrix,
+    glm::vec3 translation,
+    glm::quat rotation,
+    glm::vec3 scale,
+    glm::vec3 globalTranslation,
+    glm::quat globalRotation,
+    glm::vec3 globalScale
+){
+    // Local transform
+    glm::mat4 local = matrix
+        * glm::translate(MAT_IDENTITY, translation)
+        * glm::mat4_cast(rotation)
+        * glm::scale(MAT_IDENTITY, scale);
+
+    // Global transform
+    glm::mat4 global = glm::translate(MAT_IDENTITY, globalTranslation)
+        * glm::mat4_cast(globalRotation)
+        * glm::scale(MAT_IDENTITY, globalScale);
+
+    return global * local;
+}
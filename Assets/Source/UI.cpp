@@ -1,6 +1,7 @@
 #include "UI.hpp"
+#include "NMRMesh.hpp"
 
-void DrawMainMenu(std::map<std::string, void *>& nmrFiles, std::vector<Light*> & lights, std::string & currFile, GLFWwindow * window) { // 
+void DrawMainMenu(std::map<std::string, NMRMesh *>& nmrFiles, std::vector<Light*> & lights, std::string & currFile, GLFWwindow * window) { // 
 
     // open Dialog Simple
     if (ImGui::BeginMainMenuBar())
@@ -28,6 +29,11 @@ void DrawMainMenu(std::map<std::string, void *>& nmrFiles, std::vector<Light*> &
             if (ImGui::MenuItem("Toggle Fullscreen", "Alt+Enter")) {
                 ToggleFullscreen(window);
             }
+            // Sleep between input events instead of redrawing every vsync
+            WindowData * win = (WindowData *)glfwGetWindowUserPointer(window);
+            ImGui::MenuItem("Render on Demand", NULL, &win->onDemand);
+            ImGui::MenuItem("Profiler", NULL, &Profiler::showUI);
+            ImGui::MenuItem("Memory Budget", NULL, &MemoryBudget::showUI);
             ImGui::EndMenu();
         }
         ImGui::EndMainMenuBar();
@@ -5,12 +5,14 @@
 #include "Line.hpp"
 #include "Mesh.hpp"
 #include "NMRMesh.hpp"
+#include "NMRLoader.hpp"
 #include "Model.hpp"
 #include "Cubemap.hpp"
 #include "Shader.hpp"
 #include "FBO.hpp"
 #include "Type.hpp"
 #include "Light.hpp"
+#include "Profiler.hpp"
 
 // Matrix Headers
 #include <glm/glm.hpp>
@@ -74,6 +76,8 @@ int main()
     glfwSetWindowSizeCallback(main_window, window_size_callback);
     glfwSetWindowIconifyCallback(main_window, window_iconify_callback);
     glfwSetKeyCallback(main_window, key_callback);
+    // Mark the scene dirty on input, installed before ImGui so its callbacks chain to these
+    InstallRedrawCallbacks(main_window);
 
     // *****************
     // * Initialize GL *
@@ -96,7 +100,7 @@ int main()
     std::vector<std::string> shader_list = {
         "default", "default2d", "points", "point2d",
         "light", "nmr", "stencil", "skybox", "projection",
-        "normals", "lines", "selection", "text", 
+        "normals", "lines", "selection", "text", "outline",
     };
 
     std::map<std::string, Shader> shaders;
@@ -104,19 +108,22 @@ int main()
     // Initialize all shader programs
     initializeShaders(shaders, shader_path, shader_list);
 
+    // Heightfield variants of the shaders used to draw spectra
+    initializeHeightfieldShaders(shaders, shader_path, {"default", "points", "selection", "normals"});
+
+    // Batched variant used to draw all spectra with one multi draw
+    initializeBatchedShaders(shaders, shader_path, {"default"});
+
     // ***********************
     // * Creating NMR Object *
     // ***********************
 
-    std::map<std::string, void *> nmrMeshes;
+    std::map<std::string, NMRMesh *> nmrMeshes;
     // std::string nmrFile;
     std::string currFile;
 
     // Initialize NMR Object
     glm::vec4 point_color = glm::vec4(0.85f, 0.85f, 0.90f, 1.0f);
-    glm::vec3 nmr_pos = ZEROS;
-    glm::mat4 nmr_model = MAT_IDENTITY;
-    nmr_model = glm::translate(nmr_model, nmr_pos);
 
     // **************************
     // * Export Data to Shaders *
@@ -124,7 +131,6 @@ int main()
 
     // Export NMR object to NMR shader
     shaders["nmr"].Activate();
-    shaders["nmr"].setMat4("model", nmr_model);
     // Export point color to nmr shader
     shaders["nmr"].setVec4("pointColor", point_color);
 
@@ -183,9 +189,14 @@ int main()
     Indices line_points = {0, 1, 0, 2, 0, 3};
     Line axis_lines(axis_points, line_points);
 
-    NMRMesh * nmrMesh = (NMRMesh *) NULL;
     NMRMesh * currMesh = (NMRMesh *) NULL;
 
+    // Spectra are read and meshed in the background, then streamed to the GPU
+    NMRLoader loader;
+
+    // Spectra drawn with the same state are combined into one multi draw
+    RenderQueue renderQueue;
+
     // Initialize camera view
     Camera camera(win.width, win.height, glm::vec3(0.0f, 0.0f, 4.0f));
 
@@ -216,6 +227,9 @@ int main()
 
     SelectionFBO selection;
     selection.Init(width, height);
+
+    // Outline of the selected spectrum, drawn from the stencil buffer
+    OutlinePass outlinePass;
     
     // *************
     // * Text Init *
@@ -238,6 +252,14 @@ int main()
     // While loop repeats until window is told to close or user closes window
     while (!glfwWindowShouldClose(main_window))
     {   
+        // Sleep until input, camera movement, or loading marks the scene dirty
+        if (win.onDemand && !ConsumeRedraw()) {
+            glfwWaitEventsTimeout(IDLE_TIMEOUT);
+            continue;
+        }
+
+        Profiler::BeginFrame();
+
         // Update window size
         glfwGetWindowSize(main_window, &win.width, &win.height);
 
@@ -299,14 +321,18 @@ int main()
         // * Camera Settings *
         // *******************
 
-        // Set input for camera
-        camera.Input(main_window);
+        Profiler::Begin("Camera");
+
+        // Set input for camera, keep drawing while the camera moves
+        if (camera.Input(main_window)) MarkDirty();
 
         // Update camera matrix based on view plane and FOV
         if (win.width > 0 && win.height > 0) {
             camera.UpdateMatrix(win.width, win.height);
         }
 
+        Profiler::End();
+
         // *******************
         // * Buffer Settings *
         // *******************
@@ -322,8 +348,10 @@ int main()
 
         glDisable(GL_STENCIL_TEST);
         // Draw skybox
+        Profiler::Begin("Skybox", true);
         if (win.width > 0 && win.height > 0)
             skybox.DrawSkybox(shaders["skybox"], camera, win.width, win.height);  
+        Profiler::End();
         glEnable(GL_STENCIL_TEST);
 
         DrawMainMenu(nmrMeshes, lights, currFile, main_window);
@@ -332,64 +360,90 @@ int main()
             light->Display(win, camera, shaders);
         }
 
-        // Create new NMRMesh if necessary
-        if ((nmrMeshes.find(currFile) != nmrMeshes.end()) && (!currFile.empty())) {
-            if (nmrMeshes.at(currFile) == NULL) {
-                nmrMesh = new NMRMesh(currFile);
+        // Load new NMRMeshes in the background and upload finished ones
+        Profiler::Begin("NMRLoader");
+        loader.RequestMissing(nmrMeshes);
+        loader.Poll(nmrMeshes);
+        Profiler::End();
+        if (loader.Busy()) MarkDirty(1);
+        
+        // Mouse selection 
+        // Ensure mouse is not over an ImGui window
+        io = ImGui::GetIO();
+        if (!io.WantCaptureMouse) {
+            if (glfwGetMouseButton(main_window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+                double x, y;
+                glfwGetCursorPos(main_window, &x, &y);
+                // 5x5 region so clicks just beside thin features still hit them
+                selection.RequestPick(static_cast<GLuint>(x),  static_cast<GLuint>(abs(win.height - y)), 2);
+            }
+        }
 
-                nmrMeshes[currFile] = static_cast<void*>(nmrMesh);
+        // ID pass is only drawn while a pick is pending, results arrive a frame or two later
+        Profiler::Begin("SelectMesh", true);
+        selection.SelectMesh(shaders["selection"], camera, nmrMeshes, &shaders["selection" HEIGHTFIELD_SUFFIX]);
+        Profiler::End();
 
-                nmrMesh->resetAttributes();
-            }
+        FBO::Pixel selected_pixel;
+        while (selection.PollPick(selected_pixel)) {
+            selection.currSel = selected_pixel.objID; 
+            NMRMesh::selID = selected_pixel.objID;
+            MarkDirty();
         }
-        
-        selection.SelectMesh(shaders["selection"], camera, nmrMeshes);
+        // Keep drawing until outstanding picks are read back
+        if (selection.Busy()) MarkDirty(1);
 
+        Profiler::Begin("NMRMesh::Display", true);
+        bool meshShown = false;
+        NMRMesh * selectedMesh = NULL;
         for (auto const& [key, val] : nmrMeshes) {
-            currMesh = static_cast<NMRMesh *>(val);
+            currMesh = val;
             if (currMesh != NULL) {
                 currMesh->updateUniforms(shaders);
-                currMesh->Display(win, camera, shaders);
-
-                glLineWidth(4.0f);
-                axis_lines.Draw(shaders["lines"], camera);
-                glLineWidth(1.0f);
+                currMesh->Display(win, camera, shaders, &renderQueue);
+                meshShown = true;
+                if (currMesh->ID == NMRMesh::selID) selectedMesh = currMesh;
             }
         }
-        
-        MeshList(nmrMeshes);
-        
-        io = ImGui::GetIO();
-        // Mouse selection 
-        // Ensure mouse is not over an ImGui window
-        if (!io.WantCaptureMouse) {
-            if (glfwGetMouseButton(main_window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-                double x, y;
-                glfwGetCursorPos(main_window, &x, &y);
-                FBO::Pixel selected_pixel = selection.ReadPixel(static_cast<GLuint>(x),  static_cast<GLuint>(abs(win.height - y)));
-                selection.currSel = selected_pixel.objID; 
-                NMRMesh::selID = selected_pixel.objID;
-            }
+        renderQueue.Flush();
+
+        // Outline once every spectrum has written its stencil values
+        if (selectedMesh != NULL) {
+            selectedMesh->DisplayStencil(outlinePass, win, camera, shaders);
+        }
+
+        // Axes are shared by all spectra
+        if (meshShown) {
+            glLineWidth(4.0f);
+            axis_lines.Draw(shaders["lines"], camera);
+            glLineWidth(1.0f);
         }
+        Profiler::End();
+        
+        MeshList(nmrMeshes, &loader);
+
+        // Release CPU copies of spectra that were not viewed recently
+        MemoryBudget::Enforce();
 
         // ******************
         // * Text Rendering *
         // ******************
 
+        Profiler::Begin("Text", true);
         ActivateTextSettings();
 
         if (nmrMeshes.empty() && lights.empty()) {
             float text_x = static_cast<float>(win.width) / 2.0f;
             float text_y = static_cast<float>(win.height) / 2.0f;
-            text_pos = t.RenderText(shaders["text"], "Welcome!", 
+            text_pos = t.RenderText("Welcome!", 
                          text_x, 
                          text_y + 50, 
                          1.0f, glm::vec3(0.0, 0.0, 0.0), true);
-            t.RenderText(shaders["text"], "Use File->Open or Ctrl+O",
+            t.RenderText("Use File->Open or Ctrl+O",
                          text_x,
                          text_y,
                          1.0f, glm::vec3(0.0, 0.0, 0.0), true);
-            t.RenderText(shaders["text"], "to open a file.",
+            t.RenderText("to open a file.",
                          text_x,
                          text_y - 50,
                          1.0f, glm::vec3(0.0, 0.0, 0.0), true);
@@ -405,15 +459,26 @@ int main()
                         prev_pos = text_pos;
             #endif // DEBUG
         }
+
+        // Draw all text queued this frame in one call
+        t.Flush(shaders["text"]);
         
         DeactivateTextSettings();
+        Profiler::End();
 
         // Render UI Window
+        Profiler::DisplayUI();
+        MemoryBudget::DisplayUI();
+        Profiler::Begin("ImGui", true);
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        Profiler::End();
 
         // Swap the buffers to update the screen each frame !!
+        Profiler::Begin("SwapBuffers");
         glfwSwapBuffers(main_window);
+        Profiler::End();
+        Profiler::EndFrame();
         // Update window events every loop, such as resizing, moving, min-max, and other events
         glfwPollEvents();
     }
@@ -422,15 +487,23 @@ int main()
     // * Deletion and Deallocation *
     // *****************************
 
-    if (nmrMesh != NULL) {
-        delete nmrMesh;
+    for (auto & [file, ptr] : nmrMeshes) {
+        if (ptr != NULL) {
+            delete ptr;
+            ptr = NULL;
+        }
     }
+    loader.Shutdown(); // Meshes still uploading are deleted while the context exists
     closeIMGUI(); // Close ImGui and remove GL link
     // Delete all shader programs
     for (auto & [name, shader] : shaders) {
         shader.Delete();
     }
     selection.Delete();
+    outlinePass.Delete();
+    renderQueue.Delete();
+    skybox.Delete();
+    t.Delete();
     glfwDestroyWindow(main_window); // Close window when complete
     glfwTerminate();                // Terminate glfw process
 
@@ -89,6 +89,8 @@ typedef unsigned int mode_t;
 
 #include "nmrtime.h"
 #include "memory.h"
+#include "uringio.h"
+#include "vutil.h"
 
 #ifdef FB_SYS_IO
 
@@ -130,6 +132,8 @@ static int stdBufInSize   = 0;
 static int stdBufOutSize  = 0;
 static int initDone       = 0;
 static int ioDebugFlag    = 0;
+static int uringFlag      = 1;
+static int directFlag     = 1;
 
 static char *stdBufIn     = (char *)NULL;
 static char *stdBufOut    = (char *)NULL;
@@ -138,6 +142,8 @@ static int  checkIOError  = 1;
 
 #define FPR (void)fprintf
 
+static void swapReport();
+
      
 /* initDataIO: initialize I/O settings via environment variables.
  ***/
@@ -216,6 +222,32 @@ int initDataIO()
         status += 16;
        }
 
+    if ((sPtr = getenv( "NMR_IO_URING" )))
+       {
+        if (!strcasecmp( sPtr, "YES" ))     uringFlag = 1;
+        if (!strcasecmp( sPtr, "TRUE" ))    uringFlag = 1;
+        if (!strcasecmp( sPtr, "1" ))       uringFlag = 1;
+
+        if (!strcasecmp( sPtr, "NO" ))      uringFlag = 0;
+        if (!strcasecmp( sPtr, "FALSE" ))   uringFlag = 0;
+        if (!strcasecmp( sPtr, "0" ))       uringFlag = 0;
+
+        status += 128;
+       }
+
+    if ((sPtr = getenv( "NMR_IO_DIRECT" )))
+       {
+        if (!strcasecmp( sPtr, "YES" ))     directFlag = 1;
+        if (!strcasecmp( sPtr, "TRUE" ))    directFlag = 1;
+        if (!strcasecmp( sPtr, "1" ))       directFlag = 1;
+
+        if (!strcasecmp( sPtr, "NO" ))      directFlag = 0;
+        if (!strcasecmp( sPtr, "FALSE" ))   directFlag = 0;
+        if (!strcasecmp( sPtr, "0" ))       directFlag = 0;
+
+        status += 256;
+       }
+
 /*
    if ((sPtr = getenv( "NMR_STDBUF_IN" )))
        {
@@ -797,7 +829,7 @@ int DataRead( inUnit, array, byteCount )
    NMR_INT byteCount;
 
 {
-    NMR_INT  count;
+    NMR_INT  count, nRead, nDone;
     int      error;
 
      
@@ -809,20 +841,60 @@ int DataRead( inUnit, array, byteCount )
     (void) initDataIO();
 
      
-/* Read the data:
+/* Large reads of regular files go through io_uring when available,
+ * which byte swaps each chunk as it arrives:
  ***/
 
+#ifdef FB_SYS_IO
+    if (uringFlag && (error = uringRead( inUnit, (char *)array, byteCount, byteSwapFlag, directFlag )) >= 0)
+       {
+        if (ioDebugFlag) rdCount++;
+
+        if (byteSwapFlag) swapReport( byteCount/sizeof(REAL4) );
+
+        return( error );
+       }
+
+    error = 0;
+#endif
+
+     
+/* Read the data; when byte swapping, read it in DATAIO_SWAP_CHUNK
+ * pieces and swap each one while it is still in cache:
+ ***/
+
+    count = 0;
+
+    while( count < byteCount )
+       {
+        nRead = byteCount - count;
+
+        if (byteSwapFlag && nRead > DATAIO_SWAP_CHUNK) nRead = DATAIO_SWAP_CHUNK;
+
 #ifdef FB_SYS_IO
    #ifdef _WIN
-   count = _read( inUnit, array, byteCount);
+        nDone = _read( inUnit, (char *)array + count, (unsigned int)nRead );
    #endif // _WIN
    #ifdef LINUX
-   count = (NMR_INT)read( inUnit, (IOPTR *)array, (IOSIZE)byteCount );
+        nDone = (NMR_INT)read( inUnit, (IOPTR *)((char *)array + count), (IOSIZE)nRead );
    #endif // LINUX
 #else
-    count = (NMR_INT)fread( (IOPTR *)array, (IOSIZE)1, (IOSIZE)byteCount, inUnit );
+        nDone = (NMR_INT)fread( (IOPTR *)((char *)array + count), (IOSIZE)1, (IOSIZE)nRead, inUnit );
 #endif
 
+        if (nDone > 0)
+           {
+            if (byteSwapFlag) (void) vByteSwap64( (float *)((char *)array + count), nDone/sizeof(REAL4) );
+            count += nDone;
+           }
+        else if (count == 0)
+           {
+            count = nDone;
+           }
+
+        if (nDone != nRead) break;
+       }
+
    if (ioDebugFlag) rdCount++;
 
      
@@ -837,7 +909,15 @@ int DataRead( inUnit, array, byteCount )
         error = 1;
        }
 
-   if (byteSwapFlag) (void) byteSwapV( array, byteCount/sizeof(REAL4) );
+/* Words past a short read are still swapped, as a whole-buffer swap would: */
+
+   if (byteSwapFlag)
+      {
+       swapReport( byteCount/sizeof(REAL4) );
+
+       if (count < 0) count = 0;
+       (void) vByteSwap64( array + count/sizeof(REAL4), byteCount/sizeof(REAL4) - count/sizeof(REAL4) );
+      }
  
    return( error );
 }
@@ -884,16 +964,30 @@ int DataReadB( inUnit, rArray, bytesRequested, maxTries, timeOut )
    int     maxTries, timeOut;
    REAL4   *rArray;
 {
-    NMR_INT count, bytesLeft;
+    NMR_INT count, bytesLeft, swapped, ready;
     NMR_INT tries;
     char    *array;
 
     array     = (char *)rArray;
     bytesLeft = bytesRequested;
     tries     = 0;
+    swapped   = 0;
 
     (void) initDataIO();
 
+/* Regular files never block, large reads of them can use io_uring: */
+
+#ifdef FB_SYS_IO
+    if (uringFlag && (count = uringRead( inUnit, array, bytesRequested, byteSwapFlag, directFlag )) >= 0)
+       {
+        if (ioDebugFlag) rdCount++;
+
+        if (byteSwapFlag) swapReport( bytesRequested/sizeof(REAL4) );
+
+        return( count ? -1 : 0 );
+       }
+#endif
+
 #ifdef DATAIO_USE_MAX_TRIES
     while( bytesLeft && (maxTries < 0 || tries++ < maxTries) )
 #else
@@ -931,6 +1025,15 @@ int DataReadB( inUnit, rArray, bytesRequested, maxTries, timeOut )
 
         bytesLeft -= count;
 
+/* Swap the words completed by this read while they are in cache: */
+
+        if (byteSwapFlag)
+           {
+            ready = (bytesRequested - bytesLeft)/sizeof(REAL4);
+            (void) vByteSwap64( rArray + swapped, ready - swapped );
+            swapped = ready;
+           }
+
 #ifdef DATAIO_USE_MAX_TRIES
         if (bytesLeft && (maxTries < 0 || tries < maxTries))
 #else
@@ -949,7 +1052,11 @@ int DataReadB( inUnit, rArray, bytesRequested, maxTries, timeOut )
            }
        }
 
-    if (byteSwapFlag) (void) byteSwapV( rArray, bytesRequested/sizeof(REAL4) );
+    if (byteSwapFlag)
+       {
+        swapReport( bytesRequested/sizeof(REAL4) );
+        (void) vByteSwap64( rArray + swapped, bytesRequested/sizeof(REAL4) - swapped );
+       }
 
     if (bytesLeft) return( -1 );
 
@@ -1853,8 +1960,19 @@ int byteSwapV( vec, length )
    float *vec;
    NMR_INT   length;
 {
-    union fsw { float f; char s[4]; } in, out;
+    swapReport( length );
+
+    return( vByteSwap64( vec, length ) );
+}
+
+     
+/* swapReport: announce a byte swap of length words in verbose mode.
+ ***/
+
+static void swapReport( length )
 
+   NMR_INT length;
+{
     if (autoSwapFlag > 1)
        {
 #ifdef NMR64
@@ -1863,20 +1981,6 @@ int byteSwapV( vec, length )
         FPR( stderr, " Byte Swap Data:   %d\n", length );
 #endif
        }
-
-    while( length-- )
-       {
-        in.f = *vec;
-
-        out.s[0] = in.s[3];
-        out.s[1] = in.s[2];
-        out.s[2] = in.s[1];
-        out.s[3] = in.s[0];
-
-        *vec++ = out.f;
-       }
-
-    return( 0 );
 }
 
      
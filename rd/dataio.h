@@ -16,6 +16,10 @@
 #define DATAIO_TIMEOUT 512
 #endif
 
+/* Byte swapped reads are done in pieces of this size, each swapped while still in cache: */
+
+#define DATAIO_SWAP_CHUNK (4*1024*1024)
+
 #ifdef LINUX
 #include <unistd.h>
 #endif // LINUX
@@ -17,7 +17,7 @@
 #endif
 
    int    setAlloc();
-   int    getMemUsed();
+   int    getMemUsed( NMR_INT *usedPtr, NMR_INT *reusedPtr );
    int    showAlloc();
    int    ShowCurrentAlloc();
 
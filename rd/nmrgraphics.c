@@ -6,6 +6,19 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef LINUX
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MESH_X86
+#include <immintrin.h>
+#endif
 
 #include "memory.h"
 #include "nmrgraphics.h"
@@ -168,6 +181,20 @@ shutdown:
    return( error );
 }
 
+/*
+ * Deallocate mesh and normal lists returned by mat2mesh and findGridNormals.
+ * NULL lists are ignored.
+ */
+
+int freeMesh( float *vertexList, int vertexCount, int *indexList, int indexCount, float *normXYZ, int normCount )
+{
+   if (vertexList) (void) deAlloc( "nmrgraphics", vertexList, sizeof(float)*3*vertexCount );
+   if (indexList)  (void) deAlloc( "nmrgraphics", indexList,  sizeof(int)*indexCount );
+   if (normXYZ)    (void) deAlloc( "nmrgraphics", normXYZ,    sizeof(float)*normCount );
+
+   return( 0 );
+}
+
 /* In progress. */
 
 int findGridNormals( float **normXYZPtr,  /* On return, allocated matrix of normals x1 y1 z1 .... [xSize*ySize*3]. Use deAlloc() to deallocate. */
@@ -263,6 +290,520 @@ int findGridNormals( float **normXYZPtr,  /* On return, allocated matrix of norm
    return( 0 );
 }
 
+/*
+ * Fused mesh kernel: builds the vertex list, index list and normals of mat2mesh and
+ * findGridNormals in a single pass over the matrix, split into bands of rows that are
+ * processed in parallel. Interior points use AVX2 or SSE2 when the CPU supports them,
+ * chosen at run time; the environment variable NMR_MESH_SIMD=SCALAR|SSE|AVX2 can lower
+ * the choice. Output is identical to mat2mesh followed by findGridNormals.
+ *
+ * threadCount is the number of threads to use, or 0 to use all available processors.
+ * Returns non-zero on error.
+ */
+
+#define MESH_SIMD_SCALAR 0
+#define MESH_SIMD_SSE    1
+#define MESH_SIMD_AVX2   2
+
+#define MESH_MIN_BAND    65536 /* Minimum number of points per thread. */
+
+struct meshBand
+{
+   float *mat, *vertexList, *normXYZ, *xList, *yList;
+   int   *indexList;
+   int   xSize, ySize, iy1, iy2, simd;
+   float minVal, maxVal, scale, offset;
+};
+
+/*
+ * Normal at one point, same arithmetic as findGridNormals.
+ */
+
+static void gridNormal( float *mPtr, int ixM, int ixP, int iyM, int iyP, float minVal, float maxVal, float *nPtr )
+{
+   float sNormX, sNormY, sNormZ, sMag, dx, dy, q;
+
+   if (mPtr[0] < minVal || mPtr[0] > maxVal)
+      {
+       nPtr[0] = 0.0;
+       nPtr[1] = 1.0;
+       nPtr[2] = 0.0;
+
+       return;
+      }
+
+   dx     = mPtr[ixP] - mPtr[ixM];
+   sNormX = dx == 0.0 ? 0.0 : (-2.0/dx)/sqrt( 4.0 + dx*dx );
+
+   dy     = mPtr[iyP] - mPtr[iyM];
+   sNormY = dy == 0.0 ? 0.0 : (-2.0/dy)/sqrt( 4.0 + dy*dy );
+
+   q = 1.0 - sNormX*sNormX + sNormY*sNormY;
+
+   sNormZ = q <= 0.0 ? 0.0 : sqrt( q );
+   sMag   = sqrt( sNormX*sNormX + sNormY*sNormY + sNormZ*sNormZ );
+
+   if (sMag == 0.0) sMag = 1.0;
+
+   nPtr[0] = sNormX/sMag;
+   nPtr[1] = sNormZ/sMag;
+   nPtr[2] = sNormY/sMag;
+}
+
+#ifdef MESH_X86
+
+/*
+ * SIMD versions compute W interior points at once into val, nx, ny, nz.
+ * Double precision steps of the scalar code are kept in double lanes so results match.
+ */
+
+__attribute__((target("avx2")))
+static __m256 slopeAVX2( __m256 d )
+{
+   __m256  d2;
+   __m256d dLo, dHi, d2Lo, d2Hi, rLo, rHi;
+
+   d2   = _mm256_mul_ps( d, d );
+
+   dLo  = _mm256_cvtps_pd( _mm256_castps256_ps128( d ) );
+   dHi  = _mm256_cvtps_pd( _mm256_extractf128_ps( d, 1 ) );
+   d2Lo = _mm256_cvtps_pd( _mm256_castps256_ps128( d2 ) );
+   d2Hi = _mm256_cvtps_pd( _mm256_extractf128_ps( d2, 1 ) );
+
+   rLo  = _mm256_div_pd( _mm256_div_pd( _mm256_set1_pd( -2.0 ), dLo ), _mm256_sqrt_pd( _mm256_add_pd( _mm256_set1_pd( 4.0 ), d2Lo ) ) );
+   rHi  = _mm256_div_pd( _mm256_div_pd( _mm256_set1_pd( -2.0 ), dHi ), _mm256_sqrt_pd( _mm256_add_pd( _mm256_set1_pd( 4.0 ), d2Hi ) ) );
+
+   return( _mm256_andnot_ps( _mm256_cmp_ps( d, _mm256_setzero_ps(), _CMP_EQ_OQ ),
+                             _mm256_set_m128( _mm256_cvtpd_ps( rHi ), _mm256_cvtpd_ps( rLo ) ) ) );
+}
+
+__attribute__((target("avx2")))
+static __m256 sqrtAVX2( __m256 v )
+{
+   __m256d lo, hi;
+
+   lo = _mm256_sqrt_pd( _mm256_cvtps_pd( _mm256_castps256_ps128( v ) ) );
+   hi = _mm256_sqrt_pd( _mm256_cvtps_pd( _mm256_extractf128_ps( v, 1 ) ) );
+
+   return( _mm256_set_m128( _mm256_cvtpd_ps( hi ), _mm256_cvtpd_ps( lo ) ) );
+}
+
+__attribute__((target("avx2")))
+static void meshPointsAVX2( float *mPtr, int iyM, int iyP, struct meshBand *b, float *val, float *nx, float *ny, float *nz )
+{
+   __m256  m, minV, maxV, clip, v, sx, sy, sx2, sy2, q, sz, sMag, one, zero;
+   __m256d qLo, qHi;
+
+   minV = _mm256_set1_ps( b->minVal );
+   maxV = _mm256_set1_ps( b->maxVal );
+   one  = _mm256_set1_ps( 1.0 );
+   zero = _mm256_setzero_ps();
+
+   m = _mm256_loadu_ps( mPtr );
+
+/* Vertex intensity, clipped and scaled. Operand order keeps NaN handling of the scalar code. */
+
+   v = _mm256_min_ps( maxV, _mm256_max_ps( minV, m ) );
+   v = _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( b->scale ), _mm256_sub_ps( v, minV ) ), _mm256_set1_ps( b->offset ) );
+
+   _mm256_storeu_ps( val, v );
+
+/* Normal. */
+
+   clip = _mm256_or_ps( _mm256_cmp_ps( m, minV, _CMP_LT_OQ ), _mm256_cmp_ps( m, maxV, _CMP_GT_OQ ) );
+
+   sx  = slopeAVX2( _mm256_sub_ps( _mm256_loadu_ps( mPtr + 1 ), _mm256_loadu_ps( mPtr - 1 ) ) );
+   sy  = slopeAVX2( _mm256_sub_ps( _mm256_loadu_ps( mPtr + iyP ), _mm256_loadu_ps( mPtr + iyM ) ) );
+
+   sx2 = _mm256_mul_ps( sx, sx );
+   sy2 = _mm256_mul_ps( sy, sy );
+
+   qLo = _mm256_add_pd( _mm256_sub_pd( _mm256_set1_pd( 1.0 ), _mm256_cvtps_pd( _mm256_castps256_ps128( sx2 ) ) ),
+                        _mm256_cvtps_pd( _mm256_castps256_ps128( sy2 ) ) );
+   qHi = _mm256_add_pd( _mm256_sub_pd( _mm256_set1_pd( 1.0 ), _mm256_cvtps_pd( _mm256_extractf128_ps( sx2, 1 ) ) ),
+                        _mm256_cvtps_pd( _mm256_extractf128_ps( sy2, 1 ) ) );
+   q   = _mm256_set_m128( _mm256_cvtpd_ps( qHi ), _mm256_cvtpd_ps( qLo ) );
+
+   sz   = _mm256_andnot_ps( _mm256_cmp_ps( q, zero, _CMP_LE_OQ ), sqrtAVX2( q ) );
+   sMag = sqrtAVX2( _mm256_add_ps( _mm256_add_ps( sx2, sy2 ), _mm256_mul_ps( sz, sz ) ) );
+   sMag = _mm256_blendv_ps( sMag, one, _mm256_cmp_ps( sMag, zero, _CMP_EQ_OQ ) );
+
+   _mm256_storeu_ps( nx, _mm256_blendv_ps( _mm256_div_ps( sx, sMag ), zero, clip ) );
+   _mm256_storeu_ps( ny, _mm256_blendv_ps( _mm256_div_ps( sz, sMag ), one,  clip ) );
+   _mm256_storeu_ps( nz, _mm256_blendv_ps( _mm256_div_ps( sy, sMag ), zero, clip ) );
+}
+
+static __m128 selectSSE( __m128 mask, __m128 a, __m128 b ) /* mask ? b : a */
+{
+   return( _mm_or_ps( _mm_andnot_ps( mask, a ), _mm_and_ps( mask, b ) ) );
+}
+
+static __m128 slopeSSE( __m128 d )
+{
+   __m128  d2;
+   __m128d dLo, dHi, d2Lo, d2Hi, rLo, rHi;
+
+   d2   = _mm_mul_ps( d, d );
+
+   dLo  = _mm_cvtps_pd( d );
+   dHi  = _mm_cvtps_pd( _mm_movehl_ps( d, d ) );
+   d2Lo = _mm_cvtps_pd( d2 );
+   d2Hi = _mm_cvtps_pd( _mm_movehl_ps( d2, d2 ) );
+
+   rLo  = _mm_div_pd( _mm_div_pd( _mm_set1_pd( -2.0 ), dLo ), _mm_sqrt_pd( _mm_add_pd( _mm_set1_pd( 4.0 ), d2Lo ) ) );
+   rHi  = _mm_div_pd( _mm_div_pd( _mm_set1_pd( -2.0 ), dHi ), _mm_sqrt_pd( _mm_add_pd( _mm_set1_pd( 4.0 ), d2Hi ) ) );
+
+   return( _mm_andnot_ps( _mm_cmpeq_ps( d, _mm_setzero_ps() ),
+                          _mm_movelh_ps( _mm_cvtpd_ps( rLo ), _mm_cvtpd_ps( rHi ) ) ) );
+}
+
+static __m128 sqrtSSE( __m128 v )
+{
+   __m128d lo, hi;
+
+   lo = _mm_sqrt_pd( _mm_cvtps_pd( v ) );
+   hi = _mm_sqrt_pd( _mm_cvtps_pd( _mm_movehl_ps( v, v ) ) );
+
+   return( _mm_movelh_ps( _mm_cvtpd_ps( lo ), _mm_cvtpd_ps( hi ) ) );
+}
+
+static void meshPointsSSE( float *mPtr, int iyM, int iyP, struct meshBand *b, float *val, float *nx, float *ny, float *nz )
+{
+   __m128  m, minV, maxV, clip, v, sx, sy, sx2, sy2, q, sz, sMag, one, zero;
+   __m128d qLo, qHi;
+
+   minV = _mm_set1_ps( b->minVal );
+   maxV = _mm_set1_ps( b->maxVal );
+   one  = _mm_set1_ps( 1.0 );
+   zero = _mm_setzero_ps();
+
+   m = _mm_loadu_ps( mPtr );
+
+   v = _mm_min_ps( maxV, _mm_max_ps( minV, m ) );
+   v = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( b->scale ), _mm_sub_ps( v, minV ) ), _mm_set1_ps( b->offset ) );
+
+   _mm_storeu_ps( val, v );
+
+   clip = _mm_or_ps( _mm_cmplt_ps( m, minV ), _mm_cmpgt_ps( m, maxV ) );
+
+   sx  = slopeSSE( _mm_sub_ps( _mm_loadu_ps( mPtr + 1 ), _mm_loadu_ps( mPtr - 1 ) ) );
+   sy  = slopeSSE( _mm_sub_ps( _mm_loadu_ps( mPtr + iyP ), _mm_loadu_ps( mPtr + iyM ) ) );
+
+   sx2 = _mm_mul_ps( sx, sx );
+   sy2 = _mm_mul_ps( sy, sy );
+
+   qLo = _mm_add_pd( _mm_sub_pd( _mm_set1_pd( 1.0 ), _mm_cvtps_pd( sx2 ) ), _mm_cvtps_pd( sy2 ) );
+   qHi = _mm_add_pd( _mm_sub_pd( _mm_set1_pd( 1.0 ), _mm_cvtps_pd( _mm_movehl_ps( sx2, sx2 ) ) ), _mm_cvtps_pd( _mm_movehl_ps( sy2, sy2 ) ) );
+   q   = _mm_movelh_ps( _mm_cvtpd_ps( qLo ), _mm_cvtpd_ps( qHi ) );
+
+   sz   = _mm_andnot_ps( _mm_cmple_ps( q, zero ), sqrtSSE( q ) );
+   sMag = sqrtSSE( _mm_add_ps( _mm_add_ps( sx2, sy2 ), _mm_mul_ps( sz, sz ) ) );
+   sMag = selectSSE( _mm_cmpeq_ps( sMag, zero ), sMag, one );
+
+   _mm_storeu_ps( nx, selectSSE( clip, _mm_div_ps( sx, sMag ), zero ) );
+   _mm_storeu_ps( ny, selectSSE( clip, _mm_div_ps( sz, sMag ), one ) );
+   _mm_storeu_ps( nz, selectSSE( clip, _mm_div_ps( sy, sMag ), zero ) );
+}
+
+#endif /* MESH_X86 */
+
+/*
+ * Choose SIMD level from CPU features and NMR_MESH_SIMD.
+ */
+
+static int meshSimdLevel()
+{
+   char *sPtr;
+   int  level;
+
+   level = MESH_SIMD_SCALAR;
+
+#ifdef MESH_X86
+   __builtin_cpu_init();
+
+   if (__builtin_cpu_supports( "avx2" ))
+      level = MESH_SIMD_AVX2;
+   else if (__builtin_cpu_supports( "sse2" ))
+      level = MESH_SIMD_SSE;
+#endif
+
+   if ((sPtr = getenv( "NMR_MESH_SIMD" )))
+      {
+       if (!strcasecmp( sPtr, "SCALAR" ))
+          level = MESH_SIMD_SCALAR;
+       else if (!strcasecmp( sPtr, "SSE" ) && level > MESH_SIMD_SSE)
+          level = MESH_SIMD_SSE;
+      }
+
+   return( level );
+}
+
+/*
+ * Vertices, normals and triangles for rows iy1 ... iy2-1 of the grid.
+ */
+
+static void *meshBandRows( void *arg )
+{
+   struct meshBand *b;
+   float *mPtr, *vPtr, *nPtr, val[8], nx[8], ny[8], nz[8];
+   int   *iPtr, ix, iy, i, w, xSize, ySize, iyM, iyP, locSW, locNW, locNE, locSE;
+
+   b     = (struct meshBand *)arg;
+   xSize = b->xSize;
+   ySize = b->ySize;
+
+   w = b->simd == MESH_SIMD_AVX2 ? 8 : b->simd == MESH_SIMD_SSE ? 4 : 0;
+
+   for( iy = b->iy1; iy < b->iy2; iy++ )
+      {
+       iyP = iy == 0         ?  xSize*(ySize - 1) : -xSize;
+       iyM = iy == ySize - 1 ? -xSize*(ySize - 1) :  xSize;
+
+       mPtr = b->mat + (NMR_INT)iy*xSize;
+       vPtr = b->vertexList + 3*(NMR_INT)iy*xSize;
+       nPtr = b->normXYZ + 3*(NMR_INT)iy*xSize;
+
+       ix = 0;
+
+       while( ix < xSize )
+          {
+           /* Interior points, W at a time; edges wrap and use the scalar code. */
+
+#ifdef MESH_X86
+           if (w && ix > 0 && ix + w < xSize)
+              {
+               if (b->simd == MESH_SIMD_AVX2)
+                  meshPointsAVX2( mPtr + ix, iyM, iyP, b, val, nx, ny, nz );
+               else
+                  meshPointsSSE( mPtr + ix, iyM, iyP, b, val, nx, ny, nz );
+
+               for( i = 0; i < w; i++ )
+                  {
+                   *vPtr++ = b->xList[ix + i];
+                   *vPtr++ = val[i];
+                   *vPtr++ = b->yList[iy];
+
+                   *nPtr++ = nx[i];
+                   *nPtr++ = ny[i];
+                   *nPtr++ = nz[i];
+                  }
+
+               ix += w;
+               continue;
+              }
+#endif
+           val[0] = mPtr[ix];
+
+           if (val[0] < b->minVal) val[0] = b->minVal;
+           if (val[0] > b->maxVal) val[0] = b->maxVal;
+
+           *vPtr++ = b->xList[ix];
+           *vPtr++ = b->scale*(val[0] - b->minVal) + b->offset;
+           *vPtr++ = b->yList[iy];
+
+           gridNormal( mPtr + ix, ix == 0 ? xSize - 1 : -1, ix == xSize - 1 ? 0 : 1, iyM, iyP, b->minVal, b->maxVal, nPtr );
+
+           nPtr += 3;
+           ix++;
+          }
+
+       /* Two tris for each rectangle between this row and the next. */
+
+       if (iy < ySize - 1)
+          {
+           iPtr = b->indexList + (NMR_INT)iy*(xSize - 1)*6;
+
+           for( ix = 0; ix < xSize - 1; ix++ )
+              {
+               locSW = ix*3 + iy*xSize*3;
+               locNW = locSW + xSize*3;
+               locNE = locNW + 3;
+               locSE = locSW + 3;
+
+               *iPtr++ = locSW;
+               *iPtr++ = locNW;
+               *iPtr++ = locNE;
+
+               *iPtr++ = locSW;
+               *iPtr++ = locNE;
+               *iPtr++ = locSE;
+              }
+          }
+      }
+
+   return( (void *)NULL );
+}
+
+int mat2meshNormals( float **vertexListPtr,  /* On return, allocated array of x,y,z vertex coords [3*vertexCount]. Use freeMesh() to deallocate. */
+                     int   *vertexCountPtr,  /* Number of vertices in vertexList.                                                                */
+                     int   **indexListPtr,   /* On return, allocated array of indices for mesh triangles (tris).                                 */
+                     int   *indexCountPtr,   /* Number of indices in indexList.                                                                  */
+                     float **normXYZPtr,     /* On return, allocated matrix of normals x1 y1 z1 .... [xSize*ySize*3]                             */
+                     int   *normCountPtr,    /* On return, size of normal matrix (3*xSize*ySize)                                                 */
+                     float *mat,             /* Input 2D matrix.                                                                                 */
+                     int   xSize,            /* X-axis size of 2D matrix.                                                                        */
+                     int   ySize,            /* Y-Axis size of 2D matrix.                                                                        */
+                     float minVal,           /* Lower value for clipping intensities in mat.                                                     */
+                     float maxVal,           /* Upper value for clipping intensities in mat.                                                     */
+                     float width1D,          /* Tri width for 1D mat data, 0.0 to 1.0.                                                           */
+                     int   threadCount )     /* Number of threads, 0 for all processors.                                                         */
+{
+   struct meshBand *bandList;
+   int   i, bandCount, rowsPerBand, simd, error;
+#ifdef LINUX
+   pthread_t *threadList;
+   int       *startedList;
+#endif
+
+   *normXYZPtr   = (float *)NULL;
+   *normCountPtr = 0;
+
+/* 1D and single point data are not fused, use the individual functions. */
+
+   if (xSize < 2 || ySize < 2)
+      {
+       if ((error = mat2mesh( vertexListPtr, vertexCountPtr, indexListPtr, indexCountPtr, mat, xSize, ySize, minVal, maxVal, width1D )))
+          {
+           return( error );
+          }
+
+       return( findGridNormals( normXYZPtr, normCountPtr, mat, xSize, ySize, minVal, maxVal ) ? 5 : 0 );
+      }
+
+   *vertexListPtr  = (float *)NULL;
+   *indexListPtr   = (int *)NULL;
+   *vertexCountPtr = 0;
+   *indexCountPtr  = 0;
+
+   bandList = (struct meshBand *)NULL;
+   error    = 0;
+
+   if (!(*vertexListPtr = fltAlloc( "nmrgraphics", 3*(NMR_INT)xSize*ySize ))) { error = 4; goto shutdown; }
+   *vertexCountPtr = xSize*ySize;
+
+   if (!(*indexListPtr = intAlloc( "nmrgraphics", (NMR_INT)(xSize - 1)*(ySize - 1)*6 ))) { error = 4; goto shutdown; }
+   *indexCountPtr = (xSize - 1)*(ySize - 1)*6;
+
+   if (!(*normXYZPtr = fltAlloc( "nmrgraphics", 3*(NMR_INT)xSize*ySize ))) { error = 4; goto shutdown; }
+   *normCountPtr = 3*xSize*ySize;
+
+/* Bands of rows, at least MESH_MIN_BAND points each. */
+
+   if (threadCount < 1)
+      {
+#ifdef LINUX
+       threadCount = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+       if (threadCount < 1) threadCount = 1;
+      }
+
+   bandCount = ((NMR_INT)xSize*ySize)/MESH_MIN_BAND;
+
+   if (bandCount > threadCount) bandCount = threadCount;
+   if (bandCount > ySize)       bandCount = ySize;
+   if (bandCount < 1)           bandCount = 1;
+
+   if (!(bandList = (struct meshBand *)voidAlloc( "nmrgraphics", sizeof(struct meshBand)*bandCount ))) { error = 4; goto shutdown; }
+
+   rowsPerBand = (ySize + bandCount - 1)/bandCount;
+   simd        = meshSimdLevel();
+
+   for( i = 0; i < bandCount; i++ )
+      {
+       bandList[i].mat        = mat;
+       bandList[i].vertexList = *vertexListPtr;
+       bandList[i].indexList  = *indexListPtr;
+       bandList[i].normXYZ    = *normXYZPtr;
+       bandList[i].xSize      = xSize;
+       bandList[i].ySize      = ySize;
+       bandList[i].iy1        = i*rowsPerBand;
+       bandList[i].iy2        = (i + 1)*rowsPerBand > ySize ? ySize : (i + 1)*rowsPerBand;
+       bandList[i].simd       = simd;
+       bandList[i].minVal     = minVal;
+       bandList[i].maxVal     = maxVal;
+       bandList[i].scale      = minVal == maxVal ? 1.0 :  2.0/(maxVal - minVal);
+       bandList[i].offset     = minVal == maxVal ? 0.0 : -1.0;
+       bandList[i].xList      = (float *)NULL;
+       bandList[i].yList      = (float *)NULL;
+      }
+
+   if (!(bandList[0].xList = fltAlloc( "nmrgraphics", xSize ))) { error = 2; goto shutdown; }
+   if (!(bandList[0].yList = fltAlloc( "nmrgraphics", ySize ))) { error = 3; goto shutdown; }
+
+   (void) vGenCoords( bandList[0].xList, xSize, (float)-1.0, (float)1.0 );
+   (void) vGenCoords( bandList[0].yList, ySize, (float)1.0,  (float)-1.0 );
+
+   for( i = 1; i < bandCount; i++ )
+      {
+       bandList[i].xList = bandList[0].xList;
+       bandList[i].yList = bandList[0].yList;
+      }
+
+#ifdef LINUX
+   threadList  = (pthread_t *)NULL;
+   startedList = (int *)NULL;
+
+   if (bandCount > 1)
+      {
+       threadList  = (pthread_t *)voidAlloc( "nmrgraphics", sizeof(pthread_t)*bandCount );
+       startedList = intAlloc( "nmrgraphics", bandCount );
+      }
+
+   if (threadList && startedList)
+      {
+       /* Band 0 runs on this thread. Bands whose thread can't start are run here too. */
+
+       for( i = 1; i < bandCount; i++ )
+          {
+           startedList[i] = !pthread_create( threadList + i, (pthread_attr_t *)NULL, meshBandRows, (void *)(bandList + i) );
+          }
+
+       (void) meshBandRows( (void *)bandList );
+
+       for( i = 1; i < bandCount; i++ )
+          {
+           if (startedList[i])
+              (void) pthread_join( threadList[i], (void **)NULL );
+           else
+              (void) meshBandRows( (void *)(bandList + i) );
+          }
+      }
+   else
+      {
+       for( i = 0; i < bandCount; i++ ) (void) meshBandRows( (void *)(bandList + i) );
+      }
+
+   if (threadList)  (void) deAlloc( "nmrgraphics", threadList, sizeof(pthread_t)*bandCount );
+   if (startedList) (void) deAlloc( "nmrgraphics", startedList, sizeof(int)*bandCount );
+#else
+   for( i = 0; i < bandCount; i++ ) (void) meshBandRows( (void *)(bandList + i) );
+#endif
+
+shutdown:
+
+   if (bandList)
+      {
+       if (bandList[0].xList) (void) deAlloc( "nmrgraphics", bandList[0].xList, sizeof(float)*xSize );
+       if (bandList[0].yList) (void) deAlloc( "nmrgraphics", bandList[0].yList, sizeof(float)*ySize );
+
+       (void) deAlloc( "nmrgraphics", bandList, sizeof(struct meshBand)*bandCount );
+      }
+
+   if (error)
+      {
+       (void) freeMesh( *vertexListPtr, *vertexCountPtr, *indexListPtr, *indexCountPtr, *normXYZPtr, *normCountPtr );
+
+       *vertexListPtr  = (float *)NULL;
+       *indexListPtr   = (int *)NULL;
+       *normXYZPtr     = (float *)NULL;
+       *vertexCountPtr = 0;
+       *indexCountPtr  = 0;
+       *normCountPtr   = 0;
+      }
+
+   return( error );
+}
+
 /*
  * Generate a list of N values from val1 to valN.
  */
@@ -18,6 +18,22 @@ int findGridNormals( float **normXYZPtr,  /* On return, allocated matrix of norm
                      float minVal,        /* Lower clipping value for intensities in mat                          */
                      float maxVal );      /* Upper clipping value for intensities in mat                          */
     
+int mat2meshNormals( float **vertexListPtr,  /* On return, allocated array of x,y,z vertex coords [3*vertexCount]. */
+                     int   *vertexCountPtr,  /* Number of vertices in vertexList.                                 */
+                     int   **indexListPtr,   /* On return, allocated array of indices for mesh triangles (tris).  */
+                     int   *indexCountPtr,   /* Number of indices in indexList.                                   */
+                     float **normXYZPtr,     /* On return, allocated matrix of normals [xSize*ySize*3]            */
+                     int   *normCountPtr,    /* On return, size of normal matrix (3*xSize*ySize)                  */
+                     float *mat,             /* Input 2D matrix.                                                  */
+                     int   xSize,            /* X-axis size of 2D matrix.                                         */
+                     int   ySize,            /* Y-Axis size of 2D matrix.                                         */
+                     float minVal,           /* Lower value for clipping intensities in mat.                      */
+                     float maxVal,           /* Upper value for clipping intensities in mat.                      */
+                     float width1D,          /* Tri width for 1D mat data, 0.0 to 1.0.                            */
+                     int   threadCount );    /* Number of threads, 0 for all processors.                          */
+
+int freeMesh( float *vertexList, int vertexCount, int *indexList, int indexCount, float *normXYZ, int normCount );
+
 int vGenCoords( float *xList, int n, float val1, float valN );
 
 #define vecMin( V, N ) vecMin64( V, (NMR_INT)((NMR_INT)(N)) );
@@ -5,6 +5,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef LINUX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #include "fdatap.h"
 #include "dataio.h"
 #include "inquire.h"
@@ -86,6 +93,202 @@ int readNMRU( int inUnit, float fdata[FDATASIZE], float **matPtr, int *sizeList,
     return( 0 );
 }
 
+/* Map entire matrix from single-file data without copying it to the heap:
+ *  Arguments and return values are the same as readNMR(), plus:
+ *  The file mapping address and size are returned in mapPtr and mapSizePtr.
+ *  If the data must be byte-swapped, or the file can't be mapped, the matrix
+ *  is read into a private heap copy instead, and mapPtr is returned as NULL.
+ *  Either way, use freeNMRMapped() to release the matrix.
+ ***/
+
+int readNMRMapped( char *inName, float fdata[FDATASIZE], float **matPtr, int *sizeList, int *qSizeList, NMR_INT *totalPts, int *qSizePtr, int *dimCountPtr, void **mapPtr, NMR_INT *mapSizePtr )
+{
+#ifdef LINUX
+    struct stat buff;
+    NMR_INT     mapSize;
+    void        *addr;
+    int         i, inUnit, error;
+
+    inUnit       = UNIT_NULL;
+    error        = 0;
+
+    *matPtr      = (float *)NULL;
+    *mapPtr      = (void *)NULL;
+    *mapSizePtr  = 0;
+    *totalPts    = 0;
+    *qSizePtr    = 0;
+    *dimCountPtr = 0;
+
+    for( i = 0; i < MAXDIM; i++ )
+       {
+        sizeList[i]  = 0;
+        qSizeList[i] = 0;
+       }
+
+    if (!fileExists( inName ))
+       {
+        return( 1 );
+       }
+
+    if ((error = dataOpen( inName, &inUnit, FB_READ )))
+       {
+        return( 2 );
+       }
+
+    if ((error = rdFDATAU( inUnit, fdata )))
+       {
+        (void) dataClose( inUnit );
+        return( 3 );
+       }
+
+    (void) getNMRParms( fdata, sizeList, qSizeList, totalPts, qSizePtr, dimCountPtr );
+
+    mapSize = sizeof(float)*(FDATASIZE + *totalPts);
+
+    if (fstat( inUnit, &buff ) || (NMR_INT)buff.st_size < mapSize)
+       {
+        (void) dataClose( inUnit );
+        return( 5 );
+       }
+
+/* Swapped data can't be used in place, so read a private copy instead: */
+
+    if (getByteSwapFlag())
+       {
+        error = readNMRU( inUnit, fdata, matPtr, sizeList, qSizeList, totalPts, qSizePtr, dimCountPtr );
+        (void) dataClose( inUnit );
+        return( error );
+       }
+
+    addr = mmap( (void *)NULL, (size_t)mapSize, PROT_READ, MAP_PRIVATE, inUnit, (off_t)0 );
+
+    if (addr == MAP_FAILED)
+       {
+        error = readNMRU( inUnit, fdata, matPtr, sizeList, qSizeList, totalPts, qSizePtr, dimCountPtr );
+        (void) dataClose( inUnit );
+        return( error );
+       }
+
+/* Start read-ahead without waiting for it; the mapping stays valid after close. */
+
+    (void) madvise( addr, (size_t)mapSize, MADV_WILLNEED );
+    (void) dataClose( inUnit );
+
+    *mapPtr     = addr;
+    *mapSizePtr = mapSize;
+    *matPtr     = (float *)addr + FDATASIZE;
+
+    return( 0 );
+#else
+    *mapPtr     = (void *)NULL;
+    *mapSizePtr = 0;
+
+    return( readNMR( inName, fdata, matPtr, sizeList, qSizeList, totalPts, qSizePtr, dimCountPtr ) );
+#endif
+}
+
+/* Release a matrix returned by readNMRMapped():
+ ***/
+
+int freeNMRMapped( float *mat, NMR_INT totalPts, void *mapPtr, NMR_INT mapSize )
+{
+#ifdef LINUX
+    if (mapPtr)
+       {
+        return( munmap( mapPtr, (size_t)mapSize ) ? 1 : 0 );
+       }
+#endif
+
+    if (mat) (void) deAlloc( "nmr", mat, sizeof(float)*totalPts );
+
+    return( 0 );
+}
+
+/* Read the header and sizes of single-file data without reading the matrix:
+ *  Arguments and return values are the same as readNMR(), without matPtr.
+ ***/
+
+int readNMRParms( char *inName, float fdata[FDATASIZE], int *sizeList, int *qSizeList, NMR_INT *totalPts, int *qSizePtr, int *dimCountPtr )
+{
+    int inUnit, error;
+
+    inUnit = UNIT_NULL;
+    error  = 0;
+
+    if (!fileExists( inName ))
+       {
+        return( 1 );
+       }
+
+    if ((error = dataOpen( inName, &inUnit, FB_READ )))
+       {
+        return( 2 );
+       }
+
+    if ((error = rdFDATAU( inUnit, fdata )))
+       {
+        (void) dataClose( inUnit );
+        return( 3 );
+       }
+
+    (void) dataClose( inUnit );
+
+    return( getNMRParms( fdata, sizeList, qSizeList, totalPts, qSizePtr, dimCountPtr ) );
+}
+
+/* Allocate and read one 2D plane from a single file of 3D/4D data, or from one file of a series:
+ *  The file header is returned in fdata.
+ *  Plane number planeIndex (counting from zero) of planePts points
+ *  is allocated and returned in planePtr, the rest of the file is not read.
+ *  Use freeNMRMapped() with a NULL mapPtr to release the plane.
+ ***/
+
+int readNMRPlane( char *inName, float fdata[FDATASIZE], float **planePtr, NMR_INT planePts, NMR_INT planeIndex )
+{
+    int   inUnit, error;
+    float *plane;
+
+    inUnit    = UNIT_NULL;
+    error     = 0;
+    *planePtr = (float *)NULL;
+
+    if (!fileExists( inName ))
+       {
+        return( 1 );
+       }
+
+    if ((error = dataOpen( inName, &inUnit, FB_READ )))
+       {
+        return( 2 );
+       }
+
+    if ((error = rdFDATAU( inUnit, fdata )))
+       {
+        (void) dataClose( inUnit );
+        return( 3 );
+       }
+
+    if (!(plane = fltAlloc( "nmr", planePts )))
+       {
+        (void) dataClose( inUnit );
+        return( 4 );
+       }
+
+    if ((error = dataPos( inUnit, sizeof(float)*(FDATASIZE + planeIndex*planePts) )) ||
+        (error = dataRead( inUnit, plane, sizeof(float)*planePts )))
+       {
+        (void) deAlloc( "nmr", plane, sizeof(float)*planePts );
+        (void) dataClose( inUnit );
+        return( 5 );
+       }
+
+    (void) dataClose( inUnit );
+
+    *planePtr = plane;
+
+    return( 0 );
+}
+
 int getNMRParms( float fdata[FDATASIZE], int *sizeList, int *qSizeList, NMR_INT *totalPts, int *qSizePtr, int *dimCountPtr )
 {
     int     i, dimCount, pipeFlag, cubeFlag, quadSize, xQuadSize, yQuadSize, zQuadSize, aQuadSize, error;
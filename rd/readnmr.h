@@ -1,4 +1,8 @@
 
 int readNMR( char *inName, float fdata[FDATASIZE], float **matPtr, int *sizeList, int *qSizeList, NMR_INT *totalPts, int *qSizePtr, int *dimCountPtr );
 int readNMRU( int inUnit,  float fdata[FDATASIZE], float **matPtr, int *sizeList, int *qSizeList, NMR_INT *totalPts, int *qSizePtr, int *dimCountPtr );
+int readNMRMapped( char *inName, float fdata[FDATASIZE], float **matPtr, int *sizeList, int *qSizeList, NMR_INT *totalPts, int *qSizePtr, int *dimCountPtr, void **mapPtr, NMR_INT *mapSizePtr );
+int freeNMRMapped( float *mat, NMR_INT totalPts, void *mapPtr, NMR_INT mapSize );
+int readNMRParms( char *inName, float fdata[FDATASIZE], int *sizeList, int *qSizeList, NMR_INT *totalPts, int *qSizePtr, int *dimCountPtr );
+int readNMRPlane( char *inName, float fdata[FDATASIZE], float **planePtr, NMR_INT planePts, NMR_INT planeIndex );
 int getNMRParms( float fdata[FDATASIZE], int *sizeList, int *qSizeList, NMR_INT *totalPts, int *qSizePtr, int *dimCountPtr );
@@ -0,0 +1,398 @@
+
+/*
+ * Bulk reads of regular files through Linux io_uring.
+ *
+ * A large read is split into URING_CHUNK_BYTES pieces with up to
+ * URING_DEPTH of them queued at once, so a fast device sees many
+ * outstanding requests instead of one. Chunks are byte swapped as
+ * they complete while the remaining chunks are still being read.
+ * Huge reads may bypass the page cache with O_DIRECT, through aligned
+ * bounce buffers since callers' buffers and offsets are not aligned.
+ *
+ * The ring is set up with raw system calls on first use, and kept for
+ * later reads. Like the rest of the library this is not thread safe.
+ */
+
+#ifdef LINUX
+#define _GNU_SOURCE   /* O_DIRECT */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uringio.h"
+#include "vutil.h"
+
+#if defined(LINUX) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define URING_IO
+#endif
+#endif
+
+#ifdef URING_IO
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+struct uringRing
+   {
+    int      fd;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void     *sqMap, *cqMap;
+    size_t   sqMapSize, cqMapSize, sqeMapSize;
+   };
+
+/* One queued chunk; a chunk is read again from where it stopped after a short read. */
+
+struct uringSlot
+   {
+    char    *dest;       /* Destination of the chunk in the caller's buffer.                   */
+    NMR_INT len;         /* Bytes of the chunk.                                                */
+    char    *target;     /* Read destination, dest or an aligned bounce buffer.                */
+    off_t   readStart;   /* File offset of target.                                             */
+    NMR_INT readLen;     /* Bytes to read into target, aligned for O_DIRECT.                   */
+    NMR_INT need;        /* Bytes of target that must arrive, readLen unless aligned past EOF. */
+    NMR_INT done;        /* Bytes of target read so far.                                       */
+    struct iovec iov;
+   };
+
+static struct uringRing ring;
+static int ringState = 0;   /* 0 not tried, 1 ready, -1 unavailable. */
+
+/* Slots stay valid after a failed read, in case the kernel still holds their iovecs. */
+
+static struct uringSlot slotList[URING_DEPTH];
+static char *bounceList[URING_DEPTH];
+
+/*
+ * Create the ring and map its queues.
+ */
+
+static int uringSetup()
+{
+   struct io_uring_params p;
+   int fd;
+
+   if (ringState) return( ringState > 0 );
+
+   ringState = -1;
+
+   (void) memset( &p, 0, sizeof(p) );
+
+   if ((fd = (int)syscall( __NR_io_uring_setup, URING_DEPTH, &p )) < 0) return( 0 );
+
+   ring.fd         = fd;
+   ring.sqMapSize  = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+   ring.cqMapSize  = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+   ring.sqeMapSize = p.sq_entries*sizeof(struct io_uring_sqe);
+
+   /* Kernels with a single mapping share it between both queues. */
+
+   if (p.features & IORING_FEAT_SINGLE_MMAP)
+      {
+       if (ring.cqMapSize > ring.sqMapSize) ring.sqMapSize = ring.cqMapSize;
+       ring.cqMapSize = ring.sqMapSize;
+      }
+
+   ring.sqMap = mmap( (void *)NULL, ring.sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+
+   if (ring.sqMap == MAP_FAILED)
+      {
+       (void) close( fd );
+       return( 0 );
+      }
+
+   if (p.features & IORING_FEAT_SINGLE_MMAP)
+      {
+       ring.cqMap = ring.sqMap;
+      }
+   else
+      {
+       ring.cqMap = mmap( (void *)NULL, ring.cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+
+       if (ring.cqMap == MAP_FAILED)
+          {
+           (void) munmap( ring.sqMap, ring.sqMapSize );
+           (void) close( fd );
+           return( 0 );
+          }
+      }
+
+   ring.sqes = (struct io_uring_sqe *)mmap( (void *)NULL, ring.sqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+
+   if (ring.sqes == MAP_FAILED)
+      {
+       if (ring.cqMap != ring.sqMap) (void) munmap( ring.cqMap, ring.cqMapSize );
+       (void) munmap( ring.sqMap, ring.sqMapSize );
+       (void) close( fd );
+       return( 0 );
+      }
+
+   ring.sqHead  = (unsigned *)((char *)ring.sqMap + p.sq_off.head);
+   ring.sqTail  = (unsigned *)((char *)ring.sqMap + p.sq_off.tail);
+   ring.sqMask  = (unsigned *)((char *)ring.sqMap + p.sq_off.ring_mask);
+   ring.sqArray = (unsigned *)((char *)ring.sqMap + p.sq_off.array);
+   ring.cqHead  = (unsigned *)((char *)ring.cqMap + p.cq_off.head);
+   ring.cqTail  = (unsigned *)((char *)ring.cqMap + p.cq_off.tail);
+   ring.cqMask  = (unsigned *)((char *)ring.cqMap + p.cq_off.ring_mask);
+   ring.cqes    = (struct io_uring_cqe *)((char *)ring.cqMap + p.cq_off.cqes);
+
+   ringState = 1;
+
+   return( 1 );
+}
+
+/*
+ * Queue a read of the unread part of slot s; the kernel sees it on the next uringEnter().
+ */
+
+static void uringQueue( int fd, int s )
+{
+   struct io_uring_sqe *sqe;
+   struct uringSlot    *slot;
+   unsigned            tail, index;
+
+   slot = slotList + s;
+
+   slot->iov.iov_base = slot->target + slot->done;
+   slot->iov.iov_len  = (size_t)(slot->readLen - slot->done);
+
+   tail  = *ring.sqTail;
+   index = tail & *ring.sqMask;
+   sqe   = ring.sqes + index;
+
+   (void) memset( sqe, 0, sizeof(*sqe) );
+
+   sqe->opcode    = IORING_OP_READV;
+   sqe->fd        = fd;
+   sqe->off       = (unsigned long long)(slot->readStart + slot->done);
+   sqe->addr      = (unsigned long long)(unsigned long)&slot->iov;
+   sqe->len       = 1;
+   sqe->user_data = (unsigned long long)s;
+
+   ring.sqArray[index] = index;
+
+   __atomic_store_n( ring.sqTail, tail + 1, __ATOMIC_RELEASE );
+}
+
+/*
+ * Submit queued reads and wait for at least one completion.
+ */
+
+static int uringEnter( unsigned submitCount )
+{
+   int count;
+
+   while( 1 )
+      {
+       count = (int)syscall( __NR_io_uring_enter, ring.fd, submitCount, 1, IORING_ENTER_GETEVENTS, (void *)NULL, 0 );
+
+       if (count >= 0 || errno != EINTR) return( count < 0 ? -1 : 0 );
+
+       /* Reads taken before the interruption are not submitted again. */
+
+       submitCount = 0;
+      }
+}
+
+/*
+ * Read byteCount bytes at offset start of fd into buffer.
+ * Returns 0 on success, otherwise the negative errno of the first failed chunk,
+ * or -EIO for a read past the end of the file.
+ */
+
+static int uringReadRange( int fd, char *buffer, off_t start, NMR_INT byteCount, int swapFlag, int directFlag )
+{
+   struct io_uring_cqe *cqe;
+   int      freeList[URING_DEPTH];
+   int      freeCount, active, error, s, res;
+   unsigned head, tail, queued;
+   NMR_INT  next, len;
+   off_t    skip;
+
+   error     = 0;
+   active    = 0;
+   queued    = 0;
+   next      = 0;
+   freeCount = URING_DEPTH;
+
+   for( s = 0; s < URING_DEPTH; s++ )
+      {
+       freeList[s]   = URING_DEPTH - 1 - s;
+       bounceList[s] = (char *)NULL;
+
+       if (directFlag && posix_memalign( (void **)(bounceList + s), URING_DIRECT_ALIGN, URING_CHUNK_BYTES + 2*URING_DIRECT_ALIGN ))
+          {
+           bounceList[s] = (char *)NULL;
+           error = -ENOMEM;
+          }
+      }
+
+   while( (next < byteCount && !error) || active )
+      {
+       /* Fill the queue while there are chunks left. */
+
+       while( !error && freeCount && next < byteCount )
+          {
+           s    = freeList[--freeCount];
+           len  = byteCount - next > URING_CHUNK_BYTES ? URING_CHUNK_BYTES : byteCount - next;
+
+           slotList[s].dest = buffer + next;
+           slotList[s].len  = len;
+           slotList[s].done = 0;
+
+           if (directFlag)
+              {
+               skip = (start + next) % URING_DIRECT_ALIGN;
+
+               slotList[s].target    = bounceList[s];
+               slotList[s].readStart = start + next - skip;
+               slotList[s].need      = skip + len;
+               slotList[s].readLen   = (slotList[s].need + URING_DIRECT_ALIGN - 1)/URING_DIRECT_ALIGN*URING_DIRECT_ALIGN;
+              }
+           else
+              {
+               slotList[s].target    = slotList[s].dest;
+               slotList[s].readStart = start + next;
+               slotList[s].need      = len;
+               slotList[s].readLen   = len;
+              }
+
+           uringQueue( fd, s );
+
+           next += len;
+           queued++;
+           active++;
+          }
+
+       if (!active) break;
+
+       if (uringEnter( queued ))
+          {
+           /* Reads may still be in flight, so the ring and its bounce buffers are abandoned. */
+
+           ringState = -1;
+           return( -EIO );
+          }
+
+       queued = 0;
+
+       /* Reap completions, swapping finished chunks while the others are in flight. */
+
+       head = *ring.cqHead;
+       tail = __atomic_load_n( ring.cqTail, __ATOMIC_ACQUIRE );
+
+       while( head != tail )
+          {
+           cqe = ring.cqes + (head & *ring.cqMask);
+           s   = (int)cqe->user_data;
+           res = cqe->res;
+
+           head++;
+
+           if (res == -EAGAIN || res == -EINTR) res = 0;
+           else if (res == 0) res = -EIO;
+
+           if (res < 0)
+              {
+               if (!error) error = res;
+              }
+           else
+              {
+               slotList[s].done += res;
+              }
+
+           if (!error && slotList[s].done < slotList[s].need)
+              {
+               uringQueue( fd, s );
+               queued++;
+               continue;
+              }
+
+           if (!error)
+              {
+               if (slotList[s].target != slotList[s].dest)
+                  {
+                   (void) memcpy( slotList[s].dest, slotList[s].target + slotList[s].need - slotList[s].len, (size_t)slotList[s].len );
+                  }
+
+               if (swapFlag) (void) vByteSwap64( (float *)slotList[s].dest, slotList[s].len/(NMR_INT)sizeof(float) );
+              }
+
+           freeList[freeCount++] = s;
+           active--;
+          }
+
+       __atomic_store_n( ring.cqHead, head, __ATOMIC_RELEASE );
+      }
+
+   for( s = 0; s < URING_DEPTH; s++ ) free( bounceList[s] );
+
+   return( error );
+}
+
+int uringRead( int inUnit, char *buffer, NMR_INT byteCount, int swapFlag, int directFlag )
+{
+   struct stat buff;
+   char  procName[64];
+   off_t start;
+   int   fd, error;
+
+   if (byteCount < URING_MIN_BYTES) return( -1 );
+
+   /* Pipes and sockets keep the blocking read path. */
+
+   if (fstat( inUnit, &buff ) || !S_ISREG( buff.st_mode )) return( -1 );
+
+   if ((start = lseek( inUnit, (off_t)0, SEEK_CUR )) < 0) return( -1 );
+
+   if (!uringSetup()) return( -1 );
+
+   error = -1;
+
+   /* Reopen for O_DIRECT, the position and flags of inUnit are left alone. */
+
+   if (directFlag && byteCount >= URING_DIRECT_BYTES)
+      {
+       (void) snprintf( procName, sizeof(procName), "/proc/self/fd/%d", inUnit );
+
+       if ((fd = open( procName, O_RDONLY | O_DIRECT )) >= 0)
+          {
+           error = uringReadRange( fd, buffer, start, byteCount, swapFlag, 1 );
+           (void) close( fd );
+          }
+      }
+
+   /* Chunks are read at explicit offsets, so a failed direct read is simply repeated through the page cache. */
+
+   if (error && ringState > 0) error = uringReadRange( inUnit, buffer, start, byteCount, swapFlag, 0 );
+
+   if (error)
+      {
+       (void) fprintf( stderr, "URINGIO File Read Error %d.\n", -error );
+       return( 1 );
+      }
+
+   (void) lseek( inUnit, start + (off_t)byteCount, SEEK_SET );
+
+   return( 0 );
+}
+
+#else
+
+int uringRead( int inUnit, char *buffer, NMR_INT byteCount, int swapFlag, int directFlag )
+{
+   return( -1 );
+}
+
+#endif
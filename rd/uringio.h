@@ -0,0 +1,29 @@
+/* uringio.h: bulk file reads through Linux io_uring.
+ ***/
+
+#include "prec.h"
+
+/* Reads below this size use a single read() call: */
+
+#define URING_MIN_BYTES    (4*1024*1024)
+
+/* Size of each queued read, and the number of reads in flight: */
+
+#define URING_CHUNK_BYTES  (1024*1024)
+#define URING_DEPTH        32
+
+/* Reads of at least this size bypass the page cache when directFlag is set: */
+
+#define URING_DIRECT_BYTES ((NMR_INT)256*1024*1024)
+
+/* Alignment of O_DIRECT offsets, sizes and buffers: */
+
+#define URING_DIRECT_ALIGN 4096
+
+/* Returns 0 on success, 1 on read error, or -1 if io_uring can't be used and nothing was read: */
+
+int uringRead( int   inUnit,       /* File descriptor of a regular file, read from its current position.           */
+               char  *buffer,      /* Destination of byteCount bytes.                                               */
+               NMR_INT byteCount,  /* Bytes to read; on success the file position moves past them.                */
+               int   swapFlag,     /* Byte swap each 4-byte word as its chunk completes.                            */
+               int   directFlag ); /* Use O_DIRECT for reads of at least URING_DIRECT_BYTES.                        */
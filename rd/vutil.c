@@ -4,8 +4,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <math.h>
 
+#ifdef LINUX
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SWAP_X86
+#include <immintrin.h>
+#endif
+
 #include "prec.h"
 #include "rand.h"
 #include "vutil.h"
@@ -1461,47 +1473,210 @@ int vByteSwap64( vec, length )
    float   *vec;
    NMR_INT length;
 {
-    union fsw { float f; char s[4]; } in, out;
+    return( byteSwap4( (void *)vec, length ) );
+}
 
-    if (!vec || length < 1) return( 0 );
+int iByteSwap64( vec, length )
 
-    while( length-- )
-       {
-        in.f = *vec;
+   int     *vec;
+   NMR_INT length;
+{
+    return( byteSwap4( (void *)vec, length ) );
+}
+
+     
+/* byteSwap4: reverse the bytes of each 4-byte word, shared by every byte swap.
+ * SSSE3 or AVX2 byte shuffles are chosen at run time; the environment variable
+ * NMR_SWAP_SIMD=SCALAR|SSSE3 can lower the choice. Vectors of at least
+ * 2*SWAP_MIN_BAND words are split into bands swapped on separate threads.
+ ***/
 
-        out.s[0] = in.s[3];
-        out.s[1] = in.s[2];
-        out.s[2] = in.s[1];
-        out.s[3] = in.s[0];
+#define SWAP_SIMD_SCALAR 0
+#define SWAP_SIMD_SSSE3  1
+#define SWAP_SIMD_AVX2   2
 
-        *vec++ = out.f;
-       }
+#define SWAP_MIN_BAND    ((NMR_INT)1024*1024) /* Minimum number of words per thread. */
 
-    return( 0 );
+struct swapBand
+{
+   unsigned int *vec;
+   NMR_INT      length;
+   int          simd;
+};
+
+static void swapWordsScalar( unsigned int *vec, NMR_INT length )
+{
+   unsigned int w;
+
+   while( length-- )
+      {
+       w = *vec;
+       *vec++ = (w >> 24) | ((w >> 8) & 0xFF00) | ((w << 8) & 0xFF0000) | (w << 24);
+      }
 }
 
-int iByteSwap64( vec, length )
+#ifdef SWAP_X86
 
-   int     *vec;
-   NMR_INT length;
+__attribute__((target("ssse3")))
+static NMR_INT swapWordsSSSE3( unsigned int *vec, NMR_INT length )
 {
-    union b2i { int i; char s[4]; } in, out;
+   __m128i order, a, b;
+   NMR_INT i;
 
-    if (!vec || length < 1) return( 0 );
+   order = _mm_set_epi8( 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3 );
 
-    while( length-- )
-       {
-        in.i = *vec;
+   for( i = 0; i + 8 <= length; i += 8 )
+      {
+       a = _mm_loadu_si128( (__m128i *)(vec + i) );
+       b = _mm_loadu_si128( (__m128i *)(vec + i + 4) );
 
-        out.s[0] = in.s[3];
-        out.s[1] = in.s[2];
-        out.s[2] = in.s[1];
-        out.s[3] = in.s[0];
+       _mm_storeu_si128( (__m128i *)(vec + i),     _mm_shuffle_epi8( a, order ) );
+       _mm_storeu_si128( (__m128i *)(vec + i + 4), _mm_shuffle_epi8( b, order ) );
+      }
 
-        *vec++ = out.i;
-       }
+   return( i );
+}
 
-    return( 0 );
+__attribute__((target("avx2")))
+static NMR_INT swapWordsAVX2( unsigned int *vec, NMR_INT length )
+{
+   __m256i order, a, b;
+   NMR_INT i;
+
+   order = _mm256_set_epi8( 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                            12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3 );
+
+   for( i = 0; i + 16 <= length; i += 16 )
+      {
+       a = _mm256_loadu_si256( (__m256i *)(vec + i) );
+       b = _mm256_loadu_si256( (__m256i *)(vec + i + 8) );
+
+       _mm256_storeu_si256( (__m256i *)(vec + i),     _mm256_shuffle_epi8( a, order ) );
+       _mm256_storeu_si256( (__m256i *)(vec + i + 8), _mm256_shuffle_epi8( b, order ) );
+      }
+
+   return( i );
+}
+
+#endif
+
+static int swapSimdLevel()
+{
+   static int level = -1;
+   char *sPtr;
+
+   if (level >= 0) return( level );
+
+   level = SWAP_SIMD_SCALAR;
+
+#ifdef SWAP_X86
+   __builtin_cpu_init();
+
+   if (__builtin_cpu_supports( "avx2" ))
+      level = SWAP_SIMD_AVX2;
+   else if (__builtin_cpu_supports( "ssse3" ))
+      level = SWAP_SIMD_SSSE3;
+#endif
+
+   if ((sPtr = getenv( "NMR_SWAP_SIMD" )))
+      {
+       if (!strcasecmp( sPtr, "SCALAR" ))
+          level = SWAP_SIMD_SCALAR;
+       else if (!strcasecmp( sPtr, "SSSE3" ) && level > SWAP_SIMD_SSSE3)
+          level = SWAP_SIMD_SSSE3;
+      }
+
+   return( level );
+}
+
+static void *swapBandWords( void *arg )
+{
+   struct swapBand *b;
+   NMR_INT         done;
+
+   b    = (struct swapBand *)arg;
+   done = 0;
+
+#ifdef SWAP_X86
+   if (b->simd == SWAP_SIMD_AVX2)
+      done = swapWordsAVX2( b->vec, b->length );
+   else if (b->simd == SWAP_SIMD_SSSE3)
+      done = swapWordsSSSE3( b->vec, b->length );
+#endif
+
+   swapWordsScalar( b->vec + done, b->length - done );
+
+   return( (void *)NULL );
+}
+
+int byteSwap4( void *vec, NMR_INT length )
+{
+   struct swapBand bandList[SWAP_MAX_THREADS];
+   NMR_INT         perBand, head, first, last;
+   int             i, bandCount;
+#ifdef LINUX
+   pthread_t       threadList[SWAP_MAX_THREADS];
+   int             startedList[SWAP_MAX_THREADS];
+#endif
+
+   if (!vec || length < 1) return( 0 );
+
+   bandCount = 1;
+
+#ifdef LINUX
+   if (length >= 2*SWAP_MIN_BAND)
+      {
+       bandCount = (int)sysconf( _SC_NPROCESSORS_ONLN );
+
+       if (bandCount > SWAP_MAX_THREADS)       bandCount = SWAP_MAX_THREADS;
+       if (bandCount > length/SWAP_MIN_BAND)   bandCount = (int)(length/SWAP_MIN_BAND);
+       if (bandCount < 1)                      bandCount = 1;
+      }
+#endif
+
+   /* Bands after the first start on 64-byte addresses, so threads never share
+    * a cache line; a vector that isn't 4-byte aligned can't be split this way.
+    */
+
+   head    = ((size_t)vec % 4) ? 0 : (NMR_INT)((64 - (size_t)vec % 64) % 64)/4;
+   perBand = (length + bandCount - 1)/bandCount;
+   perBand = (perBand + 15)/16*16;
+
+   for( i = 0; i < bandCount; i++ )
+      {
+       first = i == 0 ? 0 : head + i*perBand;
+       last  = i == bandCount - 1 ? length : head + (i + 1)*perBand;
+
+       if (first > length) first = length;
+       if (last  > length) last  = length;
+
+       bandList[i].vec    = (unsigned int *)vec + first;
+       bandList[i].length = last - first;
+       bandList[i].simd   = swapSimdLevel();
+      }
+
+#ifdef LINUX
+   /* Band 0 runs on this thread. Bands whose thread can't start are run here too. */
+
+   for( i = 1; i < bandCount; i++ )
+      {
+       startedList[i] = !pthread_create( threadList + i, (pthread_attr_t *)NULL, swapBandWords, (void *)(bandList + i) );
+      }
+
+   (void) swapBandWords( (void *)bandList );
+
+   for( i = 1; i < bandCount; i++ )
+      {
+       if (startedList[i])
+          (void) pthread_join( threadList[i], (void **)NULL );
+       else
+          (void) swapBandWords( (void *)(bandList + i) );
+      }
+#else
+   for( i = 0; i < bandCount; i++ ) (void) swapBandWords( (void *)(bandList + i) );
+#endif
+
+   return( 0 );
 }
 
 int vInterpol64( dest, src, inSize, outSize )
@@ -16,6 +16,12 @@ int rSet64();
 int vByteSwap64();
 int iByteSwap64();
 
+/* Largest number of threads used to byte swap one vector: */
+
+#define SWAP_MAX_THREADS 16
+
+int byteSwap4( void *vec, NMR_INT length );    /* Reverse bytes of length 4-byte words; shared by every byte swap. */
+
 int iiCopy64( int *dest, int *src, NMR_INT n );
 
 int mmCopy( float **dest, float **src, int xSize, int ySize );         /* src[ySize][xSize] is a series of vectors.                 */
@@ -0,0 +1,213 @@
+// Headless batch renderer writing a PNG preview of each NMRPipe spectrum
+//
+// Usage: thumbnails [-o directory] [-s size] [-j workers] [-l list] files...
+//
+// Files are read and meshed by the NMRLoader workers, drawn with the default
+// shader into an offscreen target, and encoded to PNG by the ImageWriter
+// workers, so reading, rendering, and encoding of different files overlap.
+
+// Object Headers
+#include "NMRMesh.hpp"
+#include "NMRLoader.hpp"
+#include "Light.hpp"
+#include "Shader.hpp"
+#include "Offscreen.hpp"
+#include "ImageWriter.hpp"
+
+// C/C++ Library Headers
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <set>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+// Default thumbnail edge length in pixels
+#define THUMBNAIL_SIZE 256
+
+static void usage(const char * program)
+{
+    printf("Usage: %s [-o directory] [-s size] [-j workers] [-l list] files...\n", program);
+    printf("  -o  Output directory, by default the current directory\n");
+    printf("  -s  Thumbnail width and height in pixels, by default %d\n", THUMBNAIL_SIZE);
+    printf("  -j  Worker threads for reading and for encoding, by default from hardware\n");
+    printf("  -l  Text file listing one NMR file per line\n");
+}
+
+int main(int argc, char ** argv)
+{
+    // *******************
+    // * Parse Arguments *
+    // *******************
+
+    std::string outDir = ".";
+    int size = THUMBNAIL_SIZE;
+    unsigned int workerCount = 0;
+    std::vector<std::string> files;
+    std::set<std::string> seen;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if ((arg == "-o" || arg == "-s" || arg == "-j" || arg == "-l") && i + 1 >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        if (arg == "-o") {
+            outDir = argv[++i];
+        } else if (arg == "-s") {
+            size = atoi(argv[++i]);
+        } else if (arg == "-j") {
+            workerCount = (unsigned int)atoi(argv[++i]);
+        } else if (arg == "-l") {
+            std::ifstream list(argv[++i]);
+            if (!list) {
+                printf("Could not open file list %s\n", argv[i]);
+                return -1;
+            }
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty() && seen.insert(line).second) files.push_back(line);
+            }
+        } else if (arg == "-h" || arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        } else if (seen.insert(arg).second) {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.empty() || size <= 0) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    std::error_code error;
+    fs::create_directories(outDir, error);
+
+    // *****************
+    // * Initialize GL *
+    // *****************
+
+    OffscreenContext context;
+
+    if (!context.Init()) {
+        std::cout << "Failed to create a headless OpenGL context!" << std::endl;
+        return -1;
+    }
+
+    glRenderSettings();
+    glDisable(GL_CULL_FACE);
+
+    // **********************
+    // * Initialize Shaders *
+    // **********************
+
+    std::string shader_path = fs::current_path().string() + "/Assets/Shaders/";
+
+    Shaders shaders;
+    initializeShaders(shaders, shader_path, {"default"});
+
+    // Single light orbiting the spectrum as in the viewer
+    Light light(0, LightType::POINT);
+    light.UpdateUniforms(shaders["default"]);
+
+    // Spectrum fills the frame seen from above and to the front
+    Camera camera(size, size, glm::vec3(0.0f, 2.2f, 2.6f));
+    camera.orientation = glm::normalize(-camera.position);
+    camera.view = glm::lookAt(camera.position, camera.position + camera.orientation, camera.up);
+    camera.UpdateMatrix(size, size);
+
+    OffscreenTarget target;
+    target.Init(size, size);
+
+    glm::vec4 bg_color = glm::vec4(1.0f);
+
+    // *******************
+    // * Render Spectra  *
+    // *******************
+
+    NMRLoader loader(workerCount);
+    loader.uploadBudget = 0; // Nothing else is drawn, upload each mesh at once
+
+    ImageWriter writer(workerCount);
+
+    // Files handed to the loader at once, bounds the memory of meshed spectra
+    size_t inFlight = std::max<size_t>(2 * std::max(workerCount, 1u), 4);
+
+    std::map<std::string, NMRMesh *> nmrMeshes;
+    OffscreenTarget::Image image;
+    size_t next = 0;
+    size_t rendered = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (next < files.size() || !nmrMeshes.empty() || target.Busy()) {
+        bool progress = false;
+
+        while (next < files.size() && nmrMeshes.size() < inFlight) {
+            nmrMeshes[files[next++]] = NULL;
+        }
+
+        // Failed files are printed and removed by Poll
+        loader.RequestMissing(nmrMeshes);
+        loader.Poll(nmrMeshes);
+
+        for (auto entry = nmrMeshes.begin(); entry != nmrMeshes.end();) {
+            NMRMesh * mesh = entry->second;
+
+            if (mesh == NULL) {
+                entry++;
+                continue;
+            }
+
+            // Wait for the oldest read before its buffer is reused
+            if (target.Full() && target.Poll(image, true)) {
+                writer.Write(image.name, image.pixels, image.width, image.height, 4);
+            }
+
+            target.Bind();
+            glClearColor(bg_color.x, bg_color.y, bg_color.z, bg_color.w);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+            mesh->SetPrimative(GL_TRIANGLES);
+            mesh->Draw(shaders["default"], camera, mesh->drawMat, mesh->pos, mesh->rot, mesh->nmrSize * mesh->scale);
+
+            std::string name = fs::path(entry->first).stem().string() + ".png";
+            target.Read((fs::path(outDir) / name).string());
+
+            delete mesh;
+            entry = nmrMeshes.erase(entry);
+            rendered++;
+            progress = true;
+        }
+
+        while (target.Poll(image)) {
+            writer.Write(image.name, image.pixels, image.width, image.height, 4);
+            progress = true;
+        }
+
+        // Reading and meshing happens on the loader workers
+        if (!progress) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    int failed = writer.Finish();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t written = rendered - failed;
+
+    printf("Wrote %zu of %zu thumbnails in %.2f s (%.1f files/s)\n",
+           written, files.size(), seconds, seconds > 0.0 ? written / seconds : 0.0);
+
+    // *****************************
+    // * Deletion and Deallocation *
+    // *****************************
+
+    loader.Shutdown();
+    target.Delete();
+    for (auto& [name, shader] : shaders) shader.Delete();
+    context.Delete();
+
+    return written == files.size() ? 0 : 1;
+}